@@ -0,0 +1,121 @@
+#version 450 core
+
+// One workgroup per batch of up to 64 meshlets of one instance. Every meshlet owns a fixed
+// indirect command, culled meshlets get an empty one so the draw count never has to be read back.
+layout (local_size_x = 64) in;
+
+struct Meshlet
+{
+	vec4 sphere;		// center, radius
+	vec4 cone;			// axis, cutoff
+	vec4 apex;
+	uint indexOffset;
+	uint indexCount;
+	uint padding0;
+	uint padding1;
+};
+
+struct Batch
+{
+	uint instance;
+	uint streamIndex;	// baseInstance of the commands, points at the instance in the instance stream
+	uint firstMeshlet;
+	uint meshletCount;
+	uint firstIndex;
+	int baseVertex;
+	uint firstCommand;
+	uint padding;
+};
+
+struct InstanceInfo
+{
+	mat4 transform;
+	mat4 normalTransform;
+	uint mesh;
+};
+
+struct DrawCommand
+{
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int baseVertex;
+	uint baseInstance;
+};
+
+layout (std430, binding = 2) readonly buffer InstanceInfos
+{
+	InstanceInfo u_Instances[];
+};
+
+layout (std430, binding = 3) readonly buffer Meshlets
+{
+	Meshlet u_Meshlets[];
+};
+
+layout (std430, binding = 4) readonly buffer Batches
+{
+	Batch u_Batches[];
+};
+
+layout (std430, binding = 6) writeonly buffer DrawCommands
+{
+	DrawCommand u_Commands[];
+};
+
+layout (std430, binding = 7) buffer Stats
+{
+	uint u_RenderedTriangles;
+};
+
+uniform mat4 u_ModelViewMatrix;
+uniform vec4 u_FrustumPlanes[6];	// view space, normalized
+
+// same test as IsMeshletVisible in Meshlets.cpp
+bool IsVisible(Meshlet meshlet, mat4 modelView)
+{
+	vec3 center = (modelView * vec4(meshlet.sphere.xyz, 1.0)).xyz;
+	float scale = max(length(modelView[0].xyz), max(length(modelView[1].xyz), length(modelView[2].xyz)));
+	float radius = meshlet.sphere.w * scale;
+
+	for (int i = 0; i < 6; i++)
+	{
+		if (dot(u_FrustumPlanes[i].xyz, center) + u_FrustumPlanes[i].w < -radius)
+			return false;
+	}
+
+	mat3 linear = mat3(modelView);
+	vec3 yz = cross(linear[1], linear[2]);
+	if (meshlet.cone.w < 1.0 && dot(linear[0], yz) > 0.0)
+	{
+		vec3 apex = (modelView * vec4(meshlet.apex.xyz, 1.0)).xyz;
+		mat3 cofactor = mat3(yz, cross(linear[2], linear[0]), cross(linear[0], linear[1]));
+		vec3 axis = normalize(cofactor * meshlet.cone.xyz);
+
+		if (dot(normalize(apex), axis) >= meshlet.cone.w)
+			return false;
+	}
+
+	return true;
+}
+
+void main()
+{
+	Batch batch = u_Batches[gl_WorkGroupID.x];
+	uint index = gl_LocalInvocationID.x;
+	if (index >= batch.meshletCount)
+		return;
+
+	Meshlet meshlet = u_Meshlets[batch.firstMeshlet + index];
+	bool visible = IsVisible(meshlet, u_ModelViewMatrix * u_Instances[batch.instance].transform);
+
+	uint slot = batch.firstCommand + index;
+	u_Commands[slot].count = visible ? meshlet.indexCount : 0;
+	u_Commands[slot].instanceCount = visible ? 1 : 0;
+	u_Commands[slot].firstIndex = batch.firstIndex + meshlet.indexOffset;
+	u_Commands[slot].baseVertex = batch.baseVertex;
+	u_Commands[slot].baseInstance = batch.streamIndex;
+
+	if (visible)
+		atomicAdd(u_RenderedTriangles, meshlet.indexCount / 3);
+}
@@ -1,11 +1,18 @@
 #version 450 core
 
+#if defined(GL_ARB_bindless_texture) && defined(GL_NV_gpu_shader5)
+#extension GL_ARB_bindless_texture : require
+#extension GL_NV_gpu_shader5 : require
+#define MESH_TEXTURES_BINDLESS
+#endif
+
 out vec4 FinalColor;
 
 in vec3 v_normal;
 in vec3 v_tangent;
 in vec3 v_bitangent;
 in vec2 v_uv;
+flat in uint v_meshIndex;
 
 uniform vec3	iEyePosition;			// camera position
 uniform vec3	iResolution;			// viewport resolution (in pixels)
@@ -17,12 +24,31 @@ uniform float	iChannelTime[16];		// channel playback time (in seconds)
 uniform vec3	iChannelResolution[16];	// channel resolution (in pixels)
 uniform vec4	iMouse;					// mouse pixel coords. xy: current (if MLB down), zw: click
 
+// Mesh textures. With bindless textures every mesh of a model is drawn at once and picks its
+// own handles, otherwise meshes are drawn in groups with their textures bound to units 0-5.
+// v_meshIndex is not dynamically uniform, so bindless also needs NV_gpu_shader5, the same
+// condition as MeshDrawList::IsBindless.
+// Normal maps are BC5 compressed and only hold xy, z = sqrt(1.0 - dot(xy, xy)).
+#ifdef MESH_TEXTURES_BINDLESS
+layout (std430, binding = 1) readonly buffer MeshTextures
+{
+	uvec2 u_MeshTextures[];		// 6 handles per mesh
+};
+
+#define Diffuse		sampler2D(u_MeshTextures[v_meshIndex * 6 + 0])	// Diffuse / Base Color
+#define SpecularMap	sampler2D(u_MeshTextures[v_meshIndex * 6 + 1])	// Specular / Metallness
+#define NormalMap	sampler2D(u_MeshTextures[v_meshIndex * 6 + 2])	// Normals / Normals Camera
+#define Shininess	sampler2D(u_MeshTextures[v_meshIndex * 6 + 3])	// Shininess / Diffuse Roughness
+#define LightMap	sampler2D(u_MeshTextures[v_meshIndex * 6 + 4])	// LightMap / Ambient Occlusion
+#define Emissive	sampler2D(u_MeshTextures[v_meshIndex * 6 + 5])	// Emissive / Emission Color
+#else
 layout (binding = 0) uniform sampler2D Diffuse;			// Diffuse / Base Color
 layout (binding = 1) uniform sampler2D SpecularMap;		// Specular / Metallness
 layout (binding = 2) uniform sampler2D NormalMap;		// Normals / Normals Camera
 layout (binding = 3) uniform sampler2D Shininess;		// Shininess / Diffuse Roughness
 layout (binding = 4) uniform sampler2D LightMap;		// LightMap / Ambient Occlusion
 layout (binding = 5) uniform sampler2D Emissive;		// Emissive / Emission Color
+#endif
 layout (binding = 6) uniform sampler2D iChannel6;
 layout (binding = 7) uniform sampler2D iChannel7;
 layout (binding = 8) uniform sampler2D iChannel8;
@@ -1,24 +1,78 @@
 #version 450 core
 
-layout (location = 0) in vec3 position;
-layout (location = 1) in vec3 normal;
-layout (location = 2) in vec3 tangent;
-layout (location = 3) in vec2 uv;
+// vec4 so the same inputs take both MeshVertex and PackedVertex data
+layout (location = 0) in vec4 position;
+layout (location = 1) in vec4 normal;
+layout (location = 2) in vec4 tangent;
+layout (location = 3) in vec4 uv;
+layout (location = 4) in uint instanceIndex;	// streamed per instance, starting at the command's baseInstance
+
+struct MeshInfo
+{
+	vec4 boundsMin;
+	vec4 boundsMax;
+};
+
+struct InstanceInfo
+{
+	mat4 transform;		// node transform of this placement of the mesh
+	mat4 normalTransform;	// inverse transpose of transform
+	uint mesh;
+};
+
+layout (std430, binding = 0) readonly buffer MeshInfos
+{
+	MeshInfo u_Meshes[];
+};
+
+layout (std430, binding = 2) readonly buffer InstanceInfos
+{
+	InstanceInfo u_Instances[];
+};
 
 out vec3 v_normal;
 out vec3 v_tangent;
 out vec3 v_bitangent;
 out vec2 v_uv;
+flat out uint v_meshIndex;
 
 uniform mat4 u_ProjectionMatrix;
 uniform mat4 u_ViewMatrix;
 uniform mat4 u_ModelMatrix;
 
+uniform bool u_PackedVertices;	// positions relative to the mesh bounds, octahedral normal and tangent
+
+vec3 DecodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+	return normalize(n);
+}
+
 void main()
 {
-	v_normal = normal;
-	v_tangent = normalize(tangent - dot(tangent, normal) * normal);
-	v_bitangent = cross(normal, tangent);
-	v_uv = uv;
-	gl_Position = u_ProjectionMatrix * u_ViewMatrix * u_ModelMatrix * vec4(position, 1);
-}
\ No newline at end of file
+	InstanceInfo instance = u_Instances[instanceIndex];
+	uint meshIndex = instance.mesh;
+
+	vec3 p = position.xyz;
+	vec3 n = normal.xyz;
+	vec3 t = tangent.xyz;
+
+	if (u_PackedVertices)
+	{
+		p = mix(u_Meshes[meshIndex].boundsMin.xyz, u_Meshes[meshIndex].boundsMax.xyz, position.xyz);
+		n = DecodeOctahedral(normal.xy);
+		t = DecodeOctahedral(tangent.xy);
+	}
+
+	n = normalize(mat3(instance.normalTransform) * n);
+	t = normalize(mat3(instance.transform) * t);
+
+	v_normal = n;
+	v_tangent = normalize(t - dot(t, n) * n);
+	v_bitangent = cross(n, t);
+	v_uv = uv.xy;
+	v_meshIndex = meshIndex;
+	gl_Position = u_ProjectionMatrix * u_ViewMatrix * u_ModelMatrix * instance.transform * vec4(p, 1);
+}
@@ -0,0 +1,65 @@
+#version 450 core
+
+out vec4 FinalColor;
+
+in vec2 iScreenQuadUV;
+flat in int iCubeFace;
+
+uniform vec3	iResolution;			// viewport resolution (in pixels)
+uniform float	iTime;					// shader playback time (in seconds)
+uniform float	iTimeDelta;				// render time (in seconds)
+uniform float	iFrameRate;				// shader frame rate
+uniform int		iFrame;					// shader playback frame
+uniform float	iChannelTime[16];		// channel playback time (in seconds)
+uniform vec3	iChannelResolution[16];	// channel resolution (in pixels)
+uniform vec4	iMouse;					// mouse pixel coords. xy: current (if MLB down), zw: click
+
+layout (binding = 0) uniform sampler2D iChannel0;
+layout (binding = 1) uniform sampler2D iChannel1;
+layout (binding = 2) uniform sampler2D iChannel2;
+layout (binding = 3) uniform sampler2D iChannel3;
+layout (binding = 4) uniform sampler2D iChannel4;
+layout (binding = 5) uniform sampler2D iChannel5;
+layout (binding = 6) uniform sampler2D iChannel6;
+layout (binding = 7) uniform sampler2D iChannel7;
+layout (binding = 8) uniform sampler2D iChannel8;
+layout (binding = 9) uniform sampler2D iChannel9;
+layout (binding = 10) uniform sampler2D iChannel10;
+layout (binding = 11) uniform sampler2D iChannel11;
+layout (binding = 12) uniform sampler2D iChannel12;
+layout (binding = 13) uniform sampler2D iChannel13;
+layout (binding = 14) uniform sampler2D iChannel14;
+layout (binding = 15) uniform sampler2D iChannel15;
+
+void mainCubemap( out vec4 fragColor, in vec2 fragCoord, in vec3 rayOri, in vec3 rayDir );
+
+// Direction through the texel in the GL face order +X -X +Y -Y +Z -Z
+vec3 cubeFaceDirection(int face, vec2 uv)
+{
+	vec2 p = uv * 2.0 - 1.0;
+	switch (face)
+	{
+	case 0: return vec3(1.0, -p.y, -p.x);
+	case 1: return vec3(-1.0, -p.y, p.x);
+	case 2: return vec3(p.x, 1.0, p.y);
+	case 3: return vec3(p.x, -1.0, -p.y);
+	case 4: return vec3(p.x, -p.y, 1.0);
+	default: return vec3(-p.x, -p.y, -1.0);
+	}
+}
+
+void main()
+{
+	mainCubemap(FinalColor, gl_FragCoord.xy, vec3(0.0), normalize(cubeFaceDirection(iCubeFace, iScreenQuadUV)));
+}
+
+// ----------------------------------------------------------------------
+
+void mainCubemap( out vec4 fragColor, in vec2 fragCoord, in vec3 rayOri, in vec3 rayDir )
+{
+	// Sky gradient with a sun, sample it in another pass with texture(iChannelN, direction)
+	vec3 sun = normalize(vec3(0.6, 0.4, -0.7 + 0.3 * sin(iTime)));
+	vec3 sky = mix(vec3(0.35, 0.3, 0.25), vec3(0.25, 0.45, 0.85), smoothstep(-0.2, 0.4, rayDir.y));
+	sky += vec3(1.0, 0.85, 0.6) * pow(max(dot(rayDir, sun), 0.0), 256.0) * 4.0;
+	fragColor = vec4(sky, 1.0);
+}
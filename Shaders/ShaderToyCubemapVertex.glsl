@@ -0,0 +1,17 @@
+#version 450 core
+#extension GL_ARB_shader_viewport_layer_array : require
+
+layout (location = 0) in vec4 position;
+layout (location = 1) in vec2 uv;
+
+out vec2 iScreenQuadUV;
+flat out int iCubeFace;
+
+// One instance per face, a single layered draw writes all six
+void main()
+{
+	iScreenQuadUV = uv;
+	iCubeFace = gl_InstanceID;
+	gl_Layer = gl_InstanceID;
+	gl_Position = position;
+}
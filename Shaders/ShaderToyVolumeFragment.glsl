@@ -0,0 +1,55 @@
+#version 450 core
+
+out vec4 FinalColor;
+
+in vec2 iScreenQuadUV;
+
+uniform vec3	iResolution;			// viewport resolution (in pixels)
+uniform float	iTime;					// shader playback time (in seconds)
+uniform float	iTimeDelta;				// render time (in seconds)
+uniform float	iFrameRate;				// shader frame rate
+uniform int		iFrame;					// shader playback frame
+uniform float	iChannelTime[16];		// channel playback time (in seconds)
+uniform vec3	iChannelResolution[16];	// channel resolution (in pixels)
+uniform vec4	iMouse;					// mouse pixel coords. xy: current (if MLB down), zw: click
+uniform int		iSlice;					// volume slice being written
+
+layout (binding = 0) uniform sampler2D iChannel0;
+layout (binding = 1) uniform sampler2D iChannel1;
+layout (binding = 2) uniform sampler2D iChannel2;
+layout (binding = 3) uniform sampler2D iChannel3;
+layout (binding = 4) uniform sampler2D iChannel4;
+layout (binding = 5) uniform sampler2D iChannel5;
+layout (binding = 6) uniform sampler2D iChannel6;
+layout (binding = 7) uniform sampler2D iChannel7;
+layout (binding = 8) uniform sampler2D iChannel8;
+layout (binding = 9) uniform sampler2D iChannel9;
+layout (binding = 10) uniform sampler2D iChannel10;
+layout (binding = 11) uniform sampler2D iChannel11;
+layout (binding = 12) uniform sampler2D iChannel12;
+layout (binding = 13) uniform sampler2D iChannel13;
+layout (binding = 14) uniform sampler2D iChannel14;
+layout (binding = 15) uniform sampler2D iChannel15;
+
+void mainVolume( out vec4 fragColor, in vec3 fragCoord );
+
+// One draw per slice, fragCoord.z is the slice center like xy are pixel centers
+void main()
+{
+	mainVolume(FinalColor, vec3(gl_FragCoord.xy, float(iSlice) + 0.5));
+}
+
+// ----------------------------------------------------------------------
+
+void mainVolume( out vec4 fragColor, in vec3 fragCoord )
+{
+	// Animated density field, sample it in another pass with texture(iChannelN, uvw)
+	vec3 p = fragCoord / iResolution * 2.0 - 1.0;
+	float density = 0.0;
+	for (int i = 0; i < 3; i++)
+	{
+		vec3 center = 0.5 * vec3(sin(iTime + float(i) * 2.1), cos(iTime * 0.7 + float(i)), sin(iTime * 0.5 + float(i) * 1.3));
+		density += 0.08 / max(dot(p - center, p - center), 0.01);
+	}
+	fragColor = vec4(vec3(0.5) + 0.5 * p, clamp(density, 0.0, 1.0));
+}
@@ -0,0 +1,65 @@
+// ---- virtual textures --------------------------------------------------
+// Added for channels that hold a virtual texture, sample them with textureVirtual(iChannelN, N, uv).
+// iChannelN is the atlas of resident pages, the page table of channel N is on unit 16 + N.
+
+layout (binding = 16) uniform usampler2D iPageTable[16];
+
+layout (std430, binding = 8) buffer iVirtualFeedbackBuffer
+{
+	uint iVirtualFeedback[];	// a bit per page the last frames wanted, 65536 words per channel
+};
+
+const float VT_PAGE_SIZE = 128.0;
+const float VT_PAGE_BORDER = 4.0;
+const float VT_PAGE_CONTENT = 120.0;
+
+// `texel` is in level 0 texels of the image
+vec4 textureVirtualLevel(sampler2D atlas, int channel, vec2 texel, int level)
+{
+	ivec2 page = ivec2(texel / (VT_PAGE_CONTENT * float(1 << level)));
+	uvec4 entry = texelFetch(iPageTable[channel], page, level);
+	if (entry.w == 0u)
+		return vec4(0.0);
+
+	// the entry is the closest resident page, at this level or a coarser one
+	vec2 resident = texel / float(1u << entry.z);
+	vec2 inPage = resident - floor(resident / VT_PAGE_CONTENT) * VT_PAGE_CONTENT;
+	vec2 atlasTexel = vec2(entry.xy) * VT_PAGE_SIZE + VT_PAGE_BORDER + inPage;
+	return textureLod(atlas, atlasTexel / vec2(textureSize(atlas, 0)), 0.0);
+}
+
+// Samples the image at `uv`, repeating outside [0, 1], blending the two mips the footprint falls between
+vec4 textureVirtual(sampler2D atlas, int channel, vec2 uv)
+{
+	vec2 size = iChannelResolution[channel].xy;
+	int levels = textureQueryLevels(iPageTable[channel]);
+	if (levels == 0 || size.x == 0.0)
+		return vec4(0.0);
+
+	// the footprint is taken before wrapping, fract would make it jump at the seams
+	vec2 dx = dFdx(uv * size);
+	vec2 dy = dFdy(uv * size);
+	float lod = clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))), 0.0, float(levels - 1));
+	int level = int(lod);
+
+	vec2 texel = fract(uv) * size;
+
+	// one pixel in a 4x4 block reports per frame, a different one each frame, so the atomics stay cheap
+	ivec2 pixel = ivec2(gl_FragCoord.xy) & 3;
+	if (pixel.x + pixel.y * 4 == (iFrame & 15))
+	{
+		int grid = textureSize(iPageTable[channel], 0).x;
+		uint id = 0u;
+		for (int i = 0; i < level; i++)
+			id += uint((grid >> i) * (grid >> i));
+
+		ivec2 page = ivec2(texel / (VT_PAGE_CONTENT * float(1 << level)));
+		id += uint(page.y * (grid >> level) + page.x);
+		atomicOr(iVirtualFeedback[uint(channel) * 65536u + id / 32u], 1u << (id % 32u));
+	}
+
+	vec4 fine = textureVirtualLevel(atlas, channel, texel, level);
+	vec4 coarse = textureVirtualLevel(atlas, channel, texel, min(level + 1, levels - 1));
+	return mix(fine, coarse, fract(lod));
+}
+// ------------------------------------------------------------------------
@@ -0,0 +1,479 @@
+// Loads a directory of images the way TextureStreamer does for RGBA8 textures: decode on the CPU,
+// copy into a mapped staging buffer and upload from there, then generate the mips on the GPU.
+// Every image is loaded with stb_image and with the system library built in for its extension, if
+// any. It reports median decode, upload, mip and total times per image as JSON, plus the speedup
+// of what DecodeImage picks over stb_image for all of them. A multi-threaded run then decodes the
+// whole directory on worker threads while the main thread uploads, like the streamer, and reports
+// the wall time per decoder.
+//
+// usage: ImageLoadBenchmark <image directory> [options]
+//   --iterations <n>     single-threaded loads per image and decoder, the median is reported (default 3)
+//   --threads <n>        decoding threads of the multi-threaded run, default all cores but one
+//   --decode-only        no OpenGL context, decode times only
+//   --output <file>      write the JSON there instead of stdout
+//
+// Runs on Mesa llvmpipe (LIBGL_ALWAYS_SOFTWARE=1). Without a display GLFW falls back to its
+// null platform with an OSMesa context.
+
+#include "ImageDecoder.h"
+#include "TextureCompression.h"
+#include "glad/gl.h"
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::high_resolution_clock;
+
+struct LoadTimes
+{
+	bool ok{};
+	double decodeMs{};
+	double uploadMs{};
+	double mipMs{};
+	double totalMs{};
+};
+
+struct ImageResult
+{
+	std::string name;
+	int width{};
+	int height{};
+	size_t fileBytes{};
+	ImageDecoder system{ ImageDecoder::StbImage };
+	ImageDecoder selected{ ImageDecoder::StbImage };
+	LoadTimes stb;
+	LoadTimes other;		// with `system`, when that is not stb_image
+};
+
+struct ThreadedResult
+{
+	ImageDecoder decoder;
+	double wallMs{};
+	size_t images{};
+	size_t bytes{};
+};
+
+static double Ms(Clock::time_point a, Clock::time_point b)
+{
+	return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+static double Median(std::vector<double> values)
+{
+	if (values.empty())
+		return 0.0;
+	std::sort(values.begin(), values.end());
+	return values[values.size() / 2];
+}
+
+static std::string EscapeJson(const std::string& text)
+{
+	std::string out;
+	out.reserve(text.size());
+	for (char c : text)
+	{
+		switch (c)
+		{
+		case '"': out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\r': break;
+		case '\t': out += "\\t"; break;
+		default: out += c; break;
+		}
+	}
+	return out;
+}
+
+static bool CreateContext(GLFWwindow*& window)
+{
+	auto hint_window = [] {
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	};
+
+	if (glfwInit())
+	{
+		hint_window();
+		window = glfwCreateWindow(64, 64, "ImageLoadBenchmark", nullptr, nullptr);
+		if (window)
+			return true;
+		glfwTerminate();
+	}
+
+	// no display available, try an offscreen OSMesa (llvmpipe) context
+	glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+	if (!glfwInit())
+		return false;
+
+	hint_window();
+	glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+	window = glfwCreateWindow(64, 64, "ImageLoadBenchmark", nullptr, nullptr);
+	return window != nullptr;
+}
+
+// Persistently mapped like the streamer's, grown to the largest image
+class Staging
+{
+public:
+	~Staging() { Destroy(); }
+
+	uint8_t* Reserve(size_t bytes)
+	{
+		if (bytes > size)
+		{
+			Destroy();
+			size = bytes;
+			auto flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glCreateBuffers(1, &buffer);
+			glNamedBufferStorage(buffer, GLsizeiptr(size), nullptr, flags);
+			data = (uint8_t*)glMapNamedBufferRange(buffer, 0, GLsizeiptr(size), flags);
+		}
+		return data;
+	}
+
+	GLuint GetBuffer() const { return buffer; }
+
+private:
+	void Destroy()
+	{
+		if (buffer)
+		{
+			glUnmapNamedBuffer(buffer);
+			glDeleteBuffers(1, &buffer);
+		}
+		buffer = 0;
+		data = nullptr;
+		size = 0;
+	}
+
+	GLuint buffer{ 0 };
+	uint8_t* data{ nullptr };
+	size_t size{ 0 };
+};
+
+// Upload and mips of one decoded image, glFinish makes the GPU side part of the timings
+static void UploadImage(Staging& staging, const uint8_t* pixels, int width, int height, double& uploadMs, double& mipMs)
+{
+	auto start = Clock::now();
+
+	auto bytes = size_t(width) * size_t(height) * 4;
+	memcpy(staging.Reserve(bytes), pixels, bytes);
+
+	GLuint texture = 0;
+	glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+	glTextureStorage2D(texture, GetMipLevelCount(width, height), GL_RGBA8, width, height);
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.GetBuffer());
+	glTextureSubImage2D(texture, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	glFinish();
+	auto uploaded = Clock::now();
+
+	glGenerateTextureMipmap(texture);
+	glFinish();
+	auto mipmapped = Clock::now();
+
+	glDeleteTextures(1, &texture);
+
+	uploadMs = Ms(start, uploaded);
+	mipMs = Ms(uploaded, mipmapped);
+}
+
+static LoadTimes LoadSerial(const fs::path& path, ImageDecoder decoder, int iterations, Staging* staging, int& width, int& height)
+{
+	LoadTimes times;
+	std::vector<double> decode, upload, mip, total;
+
+	for (int it = 0; it < iterations; it++)
+	{
+		auto start = Clock::now();
+		auto pixels = DecodeImage(path, false, width, height, decoder);
+		auto decoded = Clock::now();
+
+		times.ok = pixels != nullptr;
+		if (!times.ok)
+			return times;
+
+		double upload_ms = 0.0, mip_ms = 0.0;
+		if (staging)
+			UploadImage(*staging, pixels, width, height, upload_ms, mip_ms);
+
+		FreeDecodedImage(pixels);
+
+		decode.push_back(Ms(start, decoded));
+		upload.push_back(upload_ms);
+		mip.push_back(mip_ms);
+		total.push_back(Ms(start, Clock::now()));
+	}
+
+	times.decodeMs = Median(decode);
+	times.uploadMs = Median(upload);
+	times.mipMs = Median(mip);
+	times.totalMs = Median(total);
+	return times;
+}
+
+// Workers decode the whole directory while this thread uploads whatever is done, `Auto` uses the
+// fast decoders where there are some
+static ThreadedResult LoadThreaded(const std::vector<fs::path>& files, ImageDecoder decoder, unsigned int threadCount, Staging* staging)
+{
+	struct Decoded
+	{
+		uint8_t* pixels;
+		int width;
+		int height;
+	};
+
+	ThreadedResult result;
+	result.decoder = decoder;
+
+	std::mutex mutex;
+	std::condition_variable ready;
+	std::deque<Decoded> decoded;
+	std::atomic<size_t> next{ 0 };
+	size_t finished = 0;
+
+	auto start = Clock::now();
+
+	std::vector<std::thread> workers;
+	for (unsigned int i = 0; i < threadCount; i++)
+	{
+		workers.emplace_back([&] {
+			for (size_t index; (index = next++) < files.size();)
+			{
+				Decoded image{};
+				image.pixels = DecodeImage(files[index], false, image.width, image.height, decoder);
+
+				std::lock_guard lock(mutex);
+				decoded.push_back(image);
+				ready.notify_one();
+			}
+		});
+	}
+
+	while (finished < files.size())
+	{
+		Decoded image{};
+		{
+			std::unique_lock lock(mutex);
+			ready.wait(lock, [&] { return !decoded.empty(); });
+			image = decoded.front();
+			decoded.pop_front();
+		}
+		finished++;
+
+		if (image.pixels == nullptr)
+			continue;
+
+		double upload_ms = 0.0, mip_ms = 0.0;
+		if (staging)
+			UploadImage(*staging, image.pixels, image.width, image.height, upload_ms, mip_ms);
+
+		result.images++;
+		result.bytes += size_t(image.width) * size_t(image.height) * 4;
+		FreeDecodedImage(image.pixels);
+	}
+
+	result.wallMs = Ms(start, Clock::now());
+
+	for (auto& worker : workers)
+		worker.join();
+
+	return result;
+}
+
+static void WriteTimes(std::stringstream& json, const char* key, const LoadTimes& times)
+{
+	json << "\"" << key << "\": { \"ok\": " << (times.ok ? "true" : "false")
+		<< ", \"decode_ms\": " << times.decodeMs << ", \"upload_ms\": " << times.uploadMs
+		<< ", \"mip_ms\": " << times.mipMs << ", \"total_ms\": " << times.totalMs << " }";
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <image directory> [--iterations n] [--threads n] [--decode-only] [--output file]\n", argv[0]);
+		return 2;
+	}
+
+	fs::path directory = argv[1];
+	fs::path output_path;
+	int iterations = 3;
+	unsigned int threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+	bool decode_only = false;
+
+	for (int i = 2; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (arg == "--iterations" && has_value) iterations = std::max(1, atoi(argv[++i]));
+		else if (arg == "--threads" && has_value) threads = unsigned(std::max(1, atoi(argv[++i])));
+		else if (arg == "--decode-only") decode_only = true;
+		else if (arg == "--output" && has_value) output_path = argv[++i];
+		else
+		{
+			fprintf(stderr, "unknown argument %s\n", arg.c_str());
+			return 2;
+		}
+	}
+
+	std::vector<fs::path> files;
+	for (const auto& entry : fs::directory_iterator(directory))
+	{
+		auto extension = entry.path().extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(tolower(c)); });
+		if (entry.is_regular_file() && (extension == ".png" || extension == ".jpg" || extension == ".jpeg" ||
+			extension == ".tga" || extension == ".bmp" || extension == ".psd" || extension == ".gif"))
+		{
+			files.push_back(entry.path());
+		}
+	}
+	std::sort(files.begin(), files.end());
+
+	GLFWwindow* window = nullptr;
+	if (!decode_only)
+	{
+		if (!CreateContext(window))
+		{
+			fprintf(stderr, "could not create an OpenGL 4.5 context, --decode-only runs without one\n");
+			return 2;
+		}
+
+		glfwMakeContextCurrent(window);
+		gladLoadGL(glfwGetProcAddress);
+	}
+
+	std::vector<ImageResult> results(files.size());
+	{
+		Staging staging;
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			auto& r = results[i];
+			r.name = files[i].filename().string();
+			r.fileBytes = size_t(fs::file_size(files[i]));
+			r.system = GetSystemImageDecoder(files[i]);
+			r.selected = SelectImageDecoder(files[i]);
+
+			// one untimed load first, so the file is in the OS cache for every decoder alike
+			int width = 0, height = 0;
+			FreeDecodedImage(DecodeImage(files[i], false, width, height, ImageDecoder::StbImage));
+
+			r.stb = LoadSerial(files[i], ImageDecoder::StbImage, iterations, decode_only ? nullptr : &staging, r.width, r.height);
+			if (r.system != ImageDecoder::StbImage)
+				r.other = LoadSerial(files[i], r.system, iterations, decode_only ? nullptr : &staging, r.width, r.height);
+		}
+	}
+
+	std::vector<ThreadedResult> threaded;
+	{
+		Staging staging;
+		threaded.push_back(LoadThreaded(files, ImageDecoder::StbImage, threads, decode_only ? nullptr : &staging));
+		threaded.push_back(LoadThreaded(files, ImageDecoder::Auto, threads, decode_only ? nullptr : &staging));
+	}
+
+	// per image the decoder Auto picks, against stb_image for all of them
+	double stb_decode = 0.0, auto_decode = 0.0, stb_total = 0.0, auto_total = 0.0;
+	for (const auto& r : results)
+	{
+		const auto& selected = r.selected != ImageDecoder::StbImage && r.other.ok ? r.other : r.stb;
+		stb_decode += r.stb.decodeMs;
+		stb_total += r.stb.totalMs;
+		auto_decode += selected.decodeMs;
+		auto_total += selected.totalMs;
+	}
+
+	std::stringstream json;
+	json << "{\n";
+	if (!decode_only)
+	{
+		json << "  \"renderer\": \"" << EscapeJson((const char*)glGetString(GL_RENDERER)) << "\",\n";
+		json << "  \"version\": \"" << EscapeJson((const char*)glGetString(GL_VERSION)) << "\",\n";
+	}
+	json << "  \"decoders\": [ \"stb_image\"";
+	for (auto decoder : { ImageDecoder::LibJpegTurbo, ImageDecoder::LibPng })
+	{
+		if (IsImageDecoderAvailable(decoder))
+			json << ", \"" << GetImageDecoderName(decoder) << "\"";
+	}
+	json << " ],\n";
+	json << "  \"iterations\": " << iterations << ",\n";
+	json << "  \"images\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const auto& r = results[i];
+		json << "    { \"name\": \"" << EscapeJson(r.name) << "\", \"width\": " << r.width << ", \"height\": " << r.height
+			<< ", \"file_bytes\": " << r.fileBytes << ", \"selected\": \"" << GetImageDecoderName(r.selected) << "\", ";
+		WriteTimes(json, "stb_image", r.stb);
+		if (r.system != ImageDecoder::StbImage)
+		{
+			json << ", ";
+			WriteTimes(json, GetImageDecoderName(r.system), r.other);
+		}
+		json << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	json << "  ],\n";
+	json << "  \"serial\": { \"stb_image_decode_ms\": " << stb_decode << ", \"auto_decode_ms\": " << auto_decode
+		<< ", \"decode_speedup\": " << (auto_decode > 0.0 ? stb_decode / auto_decode : 0.0)
+		<< ", \"stb_image_total_ms\": " << stb_total << ", \"auto_total_ms\": " << auto_total
+		<< ", \"total_speedup\": " << (auto_total > 0.0 ? stb_total / auto_total : 0.0) << " },\n";
+	json << "  \"threads\": " << threads << ",\n";
+	json << "  \"threaded\": [\n";
+	for (size_t i = 0; i < threaded.size(); i++)
+	{
+		const auto& t = threaded[i];
+		json << "    { \"decoder\": \"" << GetImageDecoderName(t.decoder) << "\", \"images\": " << t.images
+			<< ", \"wall_ms\": " << t.wallMs << ", \"mb_per_s\": "
+			<< (t.wallMs > 0.0 ? double(t.bytes) / (1024.0 * 1024.0) / (t.wallMs / 1000.0) : 0.0)
+			<< " }" << (i + 1 < threaded.size() ? "," : "") << "\n";
+	}
+	json << "  ]\n";
+	json << "}\n";
+
+	if (output_path.empty())
+	{
+		fputs(json.str().c_str(), stdout);
+	}
+	else
+	{
+		std::ofstream out(output_path);
+		out << json.str();
+	}
+
+	int exit_code = 0;
+	for (const auto& r : results)
+	{
+		if (!r.stb.ok && !r.other.ok)
+		{
+			fprintf(stderr, "FAILED %s\n", r.name.c_str());
+			exit_code = 1;
+		}
+	}
+
+	if (window)
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
+	return exit_code;
+}
@@ -0,0 +1,147 @@
+// Compares culling a dense mesh as a whole against culling its meshlets by frustum and
+// backface cone, as ModelInputRenderPass does with Cluster Culling enabled, from a few views.
+// The mesh is a UV sphere, so roughly half of it faces away from any outside view.
+//
+// usage: MeshletCullingBenchmark [sphere segments] [iterations]
+
+#include "Meshlets.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static void MakeSphere(int segments, std::vector<glm::vec3>& positions, std::vector<unsigned int>& indices)
+{
+	const float pi = 3.14159265f;
+	int rings = segments / 2;
+
+	for (int y = 0; y <= rings; y++)
+	{
+		float theta = pi * float(y) / float(rings);
+		for (int x = 0; x <= segments; x++)
+		{
+			float phi = 2.0f * pi * float(x) / float(segments);
+			positions.push_back({ sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi) });
+		}
+	}
+
+	// counter clockwise seen from outside
+	for (int y = 0; y < rings; y++)
+	{
+		for (int x = 0; x < segments; x++)
+		{
+			unsigned int a = y * (segments + 1) + x;
+			unsigned int b = a + segments + 1;
+			indices.insert(indices.end(), { a, a + 1, b, a + 1, b + 1, b });
+		}
+	}
+}
+
+template<typename Fn>
+static double MeasureMs(int iterations, Fn&& fn)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; i++)
+		fn();
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+int main(int argc, char** argv)
+{
+	int segments = argc > 1 ? atoi(argv[1]) : 2048;
+	int iterations = argc > 2 ? atoi(argv[2]) : 20;
+
+	std::vector<glm::vec3> positions;
+	std::vector<unsigned int> indices;
+	MakeSphere(segments, positions, indices);
+
+	auto triangles = indices.size() / 3;
+
+	std::vector<Meshlet> meshlets;
+	auto buildMs = MeasureMs(1, [&] {
+		BuildMeshlets(&positions[0].x, positions.size(), sizeof(glm::vec3), indices, meshlets);
+	});
+
+	size_t meshletTriangles = 0;
+	for (const auto& meshlet : meshlets)
+		meshletTriangles += meshlet.indexCount / 3;
+
+	printf("%zu triangles, %zu meshlets, built in %.1f ms\n\n", triangles, meshlets.size(), buildMs);
+
+	if (meshletTriangles != triangles || indices.size() != triangles * 3)
+	{
+		fprintf(stderr, "meshlets cover %zu of %zu triangles\n", meshletTriangles, triangles);
+		return 1;
+	}
+
+	// the whole mesh as one never backface culled cluster, what per mesh culling sees.
+	// Its sphere holds every meshlet sphere, so no meshlet can pass where the mesh does not.
+	float radius = 1.0f;
+	for (const auto& meshlet : meshlets)
+		radius = std::max(radius, glm::length(glm::vec3(meshlet.sphere)) + meshlet.sphere.w);
+
+	Meshlet whole = {};
+	whole.sphere = { 0.0f, 0.0f, 0.0f, radius };
+	whole.cone = { 0.0f, 0.0f, 1.0f, 1.0f };
+
+	struct View
+	{
+		const char* name;
+		glm::vec3 eye;
+		glm::vec3 target;
+	};
+
+	const View views[] = {
+		{ "outside", { 0.0f, 0.0f, 3.0f }, { 0.0f, 0.0f, 0.0f } },
+		{ "close", { 0.0f, 0.0f, 1.2f }, { 0.0f, 0.0f, 0.0f } },
+		{ "grazing", { 1.05f, 0.0f, 1.05f }, { -1.0f, 0.0f, 1.5f } },
+		{ "edge", { 0.0f, 0.0f, 3.0f }, { 1.5f, 0.0f, 0.0f } },
+		{ "away", { 0.0f, 0.0f, 3.0f }, { 0.0f, 0.0f, 6.0f } },
+	};
+
+	auto projection = glm::perspective(glm::radians(90.0f), 16.0f / 9.0f, 0.01f, 100.0f);
+	glm::vec4 planes[6];
+	GetFrustumPlanes(projection, planes);
+
+	printf("%-8s %14s %14s %10s %12s %10s\n", "view", "mesh culled", "meshlet culled", "rendered", "cull ms", "visible");
+
+	for (const auto& view : views)
+	{
+		auto modelView = glm::lookAt(view.eye, view.target, { 0.0f, 1.0f, 0.0f });
+
+		size_t meshSubmitted = IsMeshletVisible(whole, modelView, planes) ? triangles : 0;
+
+		size_t rendered = 0;
+		size_t visible = 0;
+		auto cullMs = MeasureMs(iterations, [&] {
+			rendered = 0;
+			visible = 0;
+			for (const auto& meshlet : meshlets)
+			{
+				if (IsMeshletVisible(meshlet, modelView, planes))
+				{
+					rendered += meshlet.indexCount / 3;
+					visible++;
+				}
+			}
+		});
+
+		printf("%-8s %14zu %14zu %9.1f%% %12.3f %10zu\n", view.name, meshSubmitted, rendered,
+			meshSubmitted > 0 ? 100.0 * double(rendered) / double(meshSubmitted) : 0.0, cullMs, visible);
+
+		// a cluster can never be visible while the whole mesh is not
+		if (rendered > meshSubmitted)
+		{
+			fprintf(stderr, "%s: meshlet culling kept %zu triangles, the whole mesh has %zu\n", view.name, rendered, meshSubmitted);
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,469 @@
+// Compiles and links a directory of ShaderToy style mainImage bodies, wrapped with the
+// ShaderToyBaseFragment.glsl prologue, serially and in parallel (KHR_parallel_shader_compile),
+// and reports per shader and total times as JSON.
+//
+// usage: ShaderCompileBenchmark <shader directory> [options]
+//   --base <file>        fragment prologue, default Shaders/ShaderToyBaseFragment.glsl
+//   --vertex <file>      vertex shader, default Shaders/ShaderToyBaseVertex.glsl
+//   --iterations <n>     serial runs per shader, the median is reported (default 3)
+//   --output <file>      write the JSON there instead of stdout
+//   --baseline <file>    compare against an earlier JSON report, exit 1 on regressions
+//   --threshold <pct>    allowed slowdown against the baseline (default 20)
+//   --keep-cache         leave the driver shader caches enabled
+//
+// Runs on Mesa llvmpipe (LIBGL_ALWAYS_SOFTWARE=1). Without a display GLFW falls back to its
+// null platform with an OSMesa context.
+
+#include "glad/gl.h"
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::high_resolution_clock;
+
+struct ShaderResult
+{
+	std::string name;
+	bool ok{};
+	std::string log;
+	double compileMs{};
+	double linkMs{};
+	double serialMs{};
+	double parallelReadyMs{ -1.0 };
+};
+
+static bool ReadFile(const fs::path& path, std::string& out)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return false;
+
+	std::stringstream ss;
+	ss << file.rdbuf();
+	out = ss.str();
+	return true;
+}
+
+static double Ms(Clock::time_point a, Clock::time_point b)
+{
+	return std::chrono::duration<double, std::milli>(b - a).count();
+}
+
+static void SetEnv(const char* name, const char* value)
+{
+#ifdef _WIN32
+	_putenv_s(name, value);
+#else
+	setenv(name, value, 1);
+#endif
+}
+
+// Everything up to and including the body of main(), the demo mainImage after it is dropped
+static std::string ExtractPrologue(const std::string& base)
+{
+	auto main = base.find("void main()");
+	if (main == std::string::npos)
+		return base;
+
+	auto close = base.find("\n}", main);
+	if (close == std::string::npos)
+		return base;
+
+	return base.substr(0, close + 2) + "\n";
+}
+
+// A unique comment after #version keeps in-process driver caches from returning earlier results
+static std::string Uniquify(const std::string& source, int run)
+{
+	auto eol = source.find('\n');
+	if (eol == std::string::npos)
+		return source;
+
+	return source.substr(0, eol + 1) + "// run " + std::to_string(run) + "\n" + source.substr(eol + 1);
+}
+
+static GLuint CompileShader(GLenum type, const std::string& source)
+{
+	GLuint shader = glCreateShader(type);
+	const char* strings[] = { source.c_str() };
+	glShaderSource(shader, 1, strings, nullptr);
+	glCompileShader(shader);
+	return shader;
+}
+
+static std::string ProgramLog(GLuint program)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+	std::string log(size_t(std::max(length, 1)), '\0');
+	glGetProgramInfoLog(program, length, nullptr, log.data());
+	log.resize(strlen(log.c_str()));
+	return log;
+}
+
+static std::string EscapeJson(const std::string& text)
+{
+	std::string out;
+	out.reserve(text.size());
+	for (char c : text)
+	{
+		switch (c)
+		{
+		case '"': out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\r': break;
+		case '\t': out += "\\t"; break;
+		default: out += c; break;
+		}
+	}
+	return out;
+}
+
+static double Median(std::vector<double> values)
+{
+	if (values.empty())
+		return 0.0;
+	std::sort(values.begin(), values.end());
+	return values[values.size() / 2];
+}
+
+static bool CreateContext(GLFWwindow*& window)
+{
+	auto hint_window = [] {
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	};
+
+	if (glfwInit())
+	{
+		hint_window();
+		window = glfwCreateWindow(64, 64, "ShaderCompileBenchmark", nullptr, nullptr);
+		if (window)
+			return true;
+		glfwTerminate();
+	}
+
+	// no display available, try an offscreen OSMesa (llvmpipe) context
+	glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+	if (!glfwInit())
+		return false;
+
+	hint_window();
+	glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+	window = glfwCreateWindow(64, 64, "ShaderCompileBenchmark", nullptr, nullptr);
+	return window != nullptr;
+}
+
+static void RunSerial(const std::string& vertex, const std::string& prologue,
+	const std::vector<std::string>& bodies, int iterations, std::vector<ShaderResult>& results, int& run)
+{
+	for (size_t i = 0; i < bodies.size(); i++)
+	{
+		auto& result = results[i];
+		std::vector<double> compile, link, total;
+
+		for (int it = 0; it < iterations; it++)
+		{
+			auto vs_source = Uniquify(vertex, run);
+			auto fs_source = Uniquify(prologue + bodies[i], run);
+			run++;
+
+			auto start = Clock::now();
+			auto vs = CompileShader(GL_VERTEX_SHADER, vs_source);
+			auto fs = CompileShader(GL_FRAGMENT_SHADER, fs_source);
+
+			// querying the status forces drivers that compile lazily to finish here
+			GLint status = 0;
+			glGetShaderiv(fs, GL_COMPILE_STATUS, &status);
+			auto compiled = Clock::now();
+
+			auto program = glCreateProgram();
+			glAttachShader(program, vs);
+			glAttachShader(program, fs);
+			glLinkProgram(program);
+			glGetProgramiv(program, GL_LINK_STATUS, &status);
+			auto linked = Clock::now();
+
+			compile.push_back(Ms(start, compiled));
+			link.push_back(Ms(compiled, linked));
+			total.push_back(Ms(start, linked));
+
+			result.ok = status == GL_TRUE;
+			if (!result.ok)
+				result.log = ProgramLog(program);
+
+			glDeleteProgram(program);
+			glDeleteShader(vs);
+			glDeleteShader(fs);
+
+			if (!result.ok)
+				break;
+		}
+
+		result.compileMs = Median(compile);
+		result.linkMs = Median(link);
+		result.serialMs = Median(total);
+	}
+}
+
+static double RunParallel(const std::string& vertex, const std::string& prologue,
+	const std::vector<std::string>& bodies, std::vector<ShaderResult>& results, int& run)
+{
+	if (GLAD_GL_KHR_parallel_shader_compile)
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+	else
+		glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
+	std::vector<GLuint> programs(bodies.size());
+	std::vector<GLuint> shaders;
+
+	auto start = Clock::now();
+
+	for (size_t i = 0; i < bodies.size(); i++)
+	{
+		auto vs = CompileShader(GL_VERTEX_SHADER, Uniquify(vertex, run));
+		auto fs = CompileShader(GL_FRAGMENT_SHADER, Uniquify(prologue + bodies[i], run));
+		run++;
+
+		programs[i] = glCreateProgram();
+		glAttachShader(programs[i], vs);
+		glAttachShader(programs[i], fs);
+		glLinkProgram(programs[i]);
+
+		shaders.push_back(vs);
+		shaders.push_back(fs);
+	}
+
+	size_t remaining = programs.size();
+	while (remaining > 0)
+	{
+		for (size_t i = 0; i < programs.size(); i++)
+		{
+			if (results[i].parallelReadyMs >= 0.0)
+				continue;
+
+			GLint done = GL_FALSE;
+			glGetProgramiv(programs[i], GL_COMPLETION_STATUS_KHR, &done);
+			if (done)
+			{
+				results[i].parallelReadyMs = Ms(start, Clock::now());
+				remaining--;
+			}
+		}
+	}
+
+	auto total = Ms(start, Clock::now());
+
+	for (auto program : programs)
+		glDeleteProgram(program);
+	for (auto shader : shaders)
+		glDeleteShader(shader);
+
+	return total;
+}
+
+// Reads the serial_ms of every shader out of a report written by this tool
+static std::vector<std::pair<std::string, double>> ReadBaseline(const std::string& json)
+{
+	std::vector<std::pair<std::string, double>> baseline;
+
+	size_t pos = 0;
+	const std::string name_key = "\"name\": \"";
+	const std::string serial_key = "\"serial_ms\": ";
+
+	while ((pos = json.find(name_key, pos)) != std::string::npos)
+	{
+		pos += name_key.size();
+		auto end = json.find('"', pos);
+		auto serial = json.find(serial_key, end);
+		if (end == std::string::npos || serial == std::string::npos)
+			break;
+
+		baseline.emplace_back(json.substr(pos, end - pos), atof(json.c_str() + serial + serial_key.size()));
+		pos = serial;
+	}
+
+	return baseline;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s <shader directory> [--base file] [--vertex file] [--iterations n] "
+			"[--output file] [--baseline file] [--threshold pct] [--keep-cache]\n", argv[0]);
+		return 2;
+	}
+
+	fs::path directory = argv[1];
+	fs::path base_path = "Shaders/ShaderToyBaseFragment.glsl";
+	fs::path vertex_path = "Shaders/ShaderToyBaseVertex.glsl";
+	fs::path output_path;
+	fs::path baseline_path;
+	int iterations = 3;
+	double threshold = 20.0;
+	bool keep_cache = false;
+
+	for (int i = 2; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (arg == "--base" && has_value) base_path = argv[++i];
+		else if (arg == "--vertex" && has_value) vertex_path = argv[++i];
+		else if (arg == "--iterations" && has_value) iterations = std::max(1, atoi(argv[++i]));
+		else if (arg == "--output" && has_value) output_path = argv[++i];
+		else if (arg == "--baseline" && has_value) baseline_path = argv[++i];
+		else if (arg == "--threshold" && has_value) threshold = atof(argv[++i]);
+		else if (arg == "--keep-cache") keep_cache = true;
+		else
+		{
+			fprintf(stderr, "unknown argument %s\n", arg.c_str());
+			return 2;
+		}
+	}
+
+	if (!keep_cache)
+	{
+		// on disk caches would turn every run after the first into a cache lookup
+		SetEnv("MESA_SHADER_CACHE_DISABLE", "true");
+		SetEnv("__GL_SHADER_DISK_CACHE", "0");
+	}
+
+	std::string base, vertex;
+	if (!ReadFile(base_path, base) || !ReadFile(vertex_path, vertex))
+	{
+		fprintf(stderr, "could not read %s or %s\n", base_path.string().c_str(), vertex_path.string().c_str());
+		return 2;
+	}
+
+	auto prologue = ExtractPrologue(base);
+
+	std::vector<fs::path> files;
+	for (const auto& entry : fs::directory_iterator(directory))
+	{
+		if (entry.is_regular_file() && entry.path().extension() == ".glsl")
+			files.push_back(entry.path());
+	}
+	std::sort(files.begin(), files.end());
+
+	std::vector<std::string> bodies(files.size());
+	std::vector<ShaderResult> results(files.size());
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		ReadFile(files[i], bodies[i]);
+		results[i].name = files[i].filename().string();
+	}
+
+	GLFWwindow* window = nullptr;
+	if (!CreateContext(window))
+	{
+		fprintf(stderr, "could not create an OpenGL 4.5 context\n");
+		return 2;
+	}
+
+	glfwMakeContextCurrent(window);
+	gladLoadGL(glfwGetProcAddress);
+
+	int run = 0;
+
+	auto serial_start = Clock::now();
+	RunSerial(vertex, prologue, bodies, iterations, results, run);
+	auto serial_total = Ms(serial_start, Clock::now());
+
+	bool parallel_supported = GLAD_GL_KHR_parallel_shader_compile || GLAD_GL_ARB_parallel_shader_compile;
+	double parallel_total = -1.0;
+	if (parallel_supported && !bodies.empty())
+		parallel_total = RunParallel(vertex, prologue, bodies, results, run);
+
+	double serial_sum = 0.0;
+	for (const auto& r : results)
+		serial_sum += r.serialMs;
+
+	std::stringstream json;
+	json << "{\n";
+	json << "  \"renderer\": \"" << EscapeJson((const char*)glGetString(GL_RENDERER)) << "\",\n";
+	json << "  \"version\": \"" << EscapeJson((const char*)glGetString(GL_VERSION)) << "\",\n";
+	json << "  \"iterations\": " << iterations << ",\n";
+	json << "  \"shaders\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const auto& r = results[i];
+		json << "    { \"name\": \"" << EscapeJson(r.name) << "\", \"ok\": " << (r.ok ? "true" : "false")
+			<< ", \"compile_ms\": " << r.compileMs << ", \"link_ms\": " << r.linkMs
+			<< ", \"serial_ms\": " << r.serialMs;
+		if (r.parallelReadyMs >= 0.0)
+			json << ", \"parallel_ready_ms\": " << r.parallelReadyMs;
+		if (!r.ok)
+			json << ", \"log\": \"" << EscapeJson(r.log) << "\"";
+		json << " }" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	json << "  ],\n";
+	json << "  \"serial_median_sum_ms\": " << serial_sum << ",\n";
+	json << "  \"serial_wall_ms\": " << serial_total << ",\n";
+	json << "  \"parallel_supported\": " << (parallel_supported ? "true" : "false") << ",\n";
+	json << "  \"parallel_wall_ms\": " << parallel_total << "\n";
+	json << "}\n";
+
+	if (output_path.empty())
+	{
+		fputs(json.str().c_str(), stdout);
+	}
+	else
+	{
+		std::ofstream out(output_path);
+		out << json.str();
+	}
+
+	int exit_code = 0;
+	for (const auto& r : results)
+	{
+		if (!r.ok)
+		{
+			fprintf(stderr, "FAILED %s\n%s\n", r.name.c_str(), r.log.c_str());
+			exit_code = 1;
+		}
+	}
+
+	if (!baseline_path.empty())
+	{
+		std::string baseline_json;
+		if (!ReadFile(baseline_path, baseline_json))
+		{
+			fprintf(stderr, "could not read baseline %s\n", baseline_path.string().c_str());
+			exit_code = 2;
+		}
+
+		for (const auto& [name, baseline_ms] : ReadBaseline(baseline_json))
+		{
+			auto it = std::find_if(results.begin(), results.end(), [&](const ShaderResult& r) { return r.name == name; });
+			if (it == results.end() || baseline_ms <= 0.0)
+				continue;
+
+			double change = (it->serialMs - baseline_ms) / baseline_ms * 100.0;
+			if (change > threshold)
+			{
+				fprintf(stderr, "REGRESSION %s: %.2f ms -> %.2f ms (+%.1f%%)\n", name.c_str(), baseline_ms, it->serialMs, change);
+				exit_code = 1;
+			}
+		}
+	}
+
+	glfwDestroyWindow(window);
+	glfwTerminate();
+	return exit_code;
+}
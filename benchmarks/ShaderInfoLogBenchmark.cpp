@@ -0,0 +1,112 @@
+// Compares ParseShaderInfoLog against the regex based parsing EditorPanel used to do,
+// on large synthetic logs in every supported vendor format.
+//
+// usage: ShaderInfoLogBenchmark [lines per log] [iterations]
+
+#include "ShaderInfoLog.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <regex>
+#include <string>
+#include <vector>
+
+static std::string MakeLog(const char* vendor, int lines)
+{
+	std::string log;
+	log.reserve(size_t(lines) * 64);
+
+	char buffer[256];
+	for (int i = 0; i < lines; i++)
+	{
+		int line = 10 + (i % 500);
+
+		if (strcmp(vendor, "nvidia") == 0)
+			snprintf(buffer, sizeof(buffer), "0(%d) : error C1008: undefined variable \"value%d\"\n", line, i);
+		else if (strcmp(vendor, "amd") == 0)
+			snprintf(buffer, sizeof(buffer), "ERROR: 0:%d: 'value%d' : undeclared identifier\n", line, i);
+		else
+			snprintf(buffer, sizeof(buffer), "0:%d(%d): error: `value%d' undeclared\n", line, 5 + (i % 40), i);
+
+		log += buffer;
+	}
+
+	return log;
+}
+
+// The pre ParseShaderInfoLog implementation, kept here as the baseline
+static size_t ParseWithRegex(std::string log)
+{
+	std::vector<std::string> errors;
+	char* token = strtok(log.data(), "\n");
+	while (token != NULL)
+	{
+		if (std::regex_search(std::string(token), std::regex(R"(((ERROR: \d:\d*:) | (\s*:\s*error)))")))
+			errors.emplace_back(std::string(token));
+		token = strtok(NULL, "\n");
+	}
+
+	size_t count = 0;
+	for (auto& error : errors)
+	{
+		std::string expression = R"((?::|\()\d*(?::|\)))";
+		auto regexp = std::regex(expression);
+		std::smatch match;
+		std::regex_search(error, match, regexp);
+		regexp = std::regex(R"(\d+)");
+		auto line = match[0].str();
+		std::smatch match2;
+		std::regex_search(line, match2, regexp);
+		line = match2[0].str();
+		if (line.empty())
+			continue;
+		int num = std::stoi(line);
+		auto newError = std::regex_replace(error, std::regex(expression), (":" + std::to_string(num) + ":"));
+		count += newError.empty() ? 0 : 1;
+	}
+
+	return count;
+}
+
+template<typename Fn>
+static double MeasureMs(int iterations, Fn&& fn)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; i++)
+		fn();
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+}
+
+int main(int argc, char** argv)
+{
+	int lines = argc > 1 ? atoi(argv[1]) : 10000;
+	int iterations = argc > 2 ? atoi(argv[2]) : 10;
+
+	printf("%-8s %10s %12s %12s %10s %10s\n", "vendor", "lines", "regex ms", "parser ms", "speedup", "entries");
+
+	std::vector<ShaderLogEntry> entries;
+	for (const char* vendor : { "nvidia", "amd", "mesa" })
+	{
+		auto log = MakeLog(vendor, lines);
+
+		size_t regexCount = 0;
+		auto regexMs = MeasureMs(1, [&] { regexCount = ParseWithRegex(log); });
+
+		size_t parsedCount = 0;
+		auto parserMs = MeasureMs(iterations, [&] { parsedCount = ParseShaderInfoLog(log, entries); });
+
+		printf("%-8s %10d %12.3f %12.3f %9.1fx %10zu\n", vendor, lines, regexMs, parserMs,
+			parserMs > 0.0 ? regexMs / parserMs : 0.0, parsedCount);
+
+		if (parsedCount != size_t(lines))
+		{
+			fprintf(stderr, "%s: expected %d entries, parsed %zu (regex found %zu)\n", vendor, lines, parsedCount, regexCount);
+			return 1;
+		}
+	}
+
+	return 0;
+}
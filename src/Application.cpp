@@ -9,8 +9,11 @@
 
 #include "FullScreenRenderPass.h"
 #include "ModelInputRenderPass.h"
+#include "TextureStreamer.h"
 #include "Utils.h"
 
+#include <algorithm>
+
 extern "C" {
 	__declspec(dllexport) int NvOptimusEnablement = 1;
 	__declspec(dllexport) int AmdPowerXpressRequestHighPerformance = 1;
@@ -142,6 +145,9 @@ void Application::Init() {
 	const char* glsl_version = "#version 450";
 	ImGui_ImplOpenGL3_Init(glsl_version);
 
+	// cubemap channels filter across face edges
+	glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
 	preview_fb = new Framebuffer(0, 0);
 	preview_fb->AddAttachment(Format::RGBA8, true);
 	preview_fb->Resize(window->GetWidth(), window->GetHeight());
@@ -174,6 +180,11 @@ void Application::Init() {
 
 	console = new ImGuiConsole();
 
+	validator = new ShaderValidator();
+	validator->Init();
+
+	TextureStreamer::instance = new TextureStreamer();
+
 	available_encoders = GetAvailableEncoders();
 	selected_encoder_index = 0; // default to first available
 
@@ -278,6 +289,16 @@ void Application::Run() {
 		// TODO: have a mode where we can only see the output of the selected pass and its input pass and so on
 		// that way we can see per pass progress and also for performance reasons too
 
+		{
+			// pass outputs can not be evicted, but they take from the same memory
+			size_t attachment_bytes = GetFramebufferBytes(preview_fb);
+			for (auto pass : passes)
+				attachment_bytes += pass->GetOutputBytes() + pass->GetOutputMipmapBytes();
+
+			auto streamer = TextureStreamer::Get();
+			streamer->SetMemoryBudget(size_t(textureMemoryBudgetMB) * 1024 * 1024, attachment_bytes);
+			streamer->Update(size_t(textureUploadBudgetMB) * 1024 * 1024);
+		}
 		DrawAllPasses();
 
 		ImGui_ImplOpenGL3_NewFrame();
@@ -468,6 +489,11 @@ void Application::Run() {
 			if (ImGui::BeginMenuBar())
 			{
 				ImGui::Text(ICON_FA_CLOCK " %.2f        " ICON_FA_FILM " %llu        FPS %llu", time, frames, fps);
+
+				auto streamer = TextureStreamer::Get();
+				ImGui::SameLine();
+				ImGui::Text("        Texture memory %.0f / %d MB",
+					(streamer->GetTextureBytes() + streamer->GetAttachmentBytes()) / (1024.0 * 1024.0), textureMemoryBudgetMB);
 				ImGui::EndMenuBar();
 			}
 			ImGui::End();
@@ -564,6 +590,18 @@ void Application::Run() {
 					selectedRenderPass = passes.back();
 				}
 
+				if (ImGui::MenuItem("Create Cubemap Pass"))
+				{
+					CreateFullScreenRenderPass(ChannelDimension::CUBEMAP);
+					selectedRenderPass = passes.back();
+				}
+
+				if (ImGui::MenuItem("Create Volume Pass"))
+				{
+					CreateFullScreenRenderPass(ChannelDimension::VOLUME);
+					selectedRenderPass = passes.back();
+				}
+
 				if (ImGui::MenuItem("Create Model Input Pass"))
 				{
 					CreateModelInputRenderPass();
@@ -586,8 +624,11 @@ void Application::Run() {
 
 		if (ImGui::Begin("Pass Properties")) 
 		{
-			if(selectedRenderPass)
+			if (selectedRenderPass)
+			{
 				selectedRenderPass->OnImGui();
+				selectedRenderPass->OnShaderCostImGui();
+			}
 		}
 
 		ImGui::End();
@@ -614,6 +655,15 @@ void Application::Run() {
 
 void Application::Shutdown() 
 {
+	validator->Shutdown();
+	delete validator;
+
+	if (preview_layer_fb)
+		glDeleteFramebuffers(1, &preview_layer_fb);
+
+	delete TextureStreamer::instance;
+	TextureStreamer::instance = nullptr;
+
 	delete window;
 }
 
@@ -643,6 +693,7 @@ void Application::CreateEditorPanel(RenderPass* renderPass)
 		ep->renderPass = renderPass;
 		ep->type = EditorPanelType::VertexShader;
 		editors.push_back(ep);
+		validator->SubmitCostAnalysis(ep, ShaderType::Vertex, shader->GetVertexSource());
 	}
 
 	{
@@ -655,13 +706,14 @@ void Application::CreateEditorPanel(RenderPass* renderPass)
 		ep->renderPass = renderPass;
 		ep->type = EditorPanelType::FragmentShader;
 		editors.push_back(ep);
+		validator->SubmitCostAnalysis(ep, ShaderType::Fragment, shader->GetFragmentSource());
 	}
 
 }
 
-void Application::CreateFullScreenRenderPass()
+void Application::CreateFullScreenRenderPass(ChannelDimension outputDimension)
 {
-	auto rp = new FullScreenRenderPass;
+	auto rp = new FullScreenRenderPass(outputDimension);
 	rp->Init();
 	passes.push_back(rp);
 	CreateEditorPanel(rp);
@@ -696,10 +748,10 @@ void Application::InitQuadVoa()
 	quadVertexInput->SetVertexBuffer(*buffer, 0, sizeof(float) * 6, 0);
 }
 
-void Application::DrawFullScreenQuad()
+void Application::DrawFullScreenQuad(int instanceCount)
 {
 	quadVertexInput->Bind();
-	glDrawArrays(GL_TRIANGLES, 0, 6);
+	glDrawArraysInstanced(GL_TRIANGLES, 0, 6, instanceCount);
 }
 
 void Application::DrawAllPasses()
@@ -707,8 +759,13 @@ void Application::DrawAllPasses()
 	for (size_t i = 0; i < passes.size(); i++)
 	{
 		const auto& pass = passes[i];
+		pass->UpdateChannels(time);
 		pass->BindChannels();
 		pass->Draw();
+
+		// channel samplers must not apply to the next pass's model textures or the preview
+		glBindSamplers(0, 16, nullptr);
+		pass->UpdateOutputMipmaps();
 	}
 
 	if (passes.size() == 1)
@@ -716,7 +773,11 @@ void Application::DrawAllPasses()
 		selectedRenderPass = passes.back();
 	}
 
-	if (selectedRenderPass && selectedRenderPass->GetOutput())
+	if (selectedRenderPass && selectedRenderPass->GetOutputDimension() != ChannelDimension::TEXTURE_2D)
+	{
+		DrawLayerPreview(selectedRenderPass);
+	}
+	else if (selectedRenderPass && selectedRenderPass->GetOutput())
 	{
 		preview_fb->Bind();
 		auto& [texture, is_draw] = selectedRenderPass->GetOutput()->GetColorAttachments()[0];
@@ -726,6 +787,57 @@ void Application::DrawAllPasses()
 	}
 }
 
+void Application::DrawLayerPreview(RenderPass* pass)
+{
+	// cubemap and volume passes have no framebuffer, the +Z face or the middle slice shows instead
+	int width = 0, height = 0, depth = 0;
+	pass->GetOutputSize(width, height, depth);
+	int layer = pass->GetOutputDimension() == ChannelDimension::CUBEMAP ? 4 : depth / 2;
+
+	if (preview_layer_fb == 0)
+		glCreateFramebuffers(1, &preview_layer_fb);
+	glNamedFramebufferTextureLayer(preview_layer_fb, GL_COLOR_ATTACHMENT0, pass->GetOutputTexture(), 0, layer);
+
+	preview_fb->Bind();
+	const float black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	glClearBufferfv(GL_COLOR, 0, black);
+
+	// square, in the middle of the preview
+	int preview_width = preview_fb->GetWidth();
+	int preview_height = preview_fb->GetHeight();
+	int size = std::min(preview_width, preview_height);
+	int x = (preview_width - size) / 2;
+	int y = (preview_height - size) / 2;
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, preview_layer_fb);
+	glBlitFramebuffer(0, 0, width, height, x, y, x + size, y + size, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+}
+
+void Application::UpdateSamplerDeclarations(RenderPass* pass)
+{
+	// the editor holds the source being worked on, unsaved edits included
+	for (auto ep : editors)
+	{
+		if (ep->type != EditorPanelType::FragmentShader || ep->renderPass != pass)
+			continue;
+
+		auto source = ep->editor->GetText();
+		if (pass->UpdateSamplerDeclarations(source))
+		{
+			// one undoable edit, SetText would drop the undo history
+			int line = 0, column = 0;
+			ep->editor->GetMainCursor(line, column);
+			ep->editor->SelectAll();
+			ep->editor->ReplaceTextInCurrentCursor(source);
+			ep->editor->SetCursor(line, column);
+
+			ep->revision++;
+			ep->Compile(false);
+		}
+	}
+}
+
 void Application::OnDrop(int count, const char* items[])
 {
 	for (int i = 0; i < count; i++)
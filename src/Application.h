@@ -9,6 +9,7 @@
 #include "RenderPass.h"
 #include "ImGuiConsole.h"
 #include "EditorPanel.h"
+#include "ShaderValidator.h"
 
 struct Application
 {
@@ -39,8 +40,13 @@ struct Application
 
 	Framebuffer* preview_fb;
 	ShaderProgram* preview_shader;
+	unsigned int preview_layer_fb{};		// reads a face or slice of cubemap and volume outputs
 	ImGuiConsole* console;
+	ShaderValidator* validator;
 	
+	int textureUploadBudgetMB{ 32 };	// per frame, see TextureStreamer
+	int textureMemoryBudgetMB{ 2048 };	// textures and pass outputs together
+
 	bool mouse_left_button;
 	bool mouse_right_button;
 	glm::vec2 mouse_position;
@@ -56,13 +62,17 @@ struct Application
 
 	void CreateEditorPanel(const std::filesystem::path& path);
 	void CreateEditorPanel(RenderPass* renderPass);
-	void CreateFullScreenRenderPass();
+	void CreateFullScreenRenderPass(ChannelDimension outputDimension = ChannelDimension::TEXTURE_2D);
 	void CreateModelInputRenderPass();
 
 	void InitQuadVoa();
-	void DrawFullScreenQuad();
+	void DrawFullScreenQuad(int instanceCount = 1);
 
 	void DrawAllPasses();
+	void DrawLayerPreview(RenderPass* pass);
+
+	// After a channel of the pass changed between 2D, cubemap and volume
+	void UpdateSamplerDeclarations(RenderPass* pass);
 
 	void OnDrop(int count, const char* items[]);
 	void OnWindowResize(int widht, int height);
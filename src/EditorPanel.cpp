@@ -1,77 +1,137 @@
 #include "EditorPanel.h"
 #include "Application.h"
 #include <cstdio>
-#include <regex>
+
+// seconds the text has to stay unchanged before it is sent for validation
+static constexpr double VALIDATION_DELAY = 0.25;
 
 void EditorPanel::OnImGui()
 {
+	ShaderCost cost;
+	if (Application::instance->validator->PollCost(this, cost))
+	{
+		renderPass->SetShaderCost(GetShaderType(), cost);
+	}
+
 	if (ImGui::Begin(name.c_str(), 0, undoIndexOnDisk != editor->GetUndoIndex() ? ImGuiWindowFlags_UnsavedDocument : 0)) {
+		auto validator = Application::instance->validator;
+
+		auto undo_index = editor->GetUndoIndex();
+		if (undo_index != lastUndoIndex)
+		{
+			lastUndoIndex = undo_index;
+			lastEditTime = ImGui::GetTime();
+			revision++;
+		}
+
+		if (submittedRevision != revision && ImGui::GetTime() - lastEditTime > VALIDATION_DELAY)
+		{
+			validator->Submit(this, GetShaderType(), editor->GetText(), revision);
+			submittedRevision = revision;
+		}
+
+		ShaderValidationResult result;
+		if (validator->Poll(this, result) && result.revision == revision)
+		{
+			validatedRevision = result.revision;
+			validatedOk = result.valid;
+			validationLog = std::move(result.log);
+
+			editor->ClearMarkers();
+			ShowLog(validationLog, false);
+		}
+
 		if (ImGui::GetIO().KeyCtrl && ImGui::IsKeyPressed(ImGuiKey_S))
 		{
-			auto shader = renderPass->GetShader();
-
-			if (type == EditorPanelType::VertexShader)
-			{
-				auto source = editor->GetText();
-				auto vs = new Shader(ShaderType::Vertex, source);
-				shader->AttachShader(vs);
-				shader->SetVertexSource(source);
-			}
-			else if (type == EditorPanelType::FragmentShader)
-			{
-				auto source = editor->GetText();
-				auto fs = new Shader(ShaderType::Fragment, source);
-				shader->AttachShader(fs);
-				shader->SetFragmentSource(source);
-			}
-
-			char* infoLog;
-
-			if (!shader->Link(&infoLog, nullptr))
-			{
-				std::vector<std::string> errors;
-				char* token = strtok(infoLog, "\n");
-				while (token != NULL)
-				{
-					if (std::regex_search(std::string(token), std::regex(R"(((ERROR: \d:\d*:) | (\s*:\s*error)))")))
-						errors.emplace_back(std::string(token));
-					token = strtok(NULL, "\n");
-				}
-
-				delete[] infoLog;
-
-				for (auto& error : errors)
-				{
-					std::string expression = R"((?::|\()\d*(?::|\)))";
-					auto regexp = std::regex(expression);
-					std::smatch match;
-					std::regex_search(error, match, regexp);
-					regexp = std::regex(R"(\d+)");
-					auto line = match[0].str();
-					std::smatch match2;
-					std::regex_search(line, match2, regexp);
-					line = match2[0].str();
-					int num = std::stoi(line);
-					auto newError = std::regex_replace(error, std::regex(expression), (":" + std::to_string(num) + ":"));
-
-					Application::instance->console->AddLog("%s\n", newError.c_str());
-					editor->AddMarker(num, IM_COL32(255, 0, 0, 255), IM_COL32(0, 0, 0, 255), "", newError.c_str());
-				}
-				
-
-				// editor->SetErrorMarkers(errorMarkers);
-			}
-			else
-			{
-				editor->ClearMarkers();
-				// editor->SetErrorMarkers({});
-			}
-
-			undoIndexOnDisk = editor->GetUndoIndex();
+			Compile();
 		}
 		editor->Render((name + "Editor").c_str());
 	}
 	ImGui::End();
 }
 
+void EditorPanel::Compile(bool saved)
+{
+	auto source = editor->GetText();
+
+	// only hand sources to the driver that the front-end already accepted
+	if (validatedRevision != revision)
+	{
+		validatedOk = Application::instance->validator->Validate(GetShaderType(), source, validationLog);
+		validatedRevision = revision;
+		submittedRevision = revision;
+	}
+
+	editor->ClearMarkers();
+
+	if (!validatedOk)
+	{
+		ShowLog(validationLog, true);
+		return;
+	}
+
+	auto shader = renderPass->GetShader();
+
+	if (type == EditorPanelType::VertexShader)
+	{
+		auto vs = new Shader(ShaderType::Vertex, source);
+		shader->AttachShader(vs);
+		shader->SetVertexSource(source);
+	}
+	else if (type == EditorPanelType::FragmentShader)
+	{
+		auto fs = new Shader(ShaderType::Fragment, source);
+		shader->AttachShader(fs);
+		shader->SetFragmentSource(source);
+	}
+
+	char* infoLog;
+
+	if (shader->Link(&infoLog, nullptr))
+	{
+		shader->ReflectSamplers();
+		Application::instance->validator->SubmitCostAnalysis(this, GetShaderType(), std::move(source));
+	}
+	else
+	{
+		ShowLog(infoLog, true);
+		delete[] infoLog;
+	}
+
+	if (saved)
+		undoIndexOnDisk = editor->GetUndoIndex();
+}
+
+void EditorPanel::ShowLog(std::string_view log, bool logToConsole)
+{
+	ParseShaderInfoLog(log, logEntries);
 
+	for (const auto& entry : logEntries)
+	{
+		bool is_error = entry.severity == ShaderLogSeverity::Error;
+
+		char text[512];
+		if (entry.column > 0)
+			snprintf(text, sizeof(text), "%s:%d:%d: %.*s", is_error ? "error" : "warning",
+				entry.line, entry.column, int(entry.message.size()), entry.message.data());
+		else
+			snprintf(text, sizeof(text), "%s:%d: %.*s", is_error ? "error" : "warning",
+				entry.line, int(entry.message.size()), entry.message.data());
+
+		if (logToConsole)
+			Application::instance->console->AddLog("%s\n", text);
+
+		// driver lines are 1 based, editor lines are 0 based
+		if (entry.line > 0)
+		{
+			editor->AddMarker(entry.line - 1,
+				is_error ? IM_COL32(255, 0, 0, 255) : IM_COL32(255, 200, 0, 255),
+				IM_COL32(0, 0, 0, 255), "", text);
+		}
+	}
+}
+
+ShaderType EditorPanel::GetShaderType() const
+{
+	return type == EditorPanelType::VertexShader ? ShaderType::Vertex : ShaderType::Fragment;
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include "ImGuiColorTextEdit/TextEditor.h"
 #include "RenderPass.h"
+#include "ShaderInfoLog.h"
 
 enum class EditorPanelType
 {
@@ -15,6 +16,22 @@ struct EditorPanel
 	EditorPanelType type{};
 	RenderPass* renderPass;
 	int undoIndexOnDisk{ 0 };
+	std::vector<ShaderLogEntry> logEntries;
+
+	// background validation state, revision is bumped on every edit
+	uint64_t revision{ 1 };
+	uint64_t submittedRevision{ 0 };
+	uint64_t validatedRevision{ 0 };
+	bool validatedOk{ false };
+	std::string validationLog;
+	size_t lastUndoIndex{ 0 };
+	double lastEditTime{ 0.0 };
 
 	void OnImGui();
+	// `saved` marks the text as on disk, edits the application makes itself leave it unsaved
+	void Compile(bool saved = true);
+
+private:
+	void ShowLog(std::string_view log, bool logToConsole);
+	ShaderType GetShaderType() const;
 };
@@ -0,0 +1,235 @@
+#include "EnvironmentFilter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <execution>
+#include <numeric>
+
+namespace
+{
+	constexpr float PI = 3.14159265358979f;
+
+	// GGX samples per texel, reading them from blurrier source mips keeps rough levels free of noise
+	constexpr uint32_t SAMPLE_COUNT = 64;
+
+	struct Level
+	{
+		int width;
+		int height;
+		std::vector<float> pixels;
+	};
+
+	// u goes around the horizon, v from straight up at 0 to straight down at 1
+	void GetDirection(float u, float v, float* direction)
+	{
+		float phi = (u - 0.5f) * 2.0f * PI;
+		float theta = v * PI;
+		direction[0] = std::sin(theta) * std::sin(phi);
+		direction[1] = std::cos(theta);
+		direction[2] = -std::sin(theta) * std::cos(phi);
+	}
+
+	void GetCoordinates(const float* direction, float& u, float& v)
+	{
+		u = std::atan2(direction[0], -direction[2]) / (2.0f * PI) + 0.5f;
+		v = std::acos(std::clamp(direction[1], -1.0f, 1.0f)) / PI;
+	}
+
+	// wraps around the horizon, clamps at the poles
+	void SampleBilinear(const Level& level, float u, float v, float* color)
+	{
+		float x = u * float(level.width) - 0.5f;
+		float y = v * float(level.height) - 0.5f;
+		int x0 = int(std::floor(x));
+		int y0 = int(std::floor(y));
+		float fx = x - float(x0);
+		float fy = y - float(y0);
+
+		std::fill_n(color, 4, 0.0f);
+		for (int dy = 0; dy < 2; dy++)
+		{
+			for (int dx = 0; dx < 2; dx++)
+			{
+				int sx = ((x0 + dx) % level.width + level.width) % level.width;
+				int sy = std::clamp(y0 + dy, 0, level.height - 1);
+				float weight = (dx ? fx : 1.0f - fx) * (dy ? fy : 1.0f - fy);
+
+				auto texel = level.pixels.data() + (size_t(sy) * size_t(level.width) + size_t(sx)) * 4;
+				for (int c = 0; c < 4; c++)
+					color[c] += texel[c] * weight;
+			}
+		}
+	}
+
+	void SampleTrilinear(const std::vector<Level>& pyramid, float u, float v, float lod, float* color)
+	{
+		lod = std::clamp(lod, 0.0f, float(pyramid.size() - 1));
+		int level = int(lod);
+		float t = lod - float(level);
+
+		SampleBilinear(pyramid[level], u, v, color);
+		if (t > 0.0f && level + 1 < int(pyramid.size()))
+		{
+			float next[4];
+			SampleBilinear(pyramid[level + 1], u, v, next);
+			for (int c = 0; c < 4; c++)
+				color[c] += (next[c] - color[c]) * t;
+		}
+	}
+
+	Level Downsample(const Level& source)
+	{
+		Level level{ std::max(1, source.width / 2), std::max(1, source.height / 2), {} };
+		level.pixels.resize(size_t(level.width) * size_t(level.height) * 4);
+
+		for (int y = 0; y < level.height; y++)
+		{
+			for (int x = 0; x < level.width; x++)
+			{
+				auto target = level.pixels.data() + (size_t(y) * size_t(level.width) + size_t(x)) * 4;
+				for (int i = 0; i < 4; i++)
+				{
+					int sx = std::min(x * 2 + (i & 1), source.width - 1);
+					int sy = std::min(y * 2 + (i >> 1), source.height - 1);
+					auto texel = source.pixels.data() + (size_t(sy) * size_t(source.width) + size_t(sx)) * 4;
+					for (int c = 0; c < 4; c++)
+						target[c] += texel[c] * 0.25f;
+				}
+			}
+		}
+
+		return level;
+	}
+
+	void GetHammersley(uint32_t i, float* xi)
+	{
+		uint32_t bits = i;
+		bits = (bits << 16) | (bits >> 16);
+		bits = ((bits & 0x55555555u) << 1) | ((bits & 0xAAAAAAAAu) >> 1);
+		bits = ((bits & 0x33333333u) << 2) | ((bits & 0xCCCCCCCCu) >> 2);
+		bits = ((bits & 0x0F0F0F0Fu) << 4) | ((bits & 0xF0F0F0F0u) >> 4);
+		bits = ((bits & 0x00FF00FFu) << 8) | ((bits & 0xFF00FF00u) >> 8);
+
+		xi[0] = float(i) / float(SAMPLE_COUNT);
+		xi[1] = float(bits) * 2.3283064365386963e-10f;
+	}
+
+	// The usual split sum assumption that the view is the normal, so every texel is one lobe around its direction
+	void FilterLevel(const std::vector<Level>& pyramid, float roughness, Level& target)
+	{
+		float alpha = roughness * roughness;
+		float alpha2 = alpha * alpha;
+
+		// of a source texel at the equator, it shrinks with sin(theta) towards the poles
+		auto& source = pyramid[0];
+		float texel_solid_angle = 2.0f * PI * PI / (float(source.width) * float(source.height));
+
+		std::vector<int> rows(size_t(target.height));
+		std::iota(rows.begin(), rows.end(), 0);
+
+		std::for_each(std::execution::par, rows.begin(), rows.end(), [&](int y) {
+			for (int x = 0; x < target.width; x++)
+			{
+				float n[3];
+				GetDirection((float(x) + 0.5f) / float(target.width), (float(y) + 0.5f) / float(target.height), n);
+
+				float up[3] = { 0.0f, 0.0f, 0.0f };
+				up[std::abs(n[1]) < 0.999f ? 1 : 0] = 1.0f;
+
+				float tangent[3] = { up[1] * n[2] - up[2] * n[1], up[2] * n[0] - up[0] * n[2], up[0] * n[1] - up[1] * n[0] };
+				float length = std::sqrt(tangent[0] * tangent[0] + tangent[1] * tangent[1] + tangent[2] * tangent[2]);
+				for (auto& t : tangent)
+					t /= length;
+
+				float bitangent[3] = { n[1] * tangent[2] - n[2] * tangent[1], n[2] * tangent[0] - n[0] * tangent[2], n[0] * tangent[1] - n[1] * tangent[0] };
+
+				float sum[4] = {};
+				float total_weight = 0.0f;
+
+				for (uint32_t i = 0; i < SAMPLE_COUNT; i++)
+				{
+					float xi[2];
+					GetHammersley(i, xi);
+
+					float phi = 2.0f * PI * xi[0];
+					float cos_theta = std::sqrt((1.0f - xi[1]) / (1.0f + (alpha2 - 1.0f) * xi[1]));
+					float sin_theta = std::sqrt(1.0f - cos_theta * cos_theta);
+
+					float h[3], l[3];
+					for (int c = 0; c < 3; c++)
+					{
+						h[c] = tangent[c] * sin_theta * std::cos(phi) + bitangent[c] * sin_theta * std::sin(phi) + n[c] * cos_theta;
+						l[c] = 2.0f * cos_theta * h[c] - n[c];
+					}
+
+					float n_dot_l = n[0] * l[0] + n[1] * l[1] + n[2] * l[2];
+					if (n_dot_l <= 0.0f)
+						continue;
+
+					// each sample stands for this much of the sphere, read from the mip whose texels are about that size
+					float d = cos_theta * cos_theta * (alpha2 - 1.0f) + 1.0f;
+					float pdf = alpha2 / (PI * d * d) * 0.25f;
+					float sample_solid_angle = 1.0f / (float(SAMPLE_COUNT) * pdf + 0.0001f);
+
+					float u, v;
+					GetCoordinates(l, u, v);
+					float texel = texel_solid_angle * std::max(std::sin(v * PI), 0.0001f);
+					float lod = roughness == 0.0f ? 0.0f : 0.5f * std::log2(sample_solid_angle / texel) + 1.0f;
+
+					float color[4];
+					SampleTrilinear(pyramid, u, v, lod, color);
+					for (int c = 0; c < 4; c++)
+						sum[c] += color[c] * n_dot_l;
+					total_weight += n_dot_l;
+				}
+
+				auto pixel = target.pixels.data() + (size_t(y) * size_t(target.width) + size_t(x)) * 4;
+				for (int c = 0; c < 4; c++)
+					pixel[c] = total_weight > 0.0f ? sum[c] / total_weight : 0.0f;
+			}
+		});
+	}
+}
+
+void PrefilterEnvironment(const FloatImage& image, CompressedTexture& result)
+{
+	std::vector<Level> pyramid;
+	pyramid.push_back({ image.width, image.height, image.pixels });
+	while (pyramid.back().width > 1 || pyramid.back().height > 1)
+		pyramid.push_back(Downsample(pyramid.back()));
+
+	int level_count = GetMipLevelCount(image.width, image.height);
+
+	result.format = TextureFormat::RGBA16F;
+	result.width = image.width;
+	result.height = image.height;
+	result.levels.clear();
+
+	size_t total = 0;
+	for (int i = 0; i < level_count; i++)
+	{
+		auto size = GetLevelBytes(result.format, std::max(1, image.width >> i), std::max(1, image.height >> i));
+		result.levels.push_back({ total, size });
+		total += size;
+	}
+	result.data.resize(total);
+
+	for (int i = 0; i < level_count; i++)
+	{
+		// a mirror is the image itself
+		Level filtered{ std::max(1, image.width >> i), std::max(1, image.height >> i), {} };
+		if (i == 0)
+		{
+			filtered.pixels = image.pixels;
+		}
+		else
+		{
+			filtered.pixels.resize(size_t(filtered.width) * size_t(filtered.height) * 4);
+			FilterLevel(pyramid, float(i) / float(level_count - 1), filtered);
+		}
+
+		auto target = (uint16_t*)(result.data.data() + result.levels[i].offset);
+		for (size_t j = 0; j < filtered.pixels.size(); j++)
+			target[j] = FloatToHalf(filtered.pixels[j]);
+	}
+}
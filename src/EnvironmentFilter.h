@@ -0,0 +1,9 @@
+#pragma once
+#include "FloatImage.h"
+#include "TextureCompression.h"
+
+// Prefilters an equirectangular environment for image based lighting into a full RGBA16F chain.
+// Level i holds the radiance convolved with a GGX lobe of roughness i / (levels - 1), so shaders
+// read it with textureLod(iChannel0, uv, roughness * float(textureQueryLevels(iChannel0) - 1)).
+// Slow for large images like CompressTexture, meant for worker threads, see TextureCache.
+void PrefilterEnvironment(const FloatImage& image, CompressedTexture& result);
@@ -0,0 +1,404 @@
+#include "FloatImage.h"
+#include "Utils.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+namespace
+{
+	constexpr uint32_t EXR_MAGIC = 20000630;
+	constexpr uint32_t EXR_TILED = 0x200;
+	constexpr uint32_t EXR_DEEP = 0x800;
+	constexpr uint32_t EXR_MULTIPART = 0x1000;
+
+	enum ExrCompression : uint8_t { EXR_NONE = 0, EXR_RLE = 1, EXR_ZIPS = 2, EXR_ZIP = 3 };
+	enum ExrPixelType : int32_t { EXR_UINT = 0, EXR_HALF = 1, EXR_FLOAT = 2 };
+
+	struct ExrChannel
+	{
+		std::string name;
+		int32_t type;
+		int component;		// RGBA index, 4 for luminance, -1 when not used
+	};
+
+	class Reader
+	{
+	public:
+		Reader(const std::vector<uint8_t>& data, size_t offset = 0) : data(data), offset(offset) {}
+
+		bool Read(void* value, size_t size)
+		{
+			if (size > data.size() - offset)
+				return false;
+			memcpy(value, data.data() + offset, size);
+			offset += size;
+			return true;
+		}
+
+		template<typename T>
+		bool Read(T& value) { return Read(&value, sizeof(T)); }
+
+		bool ReadString(std::string& value)
+		{
+			auto end = std::find(data.begin() + offset, data.end(), 0);
+			if (end == data.end())
+				return false;
+			value.assign(data.begin() + offset, end);
+			offset = size_t(end - data.begin()) + 1;
+			return true;
+		}
+
+		const std::vector<uint8_t>& data;
+		size_t offset;
+	};
+
+	int GetComponent(const std::string& name)
+	{
+		// layered files name channels like "diffuse.R", the last part tells what it is
+		auto last = name.substr(name.rfind('.') == std::string::npos ? 0 : name.rfind('.') + 1);
+		if (last == "R") return 0;
+		if (last == "G") return 1;
+		if (last == "B") return 2;
+		if (last == "A") return 3;
+		if (last == "Y") return 4;
+		return -1;
+	}
+
+	// ZIP and RLE store the bytes delta encoded and split into two halves, undone here
+	void Unpredict(const std::vector<uint8_t>& source, uint8_t* target)
+	{
+		std::vector<uint8_t> deltas(source);
+		for (size_t i = 1; i < deltas.size(); i++)
+			deltas[i] = uint8_t(deltas[i - 1] + deltas[i] - 128);
+
+		size_t half = (deltas.size() + 1) / 2;
+		for (size_t i = 0; i < deltas.size(); i++)
+			target[i] = deltas[(i % 2 == 0) ? i / 2 : half + i / 2];
+	}
+
+	bool DecodeRle(const uint8_t* source, size_t size, std::vector<uint8_t>& target, size_t expected)
+	{
+		target.clear();
+		size_t i = 0;
+		while (i < size)
+		{
+			auto count = int8_t(source[i++]);
+			if (count < 0)
+			{
+				if (i + size_t(-count) > size)
+					return false;
+				target.insert(target.end(), source + i, source + i - count);
+				i += size_t(-count);
+			}
+			else
+			{
+				if (i >= size)
+					return false;
+				target.insert(target.end(), size_t(count) + 1, source[i++]);
+			}
+		}
+		return target.size() == expected;
+	}
+
+	bool LoadExr(const std::filesystem::path& path, bool flipVertically, FloatImage& image)
+	{
+		std::ifstream stream(path, std::ios::binary | std::ios::ate);
+		if (!stream)
+			return false;
+
+		std::vector<uint8_t> data(size_t(stream.tellg()));
+		stream.seekg(0);
+		if (!stream.read((char*)data.data(), std::streamsize(data.size())))
+			return false;
+
+		Reader reader(data);
+		uint32_t magic = 0, version = 0;
+		if (!reader.Read(magic) || !reader.Read(version) || magic != EXR_MAGIC || (version & 0xFF) != 2 ||
+			(version & (EXR_TILED | EXR_DEEP | EXR_MULTIPART)) != 0)
+		{
+			return false;
+		}
+
+		std::vector<ExrChannel> channels;
+		uint8_t compression = 0xFF;
+		int32_t window[4] = {};
+		bool has_window = false;
+
+		for (;;)
+		{
+			std::string name, type;
+			int32_t size = 0;
+			if (!reader.ReadString(name))
+				return false;
+			if (name.empty())
+				break;
+			if (!reader.ReadString(type) || !reader.Read(size) || size < 0 || size_t(size) > data.size() - reader.offset)
+				return false;
+
+			auto value_end = reader.offset + size_t(size);
+			if (name == "channels")
+			{
+				for (;;)
+				{
+					ExrChannel channel;
+					if (!reader.ReadString(channel.name))
+						return false;
+					if (channel.name.empty())
+						break;
+
+					uint8_t linear_and_reserved[4];
+					int32_t sampling[2];
+					if (!reader.Read(channel.type) || !reader.Read(linear_and_reserved) || !reader.Read(sampling))
+						return false;
+
+					// subsampled channels change the line layout, nothing writes them for environments
+					if (sampling[0] != 1 || sampling[1] != 1 || channel.type < EXR_UINT || channel.type > EXR_FLOAT)
+						return false;
+
+					channel.component = GetComponent(channel.name);
+					channels.push_back(channel);
+				}
+			}
+			else if (name == "compression")
+			{
+				reader.Read(compression);
+			}
+			else if (name == "dataWindow")
+			{
+				has_window = reader.Read(window);
+			}
+
+			reader.offset = value_end;
+		}
+
+		int lines_per_block = 0;
+		switch (compression)
+		{
+		case EXR_NONE:
+		case EXR_RLE:
+		case EXR_ZIPS:
+			lines_per_block = 1;
+			break;
+		case EXR_ZIP:
+			lines_per_block = 16;
+			break;
+		default:
+			return false;
+		}
+
+		if (!has_window || channels.empty())
+			return false;
+
+		int width = window[2] - window[0] + 1;
+		int height = window[3] - window[1] + 1;
+		if (width <= 0 || height <= 0 || width > 65536 || height > 65536)
+			return false;
+
+		size_t line_bytes = 0;
+		for (auto& channel : channels)
+			line_bytes += size_t(width) * (channel.type == EXR_HALF ? 2 : 4);
+
+		image.width = width;
+		image.height = height;
+		image.pixels.assign(size_t(width) * size_t(height) * 4, 0.0f);
+		for (size_t i = 3; i < image.pixels.size(); i += 4)
+			image.pixels[i] = 1.0f;
+
+		auto chunk_count = (height + lines_per_block - 1) / lines_per_block;
+		std::vector<uint8_t> raw, unpacked;
+
+		for (int chunk = 0; chunk < chunk_count; chunk++)
+		{
+			uint64_t chunk_offset = 0;
+			if (!reader.Read(chunk_offset) || chunk_offset > data.size())
+				return false;
+
+			Reader chunk_reader(data, size_t(chunk_offset));
+			int32_t y = 0, size = 0;
+			if (!chunk_reader.Read(y) || !chunk_reader.Read(size) || size < 0 || size_t(size) > data.size() - chunk_reader.offset)
+				return false;
+
+			int first_line = y - window[1];
+			if (first_line < 0 || first_line >= height)
+				return false;
+
+			int lines = std::min(lines_per_block, height - first_line);
+			auto expected = line_bytes * size_t(lines);
+			auto source = data.data() + chunk_reader.offset;
+
+			// blocks that did not get smaller are stored as they are
+			const uint8_t* pixels = source;
+			if (size_t(size) < expected)
+			{
+				raw.resize(expected);
+				if (compression == EXR_RLE)
+				{
+					if (!DecodeRle(source, size_t(size), unpacked, expected))
+						return false;
+				}
+				else
+				{
+					unpacked.resize(expected);
+					if (stbi_zlib_decode_buffer((char*)unpacked.data(), int(expected), (const char*)source, size) != int(expected))
+						return false;
+				}
+
+				Unpredict(unpacked, raw.data());
+				pixels = raw.data();
+			}
+			else if (size_t(size) != expected)
+			{
+				return false;
+			}
+
+			for (int line = 0; line < lines; line++)
+			{
+				int row = first_line + line;
+				if (flipVertically)
+					row = height - 1 - row;
+
+				auto target = image.pixels.data() + size_t(row) * size_t(width) * 4;
+				for (auto& channel : channels)
+				{
+					for (int x = 0; x < width; x++)
+					{
+						float value = 0.0f;
+						if (channel.type == EXR_HALF)
+						{
+							uint16_t half;
+							memcpy(&half, pixels, 2);
+							value = HalfToFloat(half);
+							pixels += 2;
+						}
+						else if (channel.type == EXR_FLOAT)
+						{
+							memcpy(&value, pixels, 4);
+							pixels += 4;
+						}
+						else
+						{
+							uint32_t integer;
+							memcpy(&integer, pixels, 4);
+							value = float(integer);
+							pixels += 4;
+						}
+
+						if (channel.component == 4)
+						{
+							target[x * 4 + 0] = target[x * 4 + 1] = target[x * 4 + 2] = value;
+						}
+						else if (channel.component >= 0)
+						{
+							target[x * 4 + channel.component] = value;
+						}
+					}
+				}
+			}
+		}
+
+		return true;
+	}
+}
+
+bool IsFloatImageFile(const std::filesystem::path& path)
+{
+	auto extension = get_lowercase_extension(path);
+	return extension == ".hdr" || extension == ".exr";
+}
+
+bool LoadFloatImage(const std::filesystem::path& path, bool flipVertically, FloatImage& image)
+{
+	auto extension = get_lowercase_extension(path);
+	if (extension == ".exr")
+		return LoadExr(path, flipVertically, image);
+
+	stbi_set_flip_vertically_on_load_thread(flipVertically);
+
+	int channels = 0;
+	auto pixels = stbi_loadf(path.string().c_str(), &image.width, &image.height, &channels, 4);
+	if (pixels == nullptr)
+		return false;
+
+	image.pixels.assign(pixels, pixels + size_t(image.width) * size_t(image.height) * 4);
+	stbi_image_free(pixels);
+	return true;
+}
+
+uint16_t FloatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	uint16_t sign = uint16_t((bits >> 16) & 0x8000);
+	int32_t exponent = int32_t((bits >> 23) & 0xFF);
+	uint32_t mantissa = bits & 0x7FFFFF;
+
+	if (exponent == 0xFF)
+		return uint16_t(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+
+	exponent = exponent - 127 + 15;
+
+	// too bright for half floats, the largest finite value keeps filtering free of infinities
+	if (exponent >= 31)
+		return uint16_t(sign | 0x7BFF);
+
+	if (exponent <= 0)
+	{
+		if (exponent < -10)
+			return sign;
+
+		mantissa |= 0x800000;
+		int shift = 14 - exponent;
+		uint32_t half = mantissa >> shift;
+		if ((mantissa >> (shift - 1)) & 1)
+			half++;
+		return uint16_t(sign | half);
+	}
+
+	uint32_t half = (uint32_t(exponent) << 10) | (mantissa >> 13);
+	if (mantissa & 0x1000)
+		half++;
+	return uint16_t(sign | std::min(half, 0x7BFFu));
+}
+
+float HalfToFloat(uint16_t value)
+{
+	uint32_t sign = uint32_t(value & 0x8000) << 16;
+	uint32_t exponent = (value >> 10) & 0x1F;
+	uint32_t mantissa = value & 0x3FF;
+
+	uint32_t bits;
+	if (exponent == 0)
+	{
+		if (mantissa == 0)
+		{
+			bits = sign;
+		}
+		else
+		{
+			// denormal, normalized for the float
+			exponent = 127 - 15 + 1;
+			while ((mantissa & 0x400) == 0)
+			{
+				mantissa <<= 1;
+				exponent--;
+			}
+			bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+		}
+	}
+	else if (exponent == 31)
+	{
+		bits = sign | 0x7F800000 | (mantissa << 13);
+	}
+	else
+	{
+		bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+	}
+
+	float result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
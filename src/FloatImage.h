@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// RGBA 32 bit float pixels, top row first unless loaded flipped
+struct FloatImage
+{
+	int width{ 0 };
+	int height{ 0 };
+	std::vector<float> pixels;
+};
+
+// .hdr and .exr, the formats that need a float texture
+bool IsFloatImageFile(const std::filesystem::path& path);
+
+// Radiance .hdr through stb_image. OpenEXR single part scanline files with uncompressed, RLE, ZIPS
+// or ZIP data, which covers what most tools write by default. Missing channels read as 0, alpha as 1.
+bool LoadFloatImage(const std::filesystem::path& path, bool flipVertically, FloatImage& image);
+
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t value);
@@ -4,54 +4,136 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+static const char* PASS_NAMES[] = { "FullScreenRenderPass_", "CubemapRenderPass_", "VolumeRenderPass_" };
+static const char* SHADER_NAMES[] = { "Full Screen", "Cubemap", "Volume" };
+static const char* FRAGMENT_SOURCES[] = {
+	"Shaders\\ShaderToyBaseFragment.glsl",
+	"Shaders\\ShaderToyCubemapFragment.glsl",
+	"Shaders\\ShaderToyVolumeFragment.glsl",
+};
+
 void FullScreenRenderPass::Init()
 {
 	RenderPass::Init();
 
 	std::stringstream ss;
-	ss << "FullScreenRenderPass_" << Application::Get()->GetPassCount() + 1;
+	ss << PASS_NAMES[int(outputDimension)] << Application::Get()->GetPassCount() + 1;
 	name = ss.str();
 
-	auto width = Application::instance->preview_fb->GetWidth();
-	auto height = Application::instance->preview_fb->GetHeight();
+	if (outputDimension == ChannelDimension::TEXTURE_2D)
+	{
+		auto width = Application::instance->preview_fb->GetWidth();
+		auto height = Application::instance->preview_fb->GetHeight();
 
-	output = new Framebuffer(width, height);
-	output->AddAttachment(Format::RGBA8, true);
-	output->Resize(width, height);
+		output = new Framebuffer(width, height);
+		output->AddAttachment(Format::RGBA8, true);
+		output->Resize(width, height);
+	}
+	else
+	{
+		outputSize = outputDimension == ChannelDimension::CUBEMAP ? 512 : 64;
+		CreateLayeredOutput();
+	}
 
 	{
 		shader = new ShaderProgramSource;
 		std::string source;
-		if (read_entire_file("Shaders\\ShaderToyBaseVertex.glsl", source))
+		auto vertex_source = outputDimension == ChannelDimension::CUBEMAP ? "Shaders\\ShaderToyCubemapVertex.glsl" : "Shaders\\ShaderToyBaseVertex.glsl";
+		if (read_entire_file(vertex_source, source))
 		{
 			auto vs = new Shader(ShaderType::Vertex, source);
 			shader->AttachShader(vs);
 			shader->SetVertexSource(source);
 		}
 
-		if (read_entire_file("Shaders\\ShaderToyBaseFragment.glsl", source))
+		if (read_entire_file(FRAGMENT_SOURCES[int(outputDimension)], source))
 		{
 			auto fs = new Shader(ShaderType::Fragment, source);
 			shader->AttachShader(fs);
 			shader->SetFragmentSource(source);
 		}
 
-		shader->Link(nullptr, nullptr);
-		shader->SetName("Full Screen");
+		if (shader->Link(nullptr, nullptr))
+			shader->ReflectSamplers();
+
+		shader->SetName(SHADER_NAMES[int(outputDimension)]);
 	}
 }
 
+void FullScreenRenderPass::CreateLayeredOutput()
+{
+	if (layeredFramebuffer)
+		glDeleteFramebuffers(1, &layeredFramebuffer);
+	if (layeredTexture)
+		glDeleteTextures(1, &layeredTexture);
+
+	// half floats, skies and densities rarely fit into 8 bits
+	bool cubemap = outputDimension == ChannelDimension::CUBEMAP;
+	glCreateTextures(cubemap ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_3D, 1, &layeredTexture);
+	if (cubemap)
+		glTextureStorage2D(layeredTexture, 1, GL_RGBA16F, outputSize, outputSize);
+	else
+		glTextureStorage3D(layeredTexture, 1, GL_RGBA16F, outputSize, outputSize, outputSize);
+
+	glTextureParameteri(layeredTexture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTextureParameteri(layeredTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTextureParameteri(layeredTexture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(layeredTexture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(layeredTexture, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+	// all six faces are attached at once for the layered draw, volume slices one at a time while drawing
+	glCreateFramebuffers(1, &layeredFramebuffer);
+	if (cubemap)
+		glNamedFramebufferTexture(layeredFramebuffer, GL_COLOR_ATTACHMENT0, layeredTexture, 0);
+}
+
+size_t FullScreenRenderPass::GetOutputBytes()
+{
+	if (outputDimension == ChannelDimension::TEXTURE_2D)
+		return RenderPass::GetOutputBytes();
+
+	auto layers = outputDimension == ChannelDimension::CUBEMAP ? 6 : outputSize;
+	return size_t(outputSize) * size_t(outputSize) * size_t(layers) * 8;
+}
+
+unsigned int FullScreenRenderPass::GetOutputTexture()
+{
+	return outputDimension == ChannelDimension::TEXTURE_2D ? RenderPass::GetOutputTexture() : layeredTexture;
+}
+
+void FullScreenRenderPass::GetOutputSize(int& width, int& height, int& depth)
+{
+	if (outputDimension == ChannelDimension::TEXTURE_2D)
+		return RenderPass::GetOutputSize(width, height, depth);
+
+	width = height = outputSize;
+	depth = outputDimension == ChannelDimension::VOLUME ? outputSize : 0;
+}
+
 void FullScreenRenderPass::Draw()
 {
 	if (shader->IsValid())
 	{
-		output->ClearAttachments();
-		output->Bind();
+		if (outputDimension == ChannelDimension::TEXTURE_2D)
+		{
+			output->ClearAttachments();
+			output->Bind();
+		}
+		else
+		{
+			glClearTexImage(layeredTexture, 0, GL_RGBA, GL_FLOAT, nullptr);
+			glBindFramebuffer(GL_FRAMEBUFFER, layeredFramebuffer);
+			glViewport(0, 0, outputSize, outputSize);
+		}
+
 		shader->Bind();
 
 		auto app = Application::instance;
 
-		float resolution[3] = { float(output->GetWidth()), float(output->GetHeight()) , 0.0f };
+		int width = 0, height = 0, depth = 0;
+		GetOutputSize(width, height, depth);
+
+		float resolution[3] = { float(width), float(height), float(depth) };
 		float mouseInput[4] = { app->mouse_position.x, app->mouse_position.y,
 			app->mouse_left_button ? 1.0f : 0.0f, app->mouse_right_button ? 1.0f : 0.0f };
 
@@ -59,29 +141,17 @@ void FullScreenRenderPass::Draw()
 			float channelResolutions[16 * 3] = {};
 			float channelTimes[16] = {};
 
-			int i = 0;
-			for (auto& c : channels)
+			for (int i = 0; i < int(channels.size()); i++)
 			{
-				if (c == nullptr || c->texture == nullptr) continue;
-				if (c->type == ChannelType::EXTERNAL_IMAGE)
-				{
-					channelResolutions[i + 0] = (float)c->texture->GetWidth();
-					channelResolutions[i + 1] = (float)c->texture->GetHeight();
-					channelResolutions[i + 2] = 0.0f;
-				}
-				else if (c->type == ChannelType::RENDERPASS)
-				{
-					channelResolutions[i + 0] = (float)c->pass->GetOutput()->GetWidth();
-					channelResolutions[i + 1] = (float)c->pass->GetOutput()->GetHeight();
-					channelResolutions[i + 2] = 0.0f;
-				}
+				auto c = channels[i];
+				GetChannelResolution(i, channelResolutions + i * 3);
 
-				channelTimes[i] = app->time;
-				i++;
+				// videos loop, their channel time is that of the frame on screen
+				channelTimes[i] = c && c->type == ChannelType::VIDEO && c->video ? c->video->GetFrameTime() : app->time;
 			}
 
 			shader->UniformVec3Array("iChannelResolution", 16, channelResolutions);
-			shader->UniformVec3Array("iChannelTime", 16, channelTimes);
+			shader->UniformFloatArray("iChannelTime", 16, channelTimes);
 		}
 
 		shader->UniformVec3("iResolution", resolution);
@@ -90,112 +160,66 @@ void FullScreenRenderPass::Draw()
 		shader->UniformInt("iFrame", int(app->frames));
 		shader->UniformFloat("iTimeDelta", app->dt);
 		shader->UniformVec4("iMouse", mouseInput);
-		Application::instance->DrawFullScreenQuad();
-	}
-}
-
-void FullScreenRenderPass::OnImGui()
-{
-	ImGui::SeparatorText("Channels");
-
-	ImGui::Columns(2);
 
-	auto size = ImVec2{ 120, 120 };
-
-	for (int i = 0; i < channels.size(); i++)
-	{
-		ImGui::Text("Channel %d", i);
-
-		auto channel = channels[i];
-		auto is_image_clicked = false;
-
-		char buff[128];
-		sprintf_s(buff, "%sChannel%d%llu", name.c_str(), i, (uint64_t)this);
-		if (channel && channel->type == ChannelType::EXTERNAL_IMAGE && channel->texture)
+		if (outputDimension == ChannelDimension::CUBEMAP)
 		{
-			is_image_clicked = ImGui::ImageButton(buff, ((ImTextureID)
-				(channel->texture->GetID())), size, { 0, 1 }, { 1, 0 });
+			app->DrawFullScreenQuad(6);
 		}
-		else if (channel && channel->type == ChannelType::RENDERPASS && channel->pass)
+		else if (outputDimension == ChannelDimension::VOLUME)
 		{
-			auto& [texture, is_draw] = channel->pass->GetOutput()->GetColorAttachments()[0];
-			auto id = texture->GetID();
-			is_image_clicked = ImGui::ImageButton(buff,
-				((ImTextureID)(id)), size, { 0, 1 }, { 1, 0 });
+			for (int slice = 0; slice < outputSize; slice++)
+			{
+				glNamedFramebufferTextureLayer(layeredFramebuffer, GL_COLOR_ATTACHMENT0, layeredTexture, 0, slice);
+				shader->UniformInt("iSlice", slice);
+				app->DrawFullScreenQuad();
+			}
 		}
 		else
 		{
-			ImTextureRef null_image(ImTextureID(0));
-			is_image_clicked = ImGui::ImageButton(buff, null_image, size);
+			app->DrawFullScreenQuad();
 		}
+	}
+}
 
-		if (is_image_clicked)
-		{
-			open_channel_settings = true;
-			selected_channel = i;
-		}
+void FullScreenRenderPass::OnImGui()
+{
+	if (outputDimension != ChannelDimension::TEXTURE_2D)
+	{
+		ImGui::SeparatorText("Output");
 
-		if (ImGui::BeginDragDropTarget())
+		// a 256 texel volume is already 128 MB
+		static const int sizes[] = { 16, 32, 64, 128, 256, 512, 1024, 2048 };
+		bool cubemap = outputDimension == ChannelDimension::CUBEMAP;
+		if (ImGui::BeginCombo(cubemap ? "Face Size" : "Volume Size", std::to_string(outputSize).c_str()))
 		{
-			auto payload = ImGui::AcceptDragDropPayload("dropped_files");
-			ImGui::EndDragDropTarget();
-			
-			for (const auto& item : Application::instance->drop_items)
+			for (auto size : sizes)
 			{
-				if (item.ends_with(".png") || item.ends_with(".jpg") || item.ends_with(".jpeg"))
-				{
-					auto c = new Channel;
-					c->texture = new Texture2D(item.c_str(), true);
-					c->type = ChannelType::EXTERNAL_IMAGE;
-					SetChannel(i, c);
+				if (!cubemap && size > 256)
 					break;
+
+				if (ImGui::Selectable(std::to_string(size).c_str(), size == outputSize) && size != outputSize)
+				{
+					outputSize = size;
+					CreateLayeredOutput();
 				}
 			}
-
-			Application::instance->drop_items.clear();
+			ImGui::EndCombo();
 		}
 
-		ImGui::NextColumn();
+		ImGui::Text("RGBA16F %s, %.1f MB", cubemap ? "cubemap" : "volume", double(GetOutputBytes()) / (1024.0 * 1024.0));
 	}
 
-	ImGui::Columns(1);
-
-	if (open_channel_settings) 
-	{
-		ImGui::OpenPopup("Channel Settings");
-		ImVec2 center(ImGui::GetIO().DisplaySize.x * 0.5f, ImGui::GetIO().DisplaySize.y * 0.5f);
-		ImGui::SetNextWindowPos(center, ImGuiCond_Appearing, ImVec2(0.5f, 0.5f));
-		if (ImGui::BeginPopupModal("Channel Settings", &open_channel_settings, ImGuiWindowFlags_AlwaysAutoResize))
-		{
-			ImGui::Text("%s Channel %d Settings", GetName().c_str(), selected_channel);
-
-			auto c = GetChannel(selected_channel);
+	ImGui::SeparatorText("Channels");
 
-			ImGui::Combo("Channel Type", (int*)(&c->type), "ImageFile\0RenderPass\0");
+	ImGui::Columns(2);
 
-			if (c->type == ChannelType::RENDERPASS) 
-			{
-				static int current_item = 0;
+	for (int i = 0; i < channels.size(); i++)
+	{
+		OnChannelImGui(i, true);
+		ImGui::NextColumn();
+	}
 
-				if (ImGui::BeginCombo("Render Pass", c->pass ? c->pass->GetName().c_str() : "Select Render Pass"))
-				{
-					for (size_t i = 0; i < Application::instance->passes.size(); i++)
-					{
-						bool selected = c->pass == Application::instance->passes[i];
-						if (ImGui::Selectable(Application::instance->passes[i]->GetName().c_str(), selected))
-						{
-							c->pass = Application::instance->passes[i];
-						}
-					}
-					ImGui::EndCombo();
-				}
-			}
-			else
-			{
-				c->pass = nullptr;
-			}
+	ImGui::Columns(1);
 
-			ImGui::EndPopup();
-		}
-	}
+	OnChannelSettingsImGui();
 }
@@ -1,15 +1,29 @@
 #pragma once
 #include "RenderPass.h"
 
+// Runs a ShaderToy style fragment shader over the whole output. Cubemap passes call mainCubemap for
+// all six faces in one layered draw, volume passes call mainVolume once per slice of a 3D texture.
 class FullScreenRenderPass : public RenderPass 
 {
 public:
+	explicit FullScreenRenderPass(ChannelDimension outputDimension = ChannelDimension::TEXTURE_2D)
+		: outputDimension(outputDimension) {}
+
 	virtual void Init() override;
 	virtual void Draw() override;
 	virtual void OnImGui() override;
 
+	virtual size_t GetOutputBytes() override;
+	virtual unsigned int GetOutputTexture() override;
+	virtual ChannelDimension GetOutputDimension() override { return outputDimension; }
+	virtual void GetOutputSize(int& width, int& height, int& depth) override;
+
 private:
-	bool open_channel_settings { false };
-	int selected_channel { 0 };
-};
+	void CreateLayeredOutput();
 
+	// cubemap and volume outputs are fixed size, they do not follow the preview
+	ChannelDimension outputDimension;
+	int outputSize{ 0 };				// face or volume edge in texels
+	unsigned int layeredTexture{ 0 };
+	unsigned int layeredFramebuffer{ 0 };
+};
@@ -0,0 +1,373 @@
+#include "ImageDecoder.h"
+#include "Utils.h"
+#include "stb_image.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef SHADER_ALCHEMY_HAS_LIBJPEG
+#include <csetjmp>
+#include <jpeglib.h>
+// the RGBA output the decoder relies on is a libjpeg-turbo extension, plain libjpeg is left to stb_image
+#ifdef JCS_ALPHA_EXTENSIONS
+#define HAS_LIBJPEG_TURBO
+#endif
+#endif
+
+#ifdef SHADER_ALCHEMY_HAS_LIBPNG
+#include <png.h>
+#endif
+
+namespace
+{
+	bool ReadFile(const std::filesystem::path& path, std::vector<uint8_t>& data)
+	{
+		std::ifstream stream(path, std::ios::binary | std::ios::ate);
+		if (!stream)
+			return false;
+
+		data.resize(size_t(stream.tellg()));
+		stream.seekg(0);
+		return bool(stream.read((char*)data.data(), std::streamsize(data.size())));
+	}
+
+	uint8_t* DecodeStbImage(const std::filesystem::path& path, bool flipVertically, int& width, int& height)
+	{
+		// per thread, other code flips globally for its own images
+		stbi_set_flip_vertically_on_load_thread(flipVertically);
+
+		int channels = 0;
+		return stbi_load(path.string().c_str(), &width, &height, &channels, 4);
+	}
+
+#ifdef HAS_LIBJPEG_TURBO
+	struct JpegError
+	{
+		jpeg_error_mgr manager;
+		jmp_buf jump;
+	};
+
+	// Everything that has a destructor lives outside the setjmp scope, libjpeg only unwinds C frames
+	uint8_t* DecodeJpeg(const std::vector<uint8_t>& data, bool flipVertically, int& width, int& height)
+	{
+		jpeg_decompress_struct info = {};
+		JpegError error = {};
+		uint8_t* volatile pixels = nullptr;
+
+		info.err = jpeg_std_error(&error.manager);
+		error.manager.error_exit = [](j_common_ptr common) { longjmp(((JpegError*)common->err)->jump, 1); };
+		error.manager.output_message = [](j_common_ptr) {};
+
+		if (setjmp(error.jump))
+		{
+			jpeg_destroy_decompress(&info);
+			free(pixels);
+			return nullptr;
+		}
+
+		jpeg_create_decompress(&info);
+		jpeg_mem_src(&info, data.data(), (unsigned long)data.size());
+		jpeg_read_header(&info, TRUE);
+
+		// converted straight into RGBA by the SIMD color conversion, no extra pass over the pixels
+		info.out_color_space = JCS_EXT_RGBA;
+		jpeg_start_decompress(&info);
+
+		width = int(info.output_width);
+		height = int(info.output_height);
+		auto stride = size_t(width) * 4;
+		pixels = (uint8_t*)malloc(stride * size_t(height));
+		if (pixels == nullptr)
+			longjmp(error.jump, 1);
+
+		while (info.output_scanline < info.output_height)
+		{
+			auto y = info.output_scanline;
+			JSAMPROW row = pixels + stride * (flipVertically ? info.output_height - 1 - y : y);
+			jpeg_read_scanlines(&info, &row, 1);
+		}
+
+		jpeg_finish_decompress(&info);
+		jpeg_destroy_decompress(&info);
+		return pixels;
+	}
+#endif
+
+#ifdef SHADER_ALCHEMY_HAS_LIBPNG
+	uint8_t* DecodePng(const std::vector<uint8_t>& data, bool flipVertically, int& width, int& height)
+	{
+		png_image image = {};
+		image.version = PNG_IMAGE_VERSION;
+		if (!png_image_begin_read_from_memory(&image, data.data(), data.size()))
+			return nullptr;
+
+		// palettes, gray, 16 bit and missing alpha are all expanded by libpng on the way
+		image.format = PNG_FORMAT_RGBA;
+		width = int(image.width);
+		height = int(image.height);
+
+		auto stride = png_int_32(PNG_IMAGE_ROW_STRIDE(image));
+		auto pixels = (uint8_t*)malloc(PNG_IMAGE_SIZE(image));
+		if (pixels == nullptr)
+		{
+			png_image_free(&image);
+			return nullptr;
+		}
+
+		// a negative stride has libpng write the rows bottom up
+		if (!png_image_finish_read(&image, nullptr, pixels, flipVertically ? -stride : stride, nullptr))
+		{
+			free(pixels);
+			return nullptr;
+		}
+		return pixels;
+	}
+#endif
+}
+
+bool IsImageDecoderAvailable(ImageDecoder decoder)
+{
+	switch (decoder)
+	{
+#ifdef HAS_LIBJPEG_TURBO
+	case ImageDecoder::LibJpegTurbo: return true;
+#endif
+#ifdef SHADER_ALCHEMY_HAS_LIBPNG
+	case ImageDecoder::LibPng: return true;
+#endif
+	case ImageDecoder::Auto:
+	case ImageDecoder::StbImage: return true;
+	default: return false;
+	}
+}
+
+const char* GetImageDecoderName(ImageDecoder decoder)
+{
+	switch (decoder)
+	{
+	case ImageDecoder::StbImage: return "stb_image";
+	case ImageDecoder::LibJpegTurbo: return "libjpeg-turbo";
+	case ImageDecoder::LibPng: return "libpng";
+	default: return "auto";
+	}
+}
+
+ImageDecoder GetSystemImageDecoder(const std::filesystem::path& path)
+{
+	auto extension = get_lowercase_extension(path);
+	if ((extension == ".jpg" || extension == ".jpeg") && IsImageDecoderAvailable(ImageDecoder::LibJpegTurbo))
+		return ImageDecoder::LibJpegTurbo;
+	if (extension == ".png" && IsImageDecoderAvailable(ImageDecoder::LibPng))
+		return ImageDecoder::LibPng;
+	return ImageDecoder::StbImage;
+}
+
+ImageDecoder SelectImageDecoder(const std::filesystem::path& path)
+{
+	// libpng measured slower than stb_image in ImageLoadBenchmark, both spend their time in inflate
+	// and the simplified API adds a conversion pass, so PNGs stay with stb_image
+	auto decoder = GetSystemImageDecoder(path);
+	return decoder == ImageDecoder::LibPng ? ImageDecoder::StbImage : decoder;
+}
+
+uint8_t* DecodeImage(const std::filesystem::path& path, bool flipVertically, int& width, int& height, ImageDecoder decoder)
+{
+	bool fallback = decoder == ImageDecoder::Auto;
+	if (decoder == ImageDecoder::Auto)
+		decoder = SelectImageDecoder(path);
+
+	uint8_t* pixels = nullptr;
+	if (decoder != ImageDecoder::StbImage && IsImageDecoderAvailable(decoder))
+	{
+		std::vector<uint8_t> data;
+		if (ReadFile(path, data))
+		{
+#ifdef HAS_LIBJPEG_TURBO
+			if (decoder == ImageDecoder::LibJpegTurbo)
+				pixels = DecodeJpeg(data, flipVertically, width, height);
+#endif
+#ifdef SHADER_ALCHEMY_HAS_LIBPNG
+			if (decoder == ImageDecoder::LibPng)
+				pixels = DecodePng(data, flipVertically, width, height);
+#endif
+		}
+
+		// CMYK JPEGs, or a PNG libpng refuses, may still get through stb_image
+		if (pixels || !fallback)
+			return pixels;
+	}
+	else if (decoder != ImageDecoder::StbImage)
+	{
+		return nullptr;
+	}
+
+	return DecodeStbImage(path, flipVertically, width, height);
+}
+
+void FreeDecodedImage(uint8_t* pixels)
+{
+	// every decoder allocates with malloc like stb_image does
+	stbi_image_free(pixels);
+}
+
+struct ImageRowReader::Decoder
+{
+	FILE* file{ nullptr };
+	uint8_t* pixels{ nullptr };		// all of the image when stb_image decoded it
+
+#ifdef HAS_LIBJPEG_TURBO
+	jpeg_decompress_struct jpeg{};
+	JpegError jpegError{};
+
+	// setjmp only in frames without destructors, see DecodeJpeg
+	bool OpenJpeg(int& width, int& height)
+	{
+		jpeg.err = jpeg_std_error(&jpegError.manager);
+		jpegError.manager.error_exit = [](j_common_ptr common) { longjmp(((JpegError*)common->err)->jump, 1); };
+		jpegError.manager.output_message = [](j_common_ptr) {};
+
+		if (setjmp(jpegError.jump))
+			return false;
+
+		jpeg_create_decompress(&jpeg);
+		jpeg_stdio_src(&jpeg, file);
+		jpeg_read_header(&jpeg, TRUE);
+		jpeg.out_color_space = JCS_EXT_RGBA;
+		jpeg_start_decompress(&jpeg);
+
+		width = int(jpeg.output_width);
+		height = int(jpeg.output_height);
+		return true;
+	}
+
+	bool ReadJpegRow(uint8_t* row)
+	{
+		if (setjmp(jpegError.jump))
+			return false;
+
+		JSAMPROW rows = row;
+		return jpeg_read_scanlines(&jpeg, &rows, 1) == 1;
+	}
+#endif
+
+#ifdef SHADER_ALCHEMY_HAS_LIBPNG
+	png_structp png{ nullptr };
+	png_infop pngInfo{ nullptr };
+
+	bool OpenPng(int& width, int& height)
+	{
+		png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr,
+			[](png_structp png, png_const_charp) { png_longjmp(png, 1); }, [](png_structp, png_const_charp) {});
+		pngInfo = png ? png_create_info_struct(png) : nullptr;
+		if (pngInfo == nullptr)
+			return false;
+
+		if (setjmp(png_jmpbuf(png)))
+			return false;
+
+		png_init_io(png, file);
+		png_read_info(png, pngInfo);
+
+		// the rows of an interlaced image are only complete after its last pass
+		if (png_get_interlace_type(png, pngInfo) != PNG_INTERLACE_NONE)
+			return false;
+
+		// palettes, gray, 16 bit and missing alpha are all expanded on the way
+		png_set_expand(png);
+		png_set_strip_16(png);
+		png_set_gray_to_rgb(png);
+		png_set_filler(png, 0xff, PNG_FILLER_AFTER);
+		png_read_update_info(png, pngInfo);
+
+		width = int(png_get_image_width(png, pngInfo));
+		height = int(png_get_image_height(png, pngInfo));
+		return png_get_rowbytes(png, pngInfo) == size_t(width) * 4;
+	}
+
+	bool ReadPngRow(uint8_t* row)
+	{
+		if (setjmp(png_jmpbuf(png)))
+			return false;
+
+		png_read_row(png, row, nullptr);
+		return true;
+	}
+#endif
+
+	~Decoder()
+	{
+#ifdef HAS_LIBJPEG_TURBO
+		if (jpeg.err)
+			jpeg_destroy_decompress(&jpeg);
+#endif
+#ifdef SHADER_ALCHEMY_HAS_LIBPNG
+		if (png)
+			png_destroy_read_struct(&png, pngInfo ? &pngInfo : nullptr, nullptr);
+#endif
+		if (file)
+			fclose(file);
+		FreeDecodedImage(pixels);
+	}
+};
+
+ImageRowReader::ImageRowReader() = default;
+
+ImageRowReader::~ImageRowReader() = default;
+
+bool ImageRowReader::Open(const std::filesystem::path& path)
+{
+	auto system = GetSystemImageDecoder(path);
+	if (system != ImageDecoder::StbImage)
+	{
+		decoder = std::make_unique<Decoder>();
+		decoder->file = fopen(path.string().c_str(), "rb");
+
+		bool opened = false;
+#ifdef HAS_LIBJPEG_TURBO
+		if (decoder->file && system == ImageDecoder::LibJpegTurbo)
+			opened = decoder->OpenJpeg(width, height);
+#endif
+#ifdef SHADER_ALCHEMY_HAS_LIBPNG
+		if (decoder->file && system == ImageDecoder::LibPng)
+			opened = decoder->OpenPng(width, height);
+#endif
+		if (opened && width > 0 && height > 0)
+		{
+			nextRow = 0;
+			return true;
+		}
+	}
+
+	decoder = std::make_unique<Decoder>();
+	decoder->pixels = DecodeStbImage(path, false, width, height);
+	nextRow = 0;
+	return decoder->pixels != nullptr;
+}
+
+bool ImageRowReader::ReadRow(uint8_t* row)
+{
+	if (decoder == nullptr || nextRow >= height)
+		return false;
+
+	auto y = nextRow++;
+	if (decoder->pixels)
+	{
+		auto stride = size_t(width) * 4;
+		memcpy(row, decoder->pixels + stride * size_t(y), stride);
+		return true;
+	}
+
+#ifdef HAS_LIBJPEG_TURBO
+	if (decoder->jpeg.err)
+		return decoder->ReadJpegRow(row);
+#endif
+#ifdef SHADER_ALCHEMY_HAS_LIBPNG
+	if (decoder->png)
+		return decoder->ReadPngRow(row);
+#endif
+	return false;
+}
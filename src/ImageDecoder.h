@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+// Which library turns an 8 bit image file into RGBA8. libjpeg-turbo and libpng are only built in
+// when CMake found them on the system, stb_image decodes every other format and is the fallback.
+enum class ImageDecoder : int
+{
+	Auto,			// the fastest one built in for the file's extension
+	StbImage,
+	LibJpegTurbo,	// .jpg and .jpeg
+	LibPng,			// .png, only when asked for by name, see SelectImageDecoder
+};
+
+bool IsImageDecoderAvailable(ImageDecoder decoder);
+const char* GetImageDecoderName(ImageDecoder decoder);
+
+// The system library built in for the file's extension, StbImage when there is none
+ImageDecoder GetSystemImageDecoder(const std::filesystem::path& path);
+
+// What Auto picks for the file, by extension only
+ImageDecoder SelectImageDecoder(const std::filesystem::path& path);
+
+// Decodes to RGBA8 rows, the top row first unless `flipVertically`. Thread safe. A faster decoder
+// that fails on a file hands it to stb_image, unless it was asked for by name. nullptr on failure,
+// free the pixels with FreeDecodedImage.
+uint8_t* DecodeImage(const std::filesystem::path& path, bool flipVertically, int& width, int& height,
+	ImageDecoder decoder = ImageDecoder::Auto);
+
+void FreeDecodedImage(uint8_t* pixels);
+
+// Reads an image as RGBA8 rows, top to bottom, for images too large to decode at once. libjpeg-turbo
+// hands out JPEG scanlines and libpng PNG rows as they are decoded, so only a row is in memory.
+// Interlaced PNGs, CMYK JPEGs, other formats and builds without those libraries are decoded whole by
+// stb_image first, which refuses images of more than 2 GB of pixels, about 23170 x 23170.
+class ImageRowReader
+{
+public:
+	ImageRowReader();
+	~ImageRowReader();
+
+	ImageRowReader(const ImageRowReader&) = delete;
+	ImageRowReader& operator=(const ImageRowReader&) = delete;
+
+	bool Open(const std::filesystem::path& path);
+
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+
+	// Copies the next row, GetWidth() * 4 bytes. false past the last row or on a damaged file.
+	bool ReadRow(uint8_t* row);
+
+private:
+	struct Decoder;
+	std::unique_ptr<Decoder> decoder;
+	int width{ 0 };
+	int height{ 0 };
+	int nextRow{ 0 };
+};
@@ -0,0 +1,116 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const std::filesystem::path& path)
+{
+	Close();
+
+	file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		file = nullptr;
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+	{
+		Close();
+		return false;
+	}
+
+	mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == nullptr)
+	{
+		Close();
+		return false;
+	}
+
+	size = size_t(file_size.QuadPart);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file)
+		CloseHandle(file);
+
+	data = nullptr;
+	mapping = nullptr;
+	file = nullptr;
+	size = 0;
+}
+
+#else
+
+bool MappedFile::Open(const std::filesystem::path& path)
+{
+	Close();
+
+	fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		Close();
+		return false;
+	}
+
+	void* mapped = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	if (mapped == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+
+	madvise(mapped, size_t(info.st_size), MADV_SEQUENTIAL);
+
+	data = (const uint8_t*)mapped;
+	size = size_t(info.st_size);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data)
+		munmap((void*)data, size);
+	if (fd >= 0)
+		close(fd);
+
+	data = nullptr;
+	size = 0;
+	fd = -1;
+}
+
+#endif
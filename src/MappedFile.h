@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// Read only memory mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool Open(const std::filesystem::path& path);
+	void Close();
+
+	bool IsOpen() const { return data != nullptr; }
+	const uint8_t* GetData() const { return data; }
+	size_t GetSize() const { return size; }
+
+private:
+	const uint8_t* data{ nullptr };
+	size_t size{ 0 };
+
+#ifdef _WIN32
+	void* file{ nullptr };
+	void* mapping{ nullptr };
+#else
+	int fd{ -1 };
+#endif
+};
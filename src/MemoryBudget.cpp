@@ -0,0 +1,78 @@
+#include "MemoryBudget.h"
+
+#include <algorithm>
+
+bool MemoryBudget::Acquire(size_t bytes)
+{
+	std::unique_lock lock(mutex);
+	released.wait(lock, [&] { return cancelled || used == 0 || used + bytes <= limit; });
+
+	if (cancelled)
+		return false;
+
+	used += bytes;
+	UpdatePeak();
+	return true;
+}
+
+void MemoryBudget::Resize(size_t from, size_t to)
+{
+	{
+		std::lock_guard lock(mutex);
+		used = used - std::min(used, from) + to;
+		UpdatePeak();
+	}
+
+	if (to < from)
+		released.notify_all();
+}
+
+void MemoryBudget::Release(size_t bytes)
+{
+	{
+		std::lock_guard lock(mutex);
+		used -= std::min(used, bytes);
+	}
+
+	released.notify_all();
+}
+
+void MemoryBudget::Track(size_t bytes)
+{
+	std::lock_guard lock(mutex);
+	tracked += bytes;
+	UpdatePeak();
+}
+
+void MemoryBudget::Untrack(size_t bytes)
+{
+	std::lock_guard lock(mutex);
+	tracked -= std::min(tracked, bytes);
+}
+
+void MemoryBudget::Cancel()
+{
+	{
+		std::lock_guard lock(mutex);
+		cancelled = true;
+	}
+
+	released.notify_all();
+}
+
+size_t MemoryBudget::GetUsed() const
+{
+	std::lock_guard lock(mutex);
+	return used;
+}
+
+size_t MemoryBudget::GetPeak() const
+{
+	std::lock_guard lock(mutex);
+	return peak;
+}
+
+void MemoryBudget::UpdatePeak()
+{
+	peak = std::max(peak, used + tracked);
+}
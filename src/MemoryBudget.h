@@ -0,0 +1,43 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+// Byte budget shared between threads producing large CPU side buffers and the one consuming them.
+// Producers block in Acquire while the budget is used up, so at most about `limit` bytes are
+// in flight at once. A single request larger than the whole budget still goes through when
+// nothing else is held, so progress is always possible.
+class MemoryBudget
+{
+public:
+	explicit MemoryBudget(size_t limit) : limit(limit) {}
+
+	// Blocks until `bytes` fit, returns false when cancelled while waiting.
+	bool Acquire(size_t bytes);
+
+	// Changes an acquired amount once its real size is known, never waits.
+	void Resize(size_t from, size_t to);
+	void Release(size_t bytes);
+
+	// Memory the budget cannot hold back, like an already parsed file. Only counted in the peak.
+	void Track(size_t bytes);
+	void Untrack(size_t bytes);
+
+	// Wakes every waiting Acquire, they and all later ones fail.
+	void Cancel();
+
+	size_t GetUsed() const;
+	size_t GetPeak() const;		// of acquired and tracked memory together
+	size_t GetLimit() const { return limit; }
+
+private:
+	void UpdatePeak();
+
+	mutable std::mutex mutex;
+	std::condition_variable released;
+	size_t limit;
+	size_t used{ 0 };
+	size_t tracked{ 0 };
+	size_t peak{ 0 };
+	bool cancelled{ false };
+};
@@ -0,0 +1,70 @@
+#include "MeshArena.h"
+#include "JinGL/JinGL.h"
+
+#include <algorithm>
+
+MeshArena::MeshArena(size_t vertexStride)
+	: vertexStride(vertexStride)
+{
+}
+
+MeshArena::~MeshArena()
+{
+	if (vertexBuffer)
+		glDeleteBuffers(1, &vertexBuffer);
+	if (indexBuffer)
+		glDeleteBuffers(1, &indexBuffer);
+}
+
+void MeshArena::Grow(unsigned int& buffer, size_t& capacity, size_t used, size_t required)
+{
+	if (required <= capacity)
+		return;
+
+	// doubling keeps the number of copies logarithmic when meshes trickle in one by one
+	auto new_capacity = std::max(required, capacity * 2);
+
+	GLuint new_buffer;
+	glCreateBuffers(1, &new_buffer);
+	glNamedBufferStorage(new_buffer, GLsizeiptr(new_capacity), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+	if (buffer)
+	{
+		if (used)
+			glCopyNamedBufferSubData(buffer, new_buffer, 0, 0, GLsizeiptr(used));
+		glDeleteBuffers(1, &buffer);
+	}
+
+	buffer = new_buffer;
+	capacity = new_capacity;
+}
+
+void MeshArena::Reserve(size_t vertices, size_t indices)
+{
+	Grow(vertexBuffer, vertexCapacity, vertexCount * vertexStride, (vertexCount + vertices) * vertexStride);
+	Grow(indexBuffer, indexCapacity, indexCount * sizeof(unsigned int), (indexCount + indices) * sizeof(unsigned int));
+}
+
+void MeshArena::Append(const void* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount,
+	uint32_t& baseVertex, uint32_t& firstIndex)
+{
+	Reserve(vertexCount, indexCount);
+
+	baseVertex = uint32_t(this->vertexCount);
+	firstIndex = uint32_t(this->indexCount);
+
+	if (vertexCount)
+	{
+		glNamedBufferSubData(vertexBuffer, GLintptr(this->vertexCount * vertexStride),
+			GLsizeiptr(vertexCount * vertexStride), vertices);
+	}
+
+	if (indexCount)
+	{
+		glNamedBufferSubData(indexBuffer, GLintptr(this->indexCount * sizeof(unsigned int)),
+			GLsizeiptr(indexCount * sizeof(unsigned int)), indices);
+	}
+
+	this->vertexCount += vertexCount;
+	this->indexCount += indexCount;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// One vertex and one index buffer shared by all meshes of a model, so a whole model
+// can be drawn with a single multi-draw. Meshes are appended and addressed by base vertex
+// and first index, the buffers grow by copying on the GPU when they run out of space.
+class MeshArena
+{
+public:
+	explicit MeshArena(size_t vertexStride);
+	~MeshArena();
+
+	MeshArena(const MeshArena&) = delete;
+	MeshArena& operator=(const MeshArena&) = delete;
+
+	// Makes room for this many more vertices and indices without growing again.
+	void Reserve(size_t vertexCount, size_t indexCount);
+
+	void Append(const void* vertices, size_t vertexCount, const unsigned int* indices, size_t indexCount,
+		uint32_t& baseVertex, uint32_t& firstIndex);
+
+	unsigned int GetVertexBuffer() const { return vertexBuffer; }
+	unsigned int GetIndexBuffer() const { return indexBuffer; }
+	size_t GetVertexStride() const { return vertexStride; }
+	size_t GetVertexCount() const { return vertexCount; }
+	size_t GetIndexCount() const { return indexCount; }
+	size_t GetSizeInBytes() const { return vertexCapacity + indexCapacity; }
+
+private:
+	static void Grow(unsigned int& buffer, size_t& capacity, size_t used, size_t required);
+
+	size_t vertexStride;
+
+	unsigned int vertexBuffer{ 0 };
+	unsigned int indexBuffer{ 0 };
+	size_t vertexCapacity{ 0 };		// in bytes
+	size_t indexCapacity{ 0 };
+	size_t vertexCount{ 0 };
+	size_t indexCount{ 0 };
+};
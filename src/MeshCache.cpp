@@ -0,0 +1,385 @@
+#include "MeshCache.h"
+#include "Utils.h"
+
+#include <meshoptimizer.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <type_traits>
+
+namespace
+{
+	constexpr char MAGIC[4] = { 'S', 'A', 'M', 'C' };
+	constexpr uint32_t VERSION = 5;
+	constexpr uint64_t ALIGNMENT = 16;
+
+	// bytes from each end of the source mixed into the key, catches edits that keep size and timestamp
+	constexpr size_t SAMPLE_SIZE = 64 * 1024;
+
+	struct Header
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t key;
+		uint64_t meshCount;
+		uint32_t vertexStride;
+		uint32_t packedVertices;
+		AABB bounds;
+	};
+
+	struct Entry
+	{
+		uint64_t vertexOffset;
+		uint64_t vertexBytes;		// encoded size
+		uint64_t vertexCount;
+		uint64_t indexOffset;
+		uint64_t indexBytes;		// encoded size
+		uint64_t indexCount;
+		uint32_t lodCount;
+		MeshLod lods[MAX_MESH_LODS];
+		AABB bounds;
+		uint64_t transformOffset;
+		uint64_t transformCount;
+		uint64_t meshletOffset;		// raw, already in the GPU layout
+		uint64_t meshletCount;
+		uint64_t textureOffsets[6];
+		uint64_t textureLengths[6];
+	};
+
+	static_assert(std::is_trivially_copyable_v<MeshVertex>);
+	static_assert(std::is_trivially_copyable_v<PackedVertex>);
+	static_assert(std::is_trivially_copyable_v<Entry>);
+	static_assert(std::is_trivially_copyable_v<Meshlet>);
+	static_assert(sizeof(MeshVertex) % 4 == 0 && sizeof(PackedVertex) % 4 == 0, "meshopt vertex codec needs a multiple of 4");
+
+	uint64_t Align(uint64_t offset)
+	{
+		return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	}
+
+	const Header* GetHeader(const MappedFile& file)
+	{
+		return (const Header*)file.GetData();
+	}
+
+	const Entry* GetEntries(const MappedFile& file)
+	{
+		return (const Entry*)(file.GetData() + Align(sizeof(Header)));
+	}
+}
+
+uint64_t MeshCache::MakeKey(const std::filesystem::path& source, unsigned int importFlags, const ImportSettings& settings)
+{
+	std::error_code error;
+	auto path = std::filesystem::weakly_canonical(source, error).generic_string();
+	auto size = std::filesystem::file_size(source, error);
+	auto time = std::filesystem::last_write_time(source, error).time_since_epoch().count();
+
+	uint64_t key = FNV_OFFSET_BASIS;
+	key = Hash(key, path.data(), path.size());
+	key = Hash(key, size);
+	key = Hash(key, time);
+	key = Hash(key, importFlags);
+	key = Hash(key, settings.scale);
+	key = Hash(key, settings.packVertices);
+	key = Hash(key, settings.generateLods);
+	key = Hash(key, settings.buildMeshlets);
+	key = Hash(key, VERSION);
+
+	// hashing all of a multi gigabyte file would cost more than the import we are trying to skip
+	std::ifstream stream(source, std::ios::binary);
+	if (stream)
+	{
+		std::vector<char> sample(SAMPLE_SIZE);
+
+		stream.read(sample.data(), sample.size());
+		key = Hash(key, sample.data(), size_t(stream.gcount()));
+
+		if (size > SAMPLE_SIZE)
+		{
+			stream.clear();
+			stream.seekg(std::max<int64_t>(int64_t(size) - int64_t(SAMPLE_SIZE), int64_t(SAMPLE_SIZE)));
+			stream.read(sample.data(), sample.size());
+			key = Hash(key, sample.data(), size_t(stream.gcount()));
+		}
+	}
+
+	return key;
+}
+
+std::filesystem::path MeshCache::GetPath(uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.mesh", (unsigned long long)key);
+	return directory / name;
+}
+
+bool MeshCache::Write(uint64_t key, const ModelData& data)
+{
+	Writer writer;
+	if (!writer.Begin(key, data.meshes.size(), data.packedVertices))
+		return false;
+
+	for (size_t i = 0; i < data.meshes.size(); i++)
+	{
+		if (!writer.AddMesh(i, data.meshes[i].View()))
+			return false;
+	}
+
+	return writer.Finish(data.bounds);
+}
+
+MeshCache::Writer::~Writer()
+{
+	// never finished, nothing is left behind
+	if (stream.is_open())
+	{
+		stream.close();
+		std::error_code error;
+		std::filesystem::remove(tempPath, error);
+	}
+}
+
+bool MeshCache::Writer::Begin(uint64_t key, size_t meshCount, bool packedVertices)
+{
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+
+	this->key = key;
+	this->meshCount = meshCount;
+	this->packedVertices = packedVertices;
+	writtenMeshes = 0;
+
+	// see write_file_atomically, nothing shows up under the key until Finish
+	path = GetPath(key);
+	tempPath = get_temporary_path(path);
+
+	stream.open(tempPath, std::ios::binary | std::ios::trunc);
+	if (!stream)
+		return false;
+
+	// the header and the entry table are filled in as the meshes arrive
+	Header header = {};
+	std::vector<Entry> entries(meshCount);
+
+	stream.write((const char*)&header, sizeof(header));
+	Pad();
+	entriesOffset = uint64_t(stream.tellp());
+	stream.write((const char*)entries.data(), sizeof(Entry) * entries.size());
+	Pad();
+
+	return bool(stream);
+}
+
+void MeshCache::Writer::Pad()
+{
+	const char padding[ALIGNMENT] = {};
+	auto position = uint64_t(stream.tellp());
+	stream.write(padding, Align(position) - position);
+}
+
+bool MeshCache::Writer::AddMesh(size_t index, const MeshView& mesh)
+{
+	if (!stream.is_open() || index >= meshCount)
+		return false;
+
+	Entry entry = {};
+
+	encoded.resize(meshopt_encodeVertexBufferBound(mesh.vertexCount, mesh.vertexStride));
+	auto vertex_bytes = meshopt_encodeVertexBuffer(encoded.data(), encoded.size(), mesh.vertices, mesh.vertexCount, mesh.vertexStride);
+
+	entry.vertexOffset = uint64_t(stream.tellp());
+	entry.vertexBytes = vertex_bytes;
+	entry.vertexCount = mesh.vertexCount;
+	stream.write((const char*)encoded.data(), vertex_bytes);
+	Pad();
+
+	encoded.resize(meshopt_encodeIndexBufferBound(mesh.indexCount, mesh.vertexCount));
+	auto index_bytes = meshopt_encodeIndexBuffer(encoded.data(), encoded.size(), mesh.indices, mesh.indexCount);
+
+	entry.indexOffset = uint64_t(stream.tellp());
+	entry.indexBytes = index_bytes;
+	entry.indexCount = mesh.indexCount;
+	stream.write((const char*)encoded.data(), index_bytes);
+	Pad();
+
+	entry.lodCount = uint32_t(mesh.lodCount);
+	std::copy_n(mesh.lods, mesh.lodCount, entry.lods);
+	entry.transformOffset = uint64_t(stream.tellp());
+	entry.transformCount = mesh.transformCount;
+	stream.write((const char*)mesh.transforms, sizeof(glm::mat4) * mesh.transformCount);
+	Pad();
+
+	entry.meshletOffset = uint64_t(stream.tellp());
+	entry.meshletCount = mesh.meshletCount;
+	stream.write((const char*)mesh.meshlets, sizeof(Meshlet) * mesh.meshletCount);
+	Pad();
+
+	entry.bounds = mesh.bounds;
+
+	for (int i = 0; i < 6; i++)
+	{
+		entry.textureOffsets[i] = uint64_t(stream.tellp());
+		entry.textureLengths[i] = mesh.texturePaths[i].size();
+		stream.write(mesh.texturePaths[i].data(), mesh.texturePaths[i].size());
+	}
+	Pad();
+
+	auto end = stream.tellp();
+	stream.seekp(std::streamoff(entriesOffset + sizeof(Entry) * index));
+	stream.write((const char*)&entry, sizeof(entry));
+	stream.seekp(end);
+
+	writtenMeshes++;
+	return bool(stream);
+}
+
+bool MeshCache::Writer::Finish(const AABB& bounds)
+{
+	if (!stream.is_open() || writtenMeshes != meshCount)
+		return false;
+
+	Header header = {};
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.key = key;
+	header.meshCount = meshCount;
+	header.vertexStride = packedVertices ? sizeof(PackedVertex) : sizeof(MeshVertex);
+	header.packedVertices = packedVertices;
+	header.bounds = bounds;
+
+	stream.seekp(0);
+	stream.write((const char*)&header, sizeof(header));
+
+	bool written = bool(stream);
+	stream.close();
+	return replace_with_temporary_file(path, written);
+}
+
+bool MeshCache::Open(uint64_t key)
+{
+	if (!file.Open(GetPath(key)))
+		return false;
+
+	auto size = file.GetSize();
+	auto header = GetHeader(file);
+
+	if (size < sizeof(Header) ||
+		memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+		header->version != VERSION ||
+		header->key != key ||
+		header->meshCount == 0 ||
+		header->vertexStride != (header->packedVertices ? sizeof(PackedVertex) : sizeof(MeshVertex)) ||
+		Align(sizeof(Header)) + sizeof(Entry) * header->meshCount > size)
+	{
+		file.Close();
+		return false;
+	}
+
+	// ranges are checked once here, the codecs check the contents while decoding
+	auto entries = GetEntries(file);
+	for (uint64_t i = 0; i < header->meshCount; i++)
+	{
+		const auto& entry = entries[i];
+
+		bool valid =
+			entry.vertexOffset + entry.vertexBytes <= size &&
+			entry.indexOffset + entry.indexBytes <= size &&
+			entry.transformOffset % ALIGNMENT == 0 && entry.transformCount > 0 &&
+			entry.transformOffset + sizeof(glm::mat4) * entry.transformCount <= size &&
+			entry.meshletOffset % ALIGNMENT == 0 &&
+			entry.meshletOffset + sizeof(Meshlet) * entry.meshletCount <= size &&
+			entry.lodCount > 0 && entry.lodCount <= MAX_MESH_LODS;
+
+		for (uint32_t j = 0; valid && j < entry.lodCount; j++)
+			valid &= uint64_t(entry.lods[j].indexOffset) + entry.lods[j].indexCount <= entry.indexCount;
+
+		auto meshlets = (const Meshlet*)(file.GetData() + entry.meshletOffset);
+		for (uint64_t j = 0; valid && j < entry.meshletCount; j++)
+			valid &= uint64_t(meshlets[j].indexOffset) + meshlets[j].indexCount <= entry.lods[0].indexCount;
+
+		for (int j = 0; j < 6; j++)
+			valid &= entry.textureOffsets[j] + entry.textureLengths[j] <= size;
+
+		if (!valid)
+		{
+			file.Close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void MeshCache::Close()
+{
+	file.Close();
+	vertexScratch = {};
+	indexScratch = {};
+}
+
+size_t MeshCache::GetMeshCount() const
+{
+	return file.IsOpen() ? size_t(GetHeader(file)->meshCount) : 0;
+}
+
+AABB MeshCache::GetBounds() const
+{
+	return GetHeader(file)->bounds;
+}
+
+bool MeshCache::HasPackedVertices() const
+{
+	return GetHeader(file)->packedVertices != 0;
+}
+
+void MeshCache::GetTotalCounts(size_t& vertexCount, size_t& indexCount) const
+{
+	vertexCount = indexCount = 0;
+
+	auto entries = GetEntries(file);
+	for (size_t i = 0; i < GetMeshCount(); i++)
+	{
+		vertexCount += size_t(entries[i].vertexCount);
+		indexCount += size_t(entries[i].indexCount);
+	}
+}
+
+bool MeshCache::GetMesh(size_t index, MeshView& view)
+{
+	const auto& entry = GetEntries(file)[index];
+	auto data = file.GetData();
+	auto stride = size_t(GetHeader(file)->vertexStride);
+
+	vertexScratch.resize(size_t(entry.vertexCount) * stride);
+	indexScratch.resize(size_t(entry.indexCount));
+
+	if (meshopt_decodeVertexBuffer(vertexScratch.data(), size_t(entry.vertexCount), stride,
+			data + entry.vertexOffset, size_t(entry.vertexBytes)) != 0 ||
+		meshopt_decodeIndexBuffer(indexScratch.data(), size_t(entry.indexCount), sizeof(unsigned int),
+			data + entry.indexOffset, size_t(entry.indexBytes)) != 0)
+	{
+		return false;
+	}
+
+	view = {
+		.vertices = vertexScratch.data(),
+		.vertexCount = size_t(entry.vertexCount),
+		.vertexStride = stride,
+		.indices = indexScratch.data(),
+		.indexCount = size_t(entry.indexCount),
+		.lods = entry.lods,
+		.lodCount = entry.lodCount,
+		.meshlets = (const Meshlet*)(data + entry.meshletOffset),
+		.meshletCount = size_t(entry.meshletCount),
+		.bounds = entry.bounds,
+		.transforms = (const glm::mat4*)(data + entry.transformOffset),
+		.transformCount = size_t(entry.transformCount),
+	};
+
+	for (int i = 0; i < 6; i++)
+		view.texturePaths[i] = std::string_view((const char*)data + entry.textureOffsets[i], size_t(entry.textureLengths[i]));
+
+	return true;
+}
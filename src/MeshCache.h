@@ -0,0 +1,74 @@
+#pragma once
+#include "Model.h"
+#include "MappedFile.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+// On-disk copy of a fully processed model, so repeated loads skip Assimp and meshoptimizer.
+// The file is memory mapped, vertex and index data are stored with the meshoptimizer codecs
+// and decoded mesh by mesh into scratch memory right before the upload.
+class MeshCache
+{
+public:
+	static inline std::filesystem::path directory = "Cache\\Meshes\\";
+
+	// Identifies a source file together with the settings it was imported with. Changing the file,
+	// the flags or the scale produces a different key, so stale entries are simply never hit again.
+	static uint64_t MakeKey(const std::filesystem::path& source, unsigned int importFlags, const ImportSettings& settings);
+
+	static bool Write(uint64_t key, const ModelData& data);
+
+	// Writes an entry one mesh at a time, so the meshes never have to be in memory together.
+	// Nothing shows up under the key until Finish succeeds, an unfinished writer cleans up after itself.
+	class Writer
+	{
+	public:
+		Writer() = default;
+		~Writer();
+
+		Writer(const Writer&) = delete;
+		Writer& operator=(const Writer&) = delete;
+
+		bool Begin(uint64_t key, size_t meshCount, bool packedVertices);
+
+		// Meshes may come in any order, but every index exactly once.
+		bool AddMesh(size_t index, const MeshView& mesh);
+
+		bool Finish(const AABB& bounds);
+
+	private:
+		void Pad();
+
+		std::ofstream stream;
+		std::filesystem::path path;
+		std::filesystem::path tempPath;
+		uint64_t key{ 0 };
+		size_t meshCount{ 0 };
+		size_t writtenMeshes{ 0 };
+		bool packedVertices{ false };
+		uint64_t entriesOffset{ 0 };
+		std::vector<uint8_t> encoded;
+	};
+
+	// Maps the cache entry for `key`, fails when it is missing, from an older format or truncated.
+	bool Open(uint64_t key);
+	void Close();
+
+	size_t GetMeshCount() const;
+	AABB GetBounds() const;
+	bool HasPackedVertices() const;
+	void GetTotalCounts(size_t& vertexCount, size_t& indexCount) const;
+
+	// Decodes one mesh, the view points into scratch memory and stays valid until the next call.
+	bool GetMesh(size_t index, MeshView& view);
+
+private:
+	static std::filesystem::path GetPath(uint64_t key);
+
+	MappedFile file;
+	std::vector<uint8_t> vertexScratch;
+	std::vector<unsigned int> indexScratch;
+};
@@ -0,0 +1,216 @@
+#include "MeshCulling.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace
+{
+	constexpr uint32_t LEAF_SIZE = 16;
+
+	enum class Containment
+	{
+		Outside,
+		Intersecting,
+		Inside,
+	};
+
+	// Gribb/Hartmann, planes point inwards. Not normalized, only the sign of the distance is used.
+	void ExtractPlanes(const glm::mat4& m, glm::vec4 planes[6])
+	{
+		glm::vec4 row0 = { m[0][0], m[1][0], m[2][0], m[3][0] };
+		glm::vec4 row1 = { m[0][1], m[1][1], m[2][1], m[3][1] };
+		glm::vec4 row2 = { m[0][2], m[1][2], m[2][2], m[3][2] };
+		glm::vec4 row3 = { m[0][3], m[1][3], m[2][3], m[3][3] };
+
+		planes[0] = row3 + row0;
+		planes[1] = row3 - row0;
+		planes[2] = row3 + row1;
+		planes[3] = row3 - row1;
+		planes[4] = row3 + row2;
+		planes[5] = row3 - row2;
+	}
+
+	Containment Classify(const AABB& bounds, const glm::vec4* planes)
+	{
+		auto result = Containment::Inside;
+
+		for (int i = 0; i < 6; i++)
+		{
+			const auto& plane = planes[i];
+			glm::vec3 normal(plane);
+
+			// the corners furthest along and against the plane normal
+			glm::vec3 positive = glm::mix(bounds.min, bounds.max, glm::greaterThanEqual(normal, glm::vec3(0.0f)));
+			glm::vec3 negative = glm::mix(bounds.max, bounds.min, glm::greaterThanEqual(normal, glm::vec3(0.0f)));
+
+			if (glm::dot(normal, positive) + plane.w < 0.0f)
+				return Containment::Outside;
+
+			if (glm::dot(normal, negative) + plane.w < 0.0f)
+				result = Containment::Intersecting;
+		}
+
+		return result;
+	}
+}
+
+void MeshCulling::Build(const Model& model, bool useBvh)
+{
+	Clear();
+
+	auto count = uint32_t(model.instances.size());
+
+	std::vector<AABB> bounds(count);
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const auto& instance = model.instances[i];
+		bounds[i] = TransformBounds(model.meshes[instance.mesh].bounds, instance.transform);
+	}
+
+	order.resize(count);
+	std::iota(order.begin(), order.end(), 0u);
+
+	if (useBvh && count > LEAF_SIZE)
+	{
+		nodes.reserve(2 * (count / LEAF_SIZE + 1));
+		BuildNode(0, count, bounds);
+	}
+
+	minX.resize(count); minY.resize(count); minZ.resize(count);
+	maxX.resize(count); maxY.resize(count); maxZ.resize(count);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const auto& b = bounds[order[i]];
+		minX[i] = b.min.x; minY[i] = b.min.y; minZ[i] = b.min.z;
+		maxX[i] = b.max.x; maxY[i] = b.max.y; maxZ[i] = b.max.z;
+	}
+}
+
+void MeshCulling::Clear()
+{
+	minX.clear(); minY.clear(); minZ.clear();
+	maxX.clear(); maxY.clear(); maxZ.clear();
+	order.clear();
+	sortedVisible.clear();
+	nodes.clear();
+}
+
+uint32_t MeshCulling::BuildNode(uint32_t first, uint32_t count, const std::vector<AABB>& bounds)
+{
+	auto index = uint32_t(nodes.size());
+	nodes.push_back({});
+
+	AABB node_bounds = bounds[order[first]];
+	for (uint32_t i = first + 1; i < first + count; i++)
+	{
+		node_bounds.min = glm::min(node_bounds.min, bounds[order[i]].min);
+		node_bounds.max = glm::max(node_bounds.max, bounds[order[i]].max);
+	}
+
+	uint32_t right = 0;
+	if (count > LEAF_SIZE)
+	{
+		// median split along the longest axis keeps the tree balanced without any cost heuristics
+		auto extent = node_bounds.max - node_bounds.min;
+		int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+		auto begin = order.begin() + first;
+		std::nth_element(begin, begin + count / 2, begin + count, [&](uint32_t a, uint32_t b) {
+			return bounds[a].min[axis] + bounds[a].max[axis] < bounds[b].min[axis] + bounds[b].max[axis];
+		});
+
+		BuildNode(first, count / 2, bounds);
+		right = BuildNode(first + count / 2, count - count / 2, bounds);
+	}
+
+	nodes[index] = { node_bounds, first, count, right };
+	return index;
+}
+
+size_t MeshCulling::Cull(const glm::mat4& modelViewProjection, std::vector<uint8_t>& visible)
+{
+	glm::vec4 planes[6];
+	ExtractPlanes(modelViewProjection, planes);
+
+	auto count = uint32_t(order.size());
+	sortedVisible.assign(count, 0);
+
+	if (nodes.empty())
+		CullRange(0, count, planes);
+	else
+		CullNode(0, planes);
+
+	visible.resize(count);
+
+	size_t visible_count = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		visible[order[i]] = sortedVisible[i];
+		visible_count += sortedVisible[i];
+	}
+
+	return visible_count;
+}
+
+void MeshCulling::CullNode(uint32_t index, const glm::vec4* planes)
+{
+	const auto& node = nodes[index];
+
+	switch (Classify(node.bounds, planes))
+	{
+	case Containment::Outside:
+		return;
+
+	case Containment::Inside:
+		MarkRange(node.first, node.count);
+		return;
+
+	case Containment::Intersecting:
+		if (node.right == 0)
+		{
+			CullRange(node.first, node.count, planes);
+		}
+		else
+		{
+			CullNode(index + 1, planes);
+			CullNode(node.right, planes);
+		}
+		return;
+	}
+}
+
+void MeshCulling::CullRange(uint32_t first, uint32_t count, const glm::vec4* planes)
+{
+	auto visible = sortedVisible.data() + first;
+	std::fill_n(visible, count, uint8_t(1));
+
+	// one plane at a time over plain float arrays, the inner loop has no branches and vectorizes
+	for (int p = 0; p < 6; p++)
+	{
+		const float nx = planes[p].x, ny = planes[p].y, nz = planes[p].z, w = planes[p].w;
+
+		const float* min_x = minX.data() + first;
+		const float* min_y = minY.data() + first;
+		const float* min_z = minZ.data() + first;
+		const float* max_x = maxX.data() + first;
+		const float* max_y = maxY.data() + first;
+		const float* max_z = maxZ.data() + first;
+
+		for (uint32_t i = 0; i < count; i++)
+		{
+			// distance of the corner furthest along the plane normal
+			float distance =
+				std::max(nx * min_x[i], nx * max_x[i]) +
+				std::max(ny * min_y[i], ny * max_y[i]) +
+				std::max(nz * min_z[i], nz * max_z[i]) + w;
+
+			visible[i] &= uint8_t(distance >= 0.0f);
+		}
+	}
+}
+
+void MeshCulling::MarkRange(uint32_t first, uint32_t count)
+{
+	std::fill_n(sortedVisible.data() + first, count, uint8_t(1));
+}
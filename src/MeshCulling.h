@@ -0,0 +1,45 @@
+#pragma once
+#include "Model.h"
+
+#include <cstdint>
+#include <vector>
+
+// Frustum culling of the mesh instances of one model. Bounds are kept as separate min/max arrays
+// (structure of arrays) so the plane tests run over many meshes at once. The optional BVH
+// skips whole groups of instances outside the frustum, for scenes with tens of thousands of them.
+class MeshCulling
+{
+public:
+	// Bounds are the mesh bounds moved by each instance transform, in model space.
+	void Build(const Model& model, bool useBvh);
+	void Clear();
+
+	// `modelViewProjection` is the matrix applied on top of the instance transforms.
+	// Fills one byte per instance in `visible` and returns how many are inside the frustum.
+	size_t Cull(const glm::mat4& modelViewProjection, std::vector<uint8_t>& visible);
+
+	bool HasBvh() const { return !nodes.empty(); }
+	size_t GetInstanceCount() const { return order.size(); }
+
+private:
+	struct Node
+	{
+		AABB bounds;
+		uint32_t first;		// range of the bounds arrays below this node
+		uint32_t count;
+		uint32_t right;		// 0 for leaves, the left child always follows its parent
+	};
+
+	uint32_t BuildNode(uint32_t first, uint32_t count, const std::vector<AABB>& bounds);
+	void CullNode(uint32_t index, const glm::vec4* planes);
+	void CullRange(uint32_t first, uint32_t count, const glm::vec4* planes);
+	void MarkRange(uint32_t first, uint32_t count);
+
+	// sorted in BVH order so every leaf is a contiguous range, `order` maps back to the instance index
+	std::vector<float> minX, minY, minZ;
+	std::vector<float> maxX, maxY, maxZ;
+	std::vector<uint32_t> order;
+	std::vector<uint8_t> sortedVisible;
+
+	std::vector<Node> nodes;
+};
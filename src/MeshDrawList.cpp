@@ -0,0 +1,475 @@
+#include "MeshDrawList.h"
+#include "JinGL/JinGL.h"
+#include "Utils.h"
+
+#include <algorithm>
+
+namespace
+{
+	GLuint GetTextureID(const StreamedTexture* texture, GLuint fallback)
+	{
+		return texture && texture->IsReady() ? GLuint(texture->id) : fallback;
+	}
+
+	GLuint LoadComputeProgram(const char* path)
+	{
+		std::string source;
+		if (!read_entire_file(path, source))
+			return 0;
+
+		auto text = source.c_str();
+		auto shader = glCreateShader(GL_COMPUTE_SHADER);
+		glShaderSource(shader, 1, &text, nullptr);
+		glCompileShader(shader);
+
+		auto program = glCreateProgram();
+		glAttachShader(program, shader);
+		glLinkProgram(program);
+		glDeleteShader(shader);
+
+		GLint linked = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+		if (!linked)
+		{
+			glDeleteProgram(program);
+			return 0;
+		}
+
+		return program;
+	}
+}
+
+MeshDrawList::~MeshDrawList()
+{
+	Clear();
+
+	if (whiteTexture)
+		glDeleteTextures(1, &whiteTexture);
+
+	if (cullProgram)
+		glDeleteProgram(cullProgram);
+}
+
+bool MeshDrawList::IsBindless()
+{
+	// v_meshIndex differs between the instances and commands of one draw, ARB_bindless_texture alone
+	// leaves sampling through such a handle undefined, NV_gpu_shader5 allows it
+	return GLAD_GL_ARB_bindless_texture != 0 && GLAD_GL_NV_gpu_shader5 != 0;
+}
+
+bool MeshDrawList::HasComputeShaders()
+{
+	return GLAD_GL_VERSION_4_3 != 0 || GLAD_GL_ARB_compute_shader != 0;
+}
+
+void MeshDrawList::SetupVertexInput(bool packedVertices)
+{
+	if (packedVertices)
+	{
+		glVertexAttribFormat(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedVertex, position));
+		glVertexAttribFormat(1, 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, normal));
+		glVertexAttribFormat(2, 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, tangent));
+		glVertexAttribFormat(3, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, uv));
+	}
+	else
+	{
+		glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, offsetof(MeshVertex, position));
+		glVertexAttribFormat(1, 3, GL_FLOAT, GL_FALSE, offsetof(MeshVertex, normal));
+		glVertexAttribFormat(2, 3, GL_FLOAT, GL_FALSE, offsetof(MeshVertex, tangent));
+		glVertexAttribFormat(3, 2, GL_FLOAT, GL_FALSE, offsetof(MeshVertex, uv));
+	}
+
+	for (GLuint i = 0; i < 4; i++)
+	{
+		glVertexAttribBinding(i, 0);
+		glEnableVertexAttribArray(i);
+	}
+
+	// advances once per instance, starting at each command's baseInstance
+	glVertexAttribIFormat(INSTANCE_ATTRIBUTE, 1, GL_UNSIGNED_INT, 0);
+	glVertexAttribBinding(INSTANCE_ATTRIBUTE, INSTANCE_BINDING);
+	glVertexBindingDivisor(INSTANCE_BINDING, 1);
+	glEnableVertexAttribArray(INSTANCE_ATTRIBUTE);
+}
+
+void MeshDrawList::Build(const Model& model)
+{
+	Clear();
+
+	auto count = model.meshes.size();
+	if (count == 0 || model.instances.empty() || model.arena == nullptr)
+		return;
+
+	std::vector<MeshInfo> infos(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		const auto& mesh = model.meshes[i];
+		infos[i] = {
+			.boundsMin = glm::vec4(mesh.bounds.min, 0.0f),
+			.boundsMax = glm::vec4(mesh.bounds.max, 0.0f),
+		};
+	}
+
+	std::vector<InstanceInfo> instances(model.instances.size());
+	for (size_t i = 0; i < instances.size(); i++)
+	{
+		instances[i] = {
+			.transform = model.instances[i].transform,
+			.normalTransform = glm::transpose(glm::inverse(model.instances[i].transform)),
+			.mesh = model.instances[i].mesh,
+			.padding = {},
+		};
+	}
+
+	glCreateBuffers(1, &meshInfoBuffer);
+	glNamedBufferStorage(meshInfoBuffer, GLsizeiptr(sizeof(MeshInfo) * count), infos.data(), 0);
+
+	glCreateBuffers(1, &instanceInfoBuffer);
+	glNamedBufferStorage(instanceInfoBuffer, GLsizeiptr(sizeof(InstanceInfo) * instances.size()), instances.data(), 0);
+
+	glCreateBuffers(1, &instanceStreamBuffer);
+	glCreateBuffers(1, &commandBuffer);
+
+	if (!model.meshlets.empty())
+	{
+		glCreateBuffers(1, &meshletBuffer);
+		glNamedBufferStorage(meshletBuffer, GLsizeiptr(sizeof(Meshlet) * model.meshlets.size()), model.meshlets.data(), 0);
+
+		if (cullProgram == 0 && !cullProgramFailed && HasComputeShaders())
+		{
+			// without it meshlets are culled on the CPU
+			cullProgram = LoadComputeProgram("Shaders\\ClusterCull.glsl");
+			cullProgramFailed = cullProgram == 0;
+		}
+
+		if (cullProgram)
+		{
+			glCreateBuffers(1, &batchBuffer);
+			glCreateBuffers(STATS_READBACKS, statsBuffers);
+			for (auto buffer : statsBuffers)
+				glNamedBufferStorage(buffer, sizeof(uint32_t), nullptr, GL_DYNAMIC_STORAGE_BIT);
+		}
+	}
+
+	if (whiteTexture == 0)
+	{
+		const uint32_t white = 0xFFFFFFFF;
+		glCreateTextures(GL_TEXTURE_2D, 1, &whiteTexture);
+		glTextureStorage2D(whiteTexture, 1, GL_RGBA8, 1, 1);
+		glTextureSubImage2D(whiteTexture, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, &white);
+	}
+
+	if (IsBindless())
+	{
+		glCreateBuffers(1, &textureHandleBuffer);
+		glNamedBufferStorage(textureHandleBuffer, GLsizeiptr(sizeof(GLuint64) * 6 * count), nullptr, GL_DYNAMIC_STORAGE_BIT);
+		UpdateTextureHandles(model);
+	}
+}
+
+void MeshDrawList::UpdateTextureHandles(const Model& model)
+{
+	// textures still streaming in show up white until a later call picks up their real handle
+	textureUploadCount = TextureStreamer::Get()->GetUploadCount();
+
+	// residency is counted by the streamer, other draw lists may sample the same textures
+	auto streamer = TextureStreamer::Get();
+
+	std::vector<GLuint64> handles(model.meshes.size() * 6);
+	std::unordered_map<unsigned int, uint64_t> used;
+	for (size_t i = 0; i < model.meshes.size(); i++)
+	{
+		for (int j = 0; j < 6; j++)
+		{
+			auto id = GetTextureID(model.meshes[i].textures[j], whiteTexture);
+			auto it = used.find(id);
+			if (it == used.end())
+				it = used.emplace(id, streamer->AcquireTextureHandle(id)).first;
+
+			handles[i * 6 + j] = it->second;
+		}
+	}
+
+	// acquire before releasing so textures still in use stay resident
+	for (auto [id, handle] : textureHandles)
+		streamer->ReleaseTextureHandle(id, handle);
+	textureHandles = std::move(used);
+
+	glNamedBufferSubData(textureHandleBuffer, 0, GLsizeiptr(sizeof(GLuint64) * handles.size()), handles.data());
+}
+
+void MeshDrawList::Clear()
+{
+	if (auto streamer = TextureStreamer::Get())
+	{
+		for (auto [id, handle] : textureHandles)
+			streamer->ReleaseTextureHandle(id, handle);
+	}
+	textureHandles.clear();
+
+	GLuint buffers[] = { meshInfoBuffer, instanceInfoBuffer, instanceStreamBuffer, textureHandleBuffer, commandBuffer,
+		meshletBuffer, batchBuffer, statsBuffers[0], statsBuffers[1], statsBuffers[2] };
+	for (auto buffer : buffers)
+	{
+		if (buffer)
+			glDeleteBuffers(1, &buffer);
+	}
+
+	for (auto& fence : statsFences)
+	{
+		if (fence)
+			glDeleteSync(GLsync(fence));
+		fence = nullptr;
+	}
+
+	meshInfoBuffer = instanceInfoBuffer = instanceStreamBuffer = textureHandleBuffer = commandBuffer = 0;
+	meshletBuffer = batchBuffer = 0;
+	std::fill_n(statsBuffers, STATS_READBACKS, 0u);
+	items.clear();
+	commands.clear();
+	batches.clear();
+	clusterRanges.clear();
+	clusterCommandCount = 0;
+	drawCalls = 0;
+	submittedTriangles = renderedTriangles = clusterTriangles = 0;
+}
+
+void MeshDrawList::Begin()
+{
+	items.clear();
+	clusterCulling = false;
+}
+
+void MeshDrawList::Add(uint32_t instanceIndex, uint32_t meshIndex, uint32_t lodIndex)
+{
+	items.push_back({ meshIndex, lodIndex, instanceIndex });
+}
+
+void MeshDrawList::SetClusterView(const glm::mat4& modelViewMatrix, const glm::mat4& projectionMatrix)
+{
+	clusterCulling = true;
+	clusterModelView = modelViewMatrix;
+	GetFrustumPlanes(projectionMatrix, frustumPlanes);
+}
+
+void MeshDrawList::Submit(const Model& model)
+{
+	drawCalls = 0;
+	commands.clear();
+	batches.clear();
+	clusterRanges.clear();
+	clusterCommandCount = 0;
+	submittedTriangles = renderedTriangles = 0;
+	if (items.empty() || meshInfoBuffer == 0)
+		return;
+
+	// instances of the same mesh and LOD become one instanced command
+	std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) {
+		return a.mesh != b.mesh ? a.mesh < b.mesh : (a.lod != b.lod ? a.lod < b.lod : a.instance < b.instance);
+	});
+
+	bool gpu_clusters = clusterCulling && cullProgram != 0;
+	size_t cpu_cluster_triangles = 0;
+
+	instanceStream.resize(items.size());
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		instanceStream[i] = items[i].instance;
+
+		const auto& item = items[i];
+		const auto& mesh = model.meshes[item.mesh];
+		const auto& lod = mesh.lods[item.lod];
+		submittedTriangles += lod.indexCount / 3;
+
+		// textures of meshes off screen are the first the streamer evicts
+		if (i == 0 || item.mesh != items[i - 1].mesh)
+		{
+			for (auto texture : mesh.textures)
+				TextureStreamer::Get()->Touch(texture);
+		}
+
+		// meshlets split LOD 0, so every instance gets its own set of per meshlet commands
+		if (clusterCulling && item.lod == 0 && mesh.meshletCount > 0)
+		{
+			if (gpu_clusters)
+			{
+				for (uint32_t first = 0; first < mesh.meshletCount; first += BATCH_SIZE)
+				{
+					auto count = std::min(BATCH_SIZE, mesh.meshletCount - first);
+					batches.push_back({
+						.instance = item.instance,
+						.streamIndex = uint32_t(i),
+						.firstMeshlet = mesh.firstMeshlet + first,
+						.meshletCount = count,
+						.firstIndex = mesh.firstIndex,
+						.baseVertex = int32_t(mesh.baseVertex),
+						.firstCommand = clusterCommandCount,
+						.padding = 0,
+					});
+					clusterCommandCount += count;
+				}
+
+				if (!clusterRanges.empty() && clusterRanges.back().mesh == item.mesh)
+					clusterRanges.back().commandCount += mesh.meshletCount;
+				else
+					clusterRanges.push_back({ item.mesh, clusterCommandCount - mesh.meshletCount, mesh.meshletCount });
+			}
+			else
+			{
+				auto model_view = clusterModelView * model.instances[item.instance].transform;
+				for (uint32_t j = 0; j < mesh.meshletCount; j++)
+				{
+					const auto& meshlet = model.meshlets[mesh.firstMeshlet + j];
+					if (!IsMeshletVisible(meshlet, model_view, frustumPlanes))
+						continue;
+
+					commands.push_back({
+						.count = meshlet.indexCount,
+						.instanceCount = 1,
+						.firstIndex = mesh.firstIndex + meshlet.indexOffset,
+						.baseVertex = int32_t(mesh.baseVertex),
+						.baseInstance = uint32_t(i),
+					});
+					cpu_cluster_triangles += meshlet.indexCount / 3;
+				}
+			}
+
+			continue;
+		}
+
+		if (i > 0 && item.mesh == items[i - 1].mesh && item.lod == items[i - 1].lod)
+		{
+			commands.back().instanceCount++;
+			renderedTriangles += lod.indexCount / 3;
+			continue;
+		}
+
+		commands.push_back({
+			.count = lod.indexCount,
+			.instanceCount = 1,
+			.firstIndex = mesh.firstIndex + lod.indexOffset,
+			.baseVertex = int32_t(mesh.baseVertex),
+			.baseInstance = uint32_t(i),
+		});
+		renderedTriangles += lod.indexCount / 3;
+	}
+
+	glNamedBufferData(instanceStreamBuffer, GLsizeiptr(sizeof(uint32_t) * instanceStream.size()), instanceStream.data(), GL_STREAM_DRAW);
+
+	glBindVertexBuffer(0, model.arena->GetVertexBuffer(), 0, GLsizei(model.arena->GetVertexStride()));
+	glBindVertexBuffer(INSTANCE_BINDING, instanceStreamBuffer, 0, sizeof(uint32_t));
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.arena->GetIndexBuffer());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MESH_INFO_BINDING, meshInfoBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_INFO_BINDING, instanceInfoBuffer);
+
+	// all instances of a command share the mesh, so the first one tells which textures it needs
+	auto textures_of = [&](const Command& command) {
+		return model.meshes[model.instances[instanceStream[command.baseInstance]].mesh].textures;
+	};
+
+	if (!IsBindless())
+	{
+		// meshes sharing a texture set end up next to each other and go out in one draw
+		std::stable_sort(commands.begin(), commands.end(), [&](const Command& a, const Command& b) {
+			auto ta = textures_of(a);
+			auto tb = textures_of(b);
+			return std::lexicographical_compare(ta, ta + 6, tb, tb + 6);
+		});
+	}
+
+	// the compute shader fills the first clusterCommandCount commands, the CPU built ones follow
+	glNamedBufferData(commandBuffer, GLsizeiptr(sizeof(Command) * (clusterCommandCount + commands.size())), nullptr, GL_STREAM_DRAW);
+	glNamedBufferSubData(commandBuffer, GLintptr(sizeof(Command) * clusterCommandCount),
+		GLsizeiptr(sizeof(Command) * commands.size()), commands.data());
+
+	if (!batches.empty())
+	{
+		// the count is read once the GPU got to it, never waited for. A GPU further behind than the
+		// ring drops that frame's count, the last one read stays on screen.
+		auto slot = statsFrame % STATS_READBACKS;
+		auto stats = statsBuffers[slot];
+		auto& fence = statsFences[slot];
+		if (fence)
+		{
+			if (glClientWaitSync(GLsync(fence), 0, 0) != GL_TIMEOUT_EXPIRED)
+			{
+				uint32_t triangles = 0;
+				glGetNamedBufferSubData(stats, 0, sizeof(uint32_t), &triangles);
+				clusterTriangles = triangles;
+			}
+
+			glDeleteSync(GLsync(fence));
+			fence = nullptr;
+		}
+
+		const uint32_t zero = 0;
+		glNamedBufferSubData(stats, 0, sizeof(uint32_t), &zero);
+		statsFrame++;
+
+		glNamedBufferData(batchBuffer, GLsizeiptr(sizeof(Batch) * batches.size()), batches.data(), GL_STREAM_DRAW);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MESHLET_BINDING, meshletBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BATCH_BINDING, batchBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_BINDING, commandBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STATS_BINDING, stats);
+
+		GLint previous_program = 0;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &previous_program);
+
+		glUseProgram(cullProgram);
+		glUniformMatrix4fv(glGetUniformLocation(cullProgram, "u_ModelViewMatrix"), 1, GL_FALSE, &clusterModelView[0][0]);
+		glUniform4fv(glGetUniformLocation(cullProgram, "u_FrustumPlanes"), 6, &frustumPlanes[0][0]);
+		glDispatchCompute(GLuint(batches.size()), 1, 1);
+
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+		glUseProgram(GLuint(previous_program));
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		renderedTriangles += clusterTriangles;
+	}
+
+	renderedTriangles += cpu_cluster_triangles;
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+
+	auto total_commands = clusterCommandCount + commands.size();
+	if (IsBindless())
+	{
+		if (textureUploadCount != TextureStreamer::Get()->GetUploadCount())
+			UpdateTextureHandles(model);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MESH_TEXTURES_BINDING, textureHandleBuffer);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, GLsizei(total_commands), 0);
+		drawCalls = 1;
+	}
+	else
+	{
+		auto draw = [&](StreamedTexture* const* textures, size_t first, size_t count) {
+			GLuint ids[6];
+			for (int i = 0; i < 6; i++)
+				ids[i] = GetTextureID(textures[i], whiteTexture);
+			glBindTextures(0, 6, ids);
+
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)(first * sizeof(Command)), GLsizei(count), 0);
+			drawCalls++;
+		};
+
+		for (const auto& range : clusterRanges)
+			draw(model.meshes[range.mesh].textures, range.firstCommand, range.commandCount);
+
+		size_t first = 0;
+		while (first < commands.size())
+		{
+			auto textures = textures_of(commands[first]);
+
+			size_t last = first + 1;
+			while (last < commands.size() && std::equal(textures, textures + 6, textures_of(commands[last])))
+				last++;
+
+			draw(textures, clusterCommandCount + first, last - first);
+			first = last;
+		}
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
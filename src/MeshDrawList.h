@@ -0,0 +1,145 @@
+#pragma once
+#include "Model.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// GPU side draw data of one model and the list of instances to draw this frame.
+// Per mesh and per instance data live in storage buffers. Every frame the visible instances
+// are grouped by mesh and LOD into one instanced indirect command each, and their indices are
+// streamed into a buffer read through an instanced attribute, so each command's baseInstance
+// points at its first instance. With bindless textures the whole model is one
+// glMultiDrawElementsIndirect, otherwise there is one per distinct texture set.
+// With a cluster view set, full detail draws of meshes that have meshlets are split into one
+// command per meshlet instead, culled against the frustum and by backface cones in a compute
+// shader (ClusterCull.glsl) or on the CPU where compute shaders are not available.
+class MeshDrawList
+{
+public:
+	static constexpr unsigned int MESH_INFO_BINDING = 0;		// std430 buffers, see ModelInputVertex.glsl
+	static constexpr unsigned int MESH_TEXTURES_BINDING = 1;	// bindless handles, see ModelInputFragment.glsl
+	static constexpr unsigned int INSTANCE_INFO_BINDING = 2;
+	static constexpr unsigned int INSTANCE_ATTRIBUTE = 4;
+	static constexpr unsigned int INSTANCE_BINDING = 1;
+	static constexpr unsigned int MESHLET_BINDING = 3;			// cluster culling, see ClusterCull.glsl
+	static constexpr unsigned int BATCH_BINDING = 4;
+	static constexpr unsigned int COMMAND_BINDING = 6;
+	static constexpr unsigned int STATS_BINDING = 7;
+	static constexpr uint32_t BATCH_SIZE = 64;					// meshlets per workgroup
+
+	~MeshDrawList();
+
+	static bool IsBindless();
+	static bool HasComputeShaders();
+
+	// Sets up the attribute formats of the bound vertex array for MeshVertex or PackedVertex data
+	// plus the per instance index.
+	static void SetupVertexInput(bool packedVertices);
+
+	void Build(const Model& model);
+	void Clear();
+
+	void Begin();
+	void Add(uint32_t instanceIndex, uint32_t meshIndex, uint32_t lodIndex);
+
+	// Enables cluster culling until the next Begin, `modelViewMatrix` excludes the instance transforms.
+	void SetClusterView(const glm::mat4& modelViewMatrix, const glm::mat4& projectionMatrix);
+
+	// Expects the vertex array set up by SetupVertexInput to be bound.
+	void Submit(const Model& model);
+
+	size_t GetCommandCount() const { return commands.size(); }
+	size_t GetDrawCalls() const { return drawCalls; }
+	bool IsClusterCullingOnGpu() const { return cullProgram != 0; }
+
+	// Triangles of every added item at its LOD, and what is left after cluster culling.
+	// The GPU result is read back a frame later, so it lags behind by two frames.
+	size_t GetSubmittedTriangles() const { return submittedTriangles; }
+	size_t GetRenderedTriangles() const { return renderedTriangles; }
+
+private:
+	void UpdateTextureHandles(const Model& model);
+
+	struct Command
+	{
+		uint32_t count;
+		uint32_t instanceCount;
+		uint32_t firstIndex;
+		int32_t baseVertex;
+		uint32_t baseInstance;
+	};
+
+	struct MeshInfo
+	{
+		glm::vec4 boundsMin;
+		glm::vec4 boundsMax;
+	};
+
+	struct InstanceInfo
+	{
+		glm::mat4 transform;
+		glm::mat4 normalTransform;
+		uint32_t mesh;
+		uint32_t padding[3];
+	};
+
+	struct Batch
+	{
+		uint32_t instance;
+		uint32_t streamIndex;
+		uint32_t firstMeshlet;
+		uint32_t meshletCount;
+		uint32_t firstIndex;
+		int32_t baseVertex;
+		uint32_t firstCommand;
+		uint32_t padding;
+	};
+
+	// consecutive cluster commands of one mesh, for binding its textures without bindless
+	struct ClusterRange
+	{
+		uint32_t mesh;
+		uint32_t firstCommand;
+		uint32_t commandCount;
+	};
+
+	struct Item
+	{
+		uint32_t mesh;
+		uint32_t lod;
+		uint32_t instance;
+	};
+
+	std::vector<Item> items;
+	std::vector<Command> commands;
+	std::vector<uint32_t> instanceStream;
+	std::vector<Batch> batches;
+	std::vector<ClusterRange> clusterRanges;
+	uint32_t clusterCommandCount{ 0 };
+	size_t drawCalls{ 0 };
+
+	bool clusterCulling{ false };
+	glm::mat4 clusterModelView{ 1.0f };
+	glm::vec4 frustumPlanes[6];
+	size_t submittedTriangles{ 0 };
+	size_t renderedTriangles{ 0 };
+	size_t clusterTriangles{ 0 };	// last value read back from the GPU
+
+	unsigned int meshInfoBuffer{ 0 };
+	unsigned int instanceInfoBuffer{ 0 };
+	unsigned int instanceStreamBuffer{ 0 };
+	unsigned int textureHandleBuffer{ 0 };
+	unsigned int commandBuffer{ 0 };
+	unsigned int meshletBuffer{ 0 };
+	unsigned int batchBuffer{ 0 };
+	static constexpr int STATS_READBACKS = 3;
+	unsigned int statsBuffers[STATS_READBACKS]{};	// a ring, read back once their fence signaled
+	void* statsFences[STATS_READBACKS]{};
+	uint32_t statsFrame{ 0 };
+	unsigned int cullProgram{ 0 };
+	bool cullProgramFailed{ false };
+	unsigned int whiteTexture{ 0 };
+	std::unordered_map<unsigned int, uint64_t> textureHandles;	// by texture id, acquired from the TextureStreamer
+	uint64_t textureUploadCount{ 0 };	// TextureStreamer count the handles were built at
+};
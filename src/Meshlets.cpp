@@ -0,0 +1,102 @@
+#include "Meshlets.h"
+
+#include <meshoptimizer.h>
+
+#include <algorithm>
+
+void BuildMeshlets(const float* positions, size_t vertexCount, size_t vertexStride,
+	std::vector<unsigned int>& indices, std::vector<Meshlet>& meshlets)
+{
+	constexpr float CONE_WEIGHT = 0.25f;
+
+	auto max_meshlets = meshopt_buildMeshletsBound(indices.size(), MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+	std::vector<meshopt_Meshlet> built(max_meshlets);
+	std::vector<unsigned int> meshlet_vertices(max_meshlets * MESHLET_MAX_VERTICES);
+	std::vector<unsigned char> meshlet_triangles(max_meshlets * MESHLET_MAX_TRIANGLES * 3);
+
+	auto count = meshopt_buildMeshlets(built.data(), meshlet_vertices.data(), meshlet_triangles.data(),
+		indices.data(), indices.size(), positions, vertexCount, vertexStride,
+		MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES, CONE_WEIGHT);
+
+	std::vector<unsigned int> reordered;
+	reordered.reserve(indices.size());
+
+	meshlets.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		const auto& m = built[i];
+		auto local_vertices = &meshlet_vertices[m.vertex_offset];
+		auto local_triangles = &meshlet_triangles[m.triangle_offset];
+
+		auto bounds = meshopt_computeMeshletBounds(local_vertices, local_triangles, m.triangle_count,
+			positions, vertexCount, vertexStride);
+
+		meshlets[i] = {
+			.sphere = { bounds.center[0], bounds.center[1], bounds.center[2], bounds.radius },
+			.cone = { bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2], bounds.cone_cutoff },
+			.apex = { bounds.cone_apex[0], bounds.cone_apex[1], bounds.cone_apex[2], 0.0f },
+			.indexOffset = uint32_t(reordered.size()),
+			.indexCount = m.triangle_count * 3,
+			.padding = {},
+		};
+
+		// back to mesh wide vertex indices, the regular vertex pipeline draws these ranges
+		for (unsigned int j = 0; j < m.triangle_count * 3; j++)
+			reordered.push_back(local_vertices[local_triangles[j]]);
+	}
+
+	indices = std::move(reordered);
+}
+
+void GetFrustumPlanes(const glm::mat4& projection, glm::vec4 planes[6])
+{
+	const auto& m = projection;
+	glm::vec4 row0 = { m[0][0], m[1][0], m[2][0], m[3][0] };
+	glm::vec4 row1 = { m[0][1], m[1][1], m[2][1], m[3][1] };
+	glm::vec4 row2 = { m[0][2], m[1][2], m[2][2], m[3][2] };
+	glm::vec4 row3 = { m[0][3], m[1][3], m[2][3], m[3][3] };
+
+	planes[0] = row3 + row0;
+	planes[1] = row3 - row0;
+	planes[2] = row3 + row1;
+	planes[3] = row3 - row1;
+	planes[4] = row3 + row2;
+	planes[5] = row3 - row2;
+
+	for (int i = 0; i < 6; i++)
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+bool IsMeshletVisible(const Meshlet& meshlet, const glm::mat4& modelView, const glm::vec4 planes[6])
+{
+	auto center = glm::vec3(modelView * glm::vec4(glm::vec3(meshlet.sphere), 1.0f));
+	float scale = std::max(glm::length(glm::vec3(modelView[0])),
+		std::max(glm::length(glm::vec3(modelView[1])), glm::length(glm::vec3(modelView[2]))));
+	float radius = meshlet.sphere.w * scale;
+
+	for (int i = 0; i < 6; i++)
+	{
+		if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius)
+			return false;
+	}
+
+	// a cutoff of 1 means the normals are spread too wide for a cone, never culled. Mirrored
+	// instances, with a negative determinant, flip the winding the cone was built for and are
+	// not cone culled either.
+	auto linear = glm::mat3(modelView);
+	auto yz = glm::cross(linear[1], linear[2]);
+	if (meshlet.cone.w < 1.0f && glm::dot(linear[0], yz) > 0.0f)
+	{
+		// the camera sits at the view space origin
+		auto apex = glm::vec3(modelView * glm::vec4(glm::vec3(meshlet.apex), 1.0f));
+
+		// the axis is a normal, the cofactor matrix is the inverse transpose times the determinant
+		auto cofactor = glm::mat3(yz, glm::cross(linear[2], linear[0]), glm::cross(linear[0], linear[1]));
+		auto axis = glm::normalize(cofactor * glm::vec3(meshlet.cone));
+
+		if (glm::dot(glm::normalize(apex), axis) >= meshlet.cone.w)
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A small cluster of triangles with bounds for culling, same layout as Meshlet in ClusterCull.glsl.
+struct Meshlet
+{
+	glm::vec4 sphere;		// center, radius
+	glm::vec4 cone;			// axis, cutoff. Backfacing when seen from anywhere inside the cone
+	glm::vec4 apex;			// cone apex, w unused
+	uint32_t indexOffset;	// relative to the mesh's first index
+	uint32_t indexCount;
+	uint32_t padding[2];
+};
+
+constexpr size_t MESHLET_MAX_VERTICES = 64;
+constexpr size_t MESHLET_MAX_TRIANGLES = 124;
+
+// Splits a triangle list into meshlets and rewrites `indices` in meshlet order, so every meshlet
+// is a contiguous range of it. Positions are the first three floats of every vertex.
+void BuildMeshlets(const float* positions, size_t vertexCount, size_t vertexStride,
+	std::vector<unsigned int>& indices, std::vector<Meshlet>& meshlets);
+
+// View space frustum planes of a projection matrix, normalized so spheres can be tested.
+void GetFrustumPlanes(const glm::mat4& projection, glm::vec4 planes[6]);
+
+// Frustum and backface cone test, `modelView` takes mesh space to view space.
+// Same test as ClusterCull.glsl, used when compute shaders are not available.
+bool IsMeshletVisible(const Meshlet& meshlet, const glm::mat4& modelView, const glm::vec4 planes[6]);
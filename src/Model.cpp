@@ -2,33 +2,154 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <assimp/ProgressHandler.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <execution>
+#include <memory>
 #include <sstream>
 #include "stb_image.h"
-#include "JinGL/TextureLoader.h"
 #include "JinGL/Buffer.h"
-#include <set>
+#include "MeshCache.h"
+#include "MemoryBudget.h"
 
 #include <meshoptimizer.h>
 #include <glm/ext/matrix_transform.hpp>
 
 std::tuple<std::vector<MeshVertex>, std::vector<unsigned int>> Optimize(const float* vertices, const unsigned int* indices, size_t verticesCount, size_t indicesCount) {
 
+	// no triangles, every vertex would be unreferenced
+	if (indicesCount == 0)
+		return {};
+
 	std::vector<unsigned int> remap(indicesCount);
-	size_t vertex_count = meshopt_generateVertexRemap(&remap[0], indices, indicesCount, vertices, verticesCount, sizeof(MeshVertex));
+	size_t vertex_count = meshopt_generateVertexRemap(remap.data(), indices, indicesCount, vertices, verticesCount, sizeof(MeshVertex));
 
 	std::vector<unsigned int> optIndices(indicesCount);
 	std::vector<MeshVertex> optVertices(vertex_count);
-	meshopt_remapIndexBuffer(optIndices.data(), indices, indicesCount, &remap[0]);
-	meshopt_remapVertexBuffer(optVertices.data(), &vertices[0], verticesCount, sizeof(MeshVertex), &remap[0]);
+	meshopt_remapIndexBuffer(optIndices.data(), indices, indicesCount, remap.data());
+	meshopt_remapVertexBuffer(optVertices.data(), vertices, verticesCount, sizeof(MeshVertex), remap.data());
 
 	meshopt_optimizeVertexCache(optIndices.data(), optIndices.data(), indicesCount, vertex_count);
-	meshopt_optimizeOverdraw(optIndices.data(), optIndices.data(), indicesCount, &optVertices[0].position.x, vertex_count, sizeof(MeshVertex), 1.05f);
+	meshopt_optimizeOverdraw(optIndices.data(), optIndices.data(), indicesCount, &optVertices.data()->position.x, vertex_count, sizeof(MeshVertex), 1.05f);
+	meshopt_optimizeVertexFetch(optVertices.data(), optIndices.data(), indicesCount, optVertices.data(), vertex_count, sizeof(MeshVertex));
 
 	return { std::move(optVertices), std::move(optIndices) };
 }
 
-void Model::ProcessMesh(aiMesh* mesh, const aiScene* scene, const char* root, const glm::mat4& transform)
+static constexpr unsigned int IMPORT_FLAGS =
+	aiProcess_Triangulate |
+	aiProcess_FlipUVs |
+	aiProcess_ForceGenNormals |
+	aiProcess_CalcTangentSpace |
+	aiProcess_GenBoundingBoxes;
+
+// Simplifies each LOD from the previous one to about half the triangles, until meshoptimizer
+// can no longer make meaningful progress (borders, error limit) or the mesh gets tiny.
+static void GenerateLods(MeshData& data)
+{
+	constexpr size_t MIN_LOD_INDICES = 3 * 64;
+	constexpr float MAX_LOD_ERROR = 0.25f;
+
+	std::vector<unsigned int> lod_indices;
+	std::vector<unsigned int> source;
+
+	while (data.lodCount < MAX_MESH_LODS)
+	{
+		const auto& previous = data.lods[data.lodCount - 1];
+		size_t target = (previous.indexCount / 6) * 3;
+		if (target < MIN_LOD_INDICES)
+			break;
+
+		// appending to data.indices below may reallocate, so simplify from a copy
+		source.assign(data.indices.begin() + previous.indexOffset, data.indices.begin() + previous.indexOffset + previous.indexCount);
+		lod_indices.resize(source.size());
+
+		float error = 0.0f;
+		size_t count = meshopt_simplify(lod_indices.data(), source.data(), source.size(),
+			&data.vertices[0].position.x, data.vertices.size(), sizeof(MeshVertex),
+			target, MAX_LOD_ERROR, 0, &error);
+
+		if (count == 0 || count > source.size() * 9 / 10)
+			break;
+
+		meshopt_optimizeVertexCache(lod_indices.data(), lod_indices.data(), count, data.vertices.size());
+
+		data.lods[data.lodCount++] = {
+			.indexOffset = uint32_t(data.indices.size()),
+			.indexCount = uint32_t(count),
+			.error = previous.error + error,
+		};
+		data.indices.insert(data.indices.end(), lod_indices.begin(), lod_indices.begin() + count);
+	}
+}
+
+static void EncodeOctahedral(const glm::vec3& v, int16_t out[2])
+{
+	float l1 = fabsf(v.x) + fabsf(v.y) + fabsf(v.z);
+	if (l1 == 0.0f)
+	{
+		out[0] = out[1] = 0;
+		return;
+	}
+
+	glm::vec2 p = { v.x / l1, v.y / l1 };
+	if (v.z < 0.0f)
+	{
+		p = {
+			(1.0f - fabsf(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f),
+			(1.0f - fabsf(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f),
+		};
+	}
+
+	out[0] = int16_t(meshopt_quantizeSnorm(p.x, 16));
+	out[1] = int16_t(meshopt_quantizeSnorm(p.y, 16));
+}
+
+static std::vector<PackedVertex> PackVertices(const std::vector<MeshVertex>& vertices, const AABB& bounds)
+{
+	// flat meshes have a zero extent on one axis, every vertex quantizes to 0 there
+	auto extent = glm::max(bounds.max - bounds.min, glm::vec3(1e-20f));
+
+	std::vector<PackedVertex> packed(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		const auto& v = vertices[i];
+		auto& p = packed[i];
+
+		auto position = (v.position - bounds.min) / extent;
+		p.position[0] = uint16_t(meshopt_quantizeUnorm(position.x, 16));
+		p.position[1] = uint16_t(meshopt_quantizeUnorm(position.y, 16));
+		p.position[2] = uint16_t(meshopt_quantizeUnorm(position.z, 16));
+		p.position[3] = 0;
+
+		EncodeOctahedral(v.normal, p.normal);
+		EncodeOctahedral(v.tangent, p.tangent);
+
+		p.uv[0] = meshopt_quantizeHalf(v.uv.x);
+		p.uv[1] = meshopt_quantizeHalf(v.uv.y);
+	}
+
+	return packed;
+}
+
+static std::string GetTexturePath(const aiMaterial* mat, aiTextureType type, aiTextureType fallback, const char* root)
+{
+	if (mat->GetTextureCount(type) == 0)
+		type = fallback;
+
+	if (mat->GetTextureCount(type) == 0)
+		return {};
+
+	aiString path;
+	mat->GetTexture(type, 0, &path);
+	std::stringstream ss;
+	ss << root << "\\" << path.C_Str();
+	return ss.str();
+}
+
+static void ProcessMesh(aiMesh* mesh, const aiScene* scene, const char* root, const ImportSettings& settings, MeshData& data)
 {
 	std::vector<MeshVertex> vertices(mesh->mNumVertices);
 	std::fill(vertices.begin(), vertices.end(), MeshVertex{
@@ -72,7 +193,11 @@ void Model::ProcessMesh(aiMesh* mesh, const aiScene* scene, const char* root, co
 	std::vector<unsigned int> indices;
 	indices.reserve(mesh->mNumFaces * 3);
 	for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
-		aiFace face = mesh->mFaces[i];
+		// point and line primitives survive triangulation, they would break the triangle list
+		const aiFace& face = mesh->mFaces[i];
+		if (face.mNumIndices != 3)
+			continue;
+
 		for (unsigned int j = 0; j < face.mNumIndices; j++)
 			indices.push_back(face.mIndices[j]);
 	}
@@ -80,141 +205,46 @@ void Model::ProcessMesh(aiMesh* mesh, const aiScene* scene, const char* root, co
 #define OPTIMIZE
 
 #ifdef OPTIMIZE
-	printf("Optimized Version\n");
 	auto [optVertices, optIndices] = Optimize((const float*)vertices.data(), indices.data(), vertices.size(), indices.size());
 
-	auto verticesSize = sizeof(MeshVertex) * optVertices.size();
-	auto indicesSize = sizeof(unsigned int) * optIndices.size();
-
-	Geometry* geometry = new Geometry(optVertices.data(), verticesSize, optIndices.data(), indicesSize);
-
+	data.vertices = std::move(optVertices);
+	data.indices = std::move(optIndices);
 #else
-	printf("UnOptimized Version\n");
-	auto verticesSize = sizeof(MeshVertex) * vertices.size();
-	auto indicesSize = sizeof(unsigned int) * indices.size();
-
-	Geometry* geometry = new Geometry(vertices.data(), verticesSize, indices.data(), indicesSize);
-
+	data.vertices = std::move(vertices);
+	data.indices = std::move(indices);
 #endif // OPTIMIZE
 
-	Mesh gpuMesh = {
-		.geometry = geometry,
-		.bounds = {
-			.min = {mesh->mAABB.mMin.x, mesh->mAABB.mMin.y, mesh->mAABB.mMin.z},
-			.max = {mesh->mAABB.mMax.x, mesh->mAABB.mMax.y, mesh->mAABB.mMax.z},
-		},
-		.textures = {},
-		.visible = true,
-		.transform = transform
+	data.bounds = {
+		.min = {mesh->mAABB.mMin.x, mesh->mAABB.mMin.y, mesh->mAABB.mMin.z},
+		.max = {mesh->mAABB.mMax.x, mesh->mAABB.mMax.y, mesh->mAABB.mMax.z},
 	};
 
-	if (scene->HasMaterials())
-	{
-		auto mat = scene->mMaterials[mesh->mMaterialIndex];
-		if (mat->GetTextureCount(aiTextureType_BASE_COLOR) > 0)
-		{
-			aiString path;
-			mat->GetTexture(aiTextureType_BASE_COLOR, 0, &path);
-			std::stringstream ss;
-			ss << root << "\\" << path.C_Str();
-			gpuMesh.textures[0] = TextureLoader::Load(ss.str());
-		}
-		else if (mat->GetTextureCount(aiTextureType_DIFFUSE) > 0)
-		{
-			aiString path;
-			mat->GetTexture(aiTextureType_DIFFUSE, 0, &path);
-			std::stringstream ss;
-			ss << root << "\\" << path.C_Str();
-			gpuMesh.textures[0] = TextureLoader::Load(ss.str());
-		}
-
-		if (mat->GetTextureCount(aiTextureType_SPECULAR) > 0)
-		{
-			aiString path;
-			mat->GetTexture(aiTextureType_SPECULAR, 0, &path);
-			std::stringstream ss;
-			ss << root << "\\" << path.C_Str();
-			gpuMesh.textures[1] = TextureLoader::Load(ss.str());
-		}
-		else if (mat->GetTextureCount(aiTextureType_METALNESS) > 0)
-		{
-			aiString path;
-			mat->GetTexture(aiTextureType_METALNESS, 0, &path);
-			std::stringstream ss;
-			ss << root << "\\" << path.C_Str();
-			gpuMesh.textures[1] = TextureLoader::Load(ss.str());
-		}
+	// reorders the LOD 0 indices, so before the LODs are appended after them
+	if (settings.buildMeshlets && !data.vertices.empty())
+		BuildMeshlets(&data.vertices[0].position.x, data.vertices.size(), sizeof(MeshVertex), data.indices, data.meshlets);
 
-		if (mat->GetTextureCount(aiTextureType_NORMAL_CAMERA) > 0)
-		{
-			aiString path;
-			mat->GetTexture(aiTextureType_NORMAL_CAMERA, 0, &path);
-			std::stringstream ss;
-			ss << root << "\\" << path.C_Str();
-			gpuMesh.textures[2] = TextureLoader::Load(ss.str());
-		}
-		else if (mat->GetTextureCount(aiTextureType_NORMALS) > 0)
-		{
-			aiString path;
-			mat->GetTexture(aiTextureType_NORMALS, 0, &path);
-			std::stringstream ss;
-			ss << root << "\\" << path.C_Str();
-			gpuMesh.textures[2] = TextureLoader::Load(ss.str());
-		}
+	data.lods[0] = { 0, uint32_t(data.indices.size()), 0.0f };
+	data.lodCount = 1;
 
-		if (mat->GetTextureCount(aiTextureType_SHININESS) > 0)
-		{
-			aiString path;
-			mat->GetTexture(aiTextureType_SHININESS, 0, &path);
-			std::stringstream ss;
-			ss << root << "\\" << path.C_Str();
-			gpuMesh.textures[3] = TextureLoader::Load(ss.str());
-		}
-		else if (mat->GetTextureCount(aiTextureType_DIFFUSE_ROUGHNESS) > 0)
-		{
-			aiString path;
-			mat->GetTexture(aiTextureType_DIFFUSE_ROUGHNESS, 0, &path);
-			std::stringstream ss;
-			ss << root << "\\" << path.C_Str();
-			gpuMesh.textures[3] = TextureLoader::Load(ss.str());
-		}
+	if (settings.generateLods && !data.vertices.empty())
+		GenerateLods(data);
 
-		if (mat->GetTextureCount(aiTextureType_AMBIENT_OCCLUSION) > 0)
-		{
-			aiString path;
-			mat->GetTexture(aiTextureType_AMBIENT_OCCLUSION, 0, &path);
-			std::stringstream ss;
-			ss << root << "\\" << path.C_Str();
-			gpuMesh.textures[4] = TextureLoader::Load(ss.str());
-		}
-		else if (mat->GetTextureCount(aiTextureType_LIGHTMAP) > 0)
-		{
-			aiString path;
-			mat->GetTexture(aiTextureType_LIGHTMAP, 0, &path);
-			std::stringstream ss;
-			ss << root << "\\" << path.C_Str();
-			gpuMesh.textures[4] = TextureLoader::Load(ss.str());
-		}
-
-		if (mat->GetTextureCount(aiTextureType_EMISSION_COLOR) > 0)
-		{
-			aiString path;
-			mat->GetTexture(aiTextureType_EMISSION_COLOR, 0, &path);
-			std::stringstream ss;
-			ss << root << "\\" << path.C_Str();
-			gpuMesh.textures[5] = TextureLoader::Load(ss.str());
-		}
-		else if (mat->GetTextureCount(aiTextureType_EMISSIVE) > 0)
-		{
-			aiString path;
-			mat->GetTexture(aiTextureType_EMISSIVE, 0, &path);
-			std::stringstream ss;
-			ss << root << "\\" << path.C_Str();
-			gpuMesh.textures[5] = TextureLoader::Load(ss.str());
-		}
+	if (settings.packVertices)
+	{
+		data.packedVertices = PackVertices(data.vertices, data.bounds);
+		data.vertices = {};
 	}
 
-	meshes.push_back(gpuMesh);
+	if (scene->HasMaterials())
+	{
+		auto mat = scene->mMaterials[mesh->mMaterialIndex];
+		data.texturePaths[0] = GetTexturePath(mat, aiTextureType_BASE_COLOR, aiTextureType_DIFFUSE, root);
+		data.texturePaths[1] = GetTexturePath(mat, aiTextureType_SPECULAR, aiTextureType_METALNESS, root);
+		data.texturePaths[2] = GetTexturePath(mat, aiTextureType_NORMAL_CAMERA, aiTextureType_NORMALS, root);
+		data.texturePaths[3] = GetTexturePath(mat, aiTextureType_SHININESS, aiTextureType_DIFFUSE_ROUGHNESS, root);
+		data.texturePaths[4] = GetTexturePath(mat, aiTextureType_AMBIENT_OCCLUSION, aiTextureType_LIGHTMAP, root);
+		data.texturePaths[5] = GetTexturePath(mat, aiTextureType_EMISSION_COLOR, aiTextureType_EMISSIVE, root);
+	}
 }
 
 static inline glm::mat4 AssimpMat4ToGlmMat4(const aiMatrix4x4& from)
@@ -227,79 +257,370 @@ static inline glm::mat4 AssimpMat4ToGlmMat4(const aiMatrix4x4& from)
 	return to;
 }
 
-void Model::ProcessNode(aiNode* node, const aiScene* scene, const char* root, const glm::mat4& transform)
+AABB TransformBounds(const AABB& bounds, const glm::mat4& transform)
+{
+	// Arvo: each output axis is the translation plus the extremes of every matrix entry times the input range
+	AABB result = { glm::vec3(transform[3]), glm::vec3(transform[3]) };
+
+	for (int i = 0; i < 3; i++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			float a = transform[j][i] * bounds.min[j];
+			float b = transform[j][i] * bounds.max[j];
+			result.min[i] += std::min(a, b);
+			result.max[i] += std::max(a, b);
+		}
+	}
+
+	return result;
+}
+
+struct MeshReference
+{
+	unsigned int mesh;
+	std::vector<glm::mat4> transforms;
+};
+
+// Flattens the node tree so the meshes can be processed independently of each other.
+// A mesh referenced by several nodes is listed once with all of its transforms.
+static void CollectMeshes(aiNode* node, const aiScene* scene, const glm::mat4& parentTransform,
+	std::vector<int>& referenceIndices, std::vector<MeshReference>& references)
 {
-	glm::mat4 local_transform = AssimpMat4ToGlmMat4(node->mTransformation) * transform;
+	glm::mat4 transform = parentTransform * AssimpMat4ToGlmMat4(node->mTransformation);
 
 	for (unsigned int i = 0; i < node->mNumMeshes; ++i)
 	{
-		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		ProcessMesh(mesh, scene, root, local_transform);
+		// point and line meshes have nothing to draw, ProcessMesh only keeps triangles
+		auto mesh_index = node->mMeshes[i];
+		if ((scene->mMeshes[mesh_index]->mPrimitiveTypes & aiPrimitiveType_TRIANGLE) == 0)
+			continue;
+
+		if (referenceIndices[mesh_index] < 0)
+		{
+			referenceIndices[mesh_index] = int(references.size());
+			references.push_back({ mesh_index, {} });
+		}
+
+		references[referenceIndices[mesh_index]].transforms.push_back(transform);
 	}
 
 	for (unsigned int i = 0; i < node->mNumChildren; ++i)
 	{
-		ProcessNode(node->mChildren[i], scene, root, local_transform);
+		CollectMeshes(node->mChildren[i], scene, transform, referenceIndices, references);
+	}
+}
+
+class ImportProgressHandler : public Assimp::ProgressHandler
+{
+public:
+	explicit ImportProgressHandler(ImportProgress* progress) : progress(progress) {}
+
+	bool Update(float percentage) override
+	{
+		if (percentage >= 0.0f)
+			progress->parsing = percentage;
+		return !progress->cancel;
 	}
+
+private:
+	ImportProgress* progress;
+};
+
+// What Assimp holds for one mesh, released as soon as the mesh is processed
+static size_t GetSceneMeshBytes(const aiMesh* mesh)
+{
+	size_t channels = 1 + mesh->HasNormals() + 2 * mesh->HasTangentsAndBitangents() + mesh->GetNumUVChannels() + mesh->GetNumColorChannels();
+	return size_t(mesh->mNumVertices) * channels * sizeof(aiVector3D) + size_t(mesh->mNumFaces) * (sizeof(aiFace) + 3 * sizeof(unsigned int));
 }
 
-bool Model::Load(const char* root, const char* filename, float scale)
+bool Model::Import(const char* root, const char* filename, const ImportSettings& settings, ModelData& data, ImportProgress* progress)
+{
+	auto on_parsed = [&](const ImportInfo& info) {
+		data.meshes.resize(info.meshCount);
+		data.bounds = info.bounds;
+		data.packedVertices = info.packedVertices;
+		return true;
+	};
+
+	auto on_mesh = [&](size_t index, MeshData& mesh) {
+		data.meshes[index] = std::move(mesh);
+		return true;
+	};
+
+	return ImportStreaming(root, filename, settings, on_parsed, on_mesh, progress);
+}
+
+bool Model::ImportStreaming(const char* root, const char* filename, const ImportSettings& settings,
+	const std::function<bool(const ImportInfo&)>& onParsed, const MeshSink& onMesh, ImportProgress* progress, MemoryBudget* budget)
 {
 	Assimp::Importer importer;
 	char fullPath[256];
 
 	sprintf_s(fullPath, "%s\\%s", root, filename);
 
-	const aiScene* scene = importer.ReadFile(fullPath,
-		aiProcess_Triangulate |
-		aiProcess_FlipUVs |
-		aiProcess_ForceGenNormals |
-		aiProcess_CalcTangentSpace |
-		aiProcess_GenBoundingBoxes);
+	if (progress)
+	{
+		// the importer owns the handler from here on
+		importer.SetProgressHandler(new ImportProgressHandler(progress));
+	}
+
+	if (!importer.ReadFile(fullPath, IMPORT_FLAGS))
+		return false;
+
+	// taken over so every mesh can be freed right after processing instead of with the whole scene
+	std::unique_ptr<aiScene> scene(importer.GetOrphanedScene());
 	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
 		return false;
 	}
 
-	auto transform = AssimpMat4ToGlmMat4(scene->mRootNode->mTransformation) * glm::scale(glm::mat4(1.0f), { scale, scale, scale });
-	ProcessNode(scene->mRootNode, scene, root, transform);
+	// the root node's own transformation is applied by CollectMeshes like every other node's
+	auto transform = glm::scale(glm::mat4(1.0f), glm::vec3(settings.scale));
 
-	bounds.min = meshes[0].bounds.min;
-	bounds.max = meshes[0].bounds.max;
+	std::vector<int> reference_indices(scene->mNumMeshes, -1);
+	std::vector<MeshReference> references;
+	CollectMeshes(scene->mRootNode, scene.get(), transform, reference_indices, references);
 
-	for (const auto& mesh : meshes) {
-		bounds.min = glm::min(bounds.min, mesh.bounds.min);
-		bounds.max = glm::max(bounds.max, mesh.bounds.max);
+	if (references.empty())
+		return false;
+
+	// everything the receiver needs up front comes from the scene, before any mesh is processed
+	ImportInfo info = {};
+	info.meshCount = references.size();
+	info.packedVertices = settings.packVertices;
+
+	size_t scene_bytes = 0;
+	bool first_bounds = true;
+	for (size_t i = 0; i < references.size(); i++)
+	{
+		auto mesh = scene->mMeshes[references[i].mesh];
+		AABB mesh_bounds = {
+			.min = {mesh->mAABB.mMin.x, mesh->mAABB.mMin.y, mesh->mAABB.mMin.z},
+			.max = {mesh->mAABB.mMax.x, mesh->mAABB.mMax.y, mesh->mAABB.mMax.z},
+		};
+
+		for (const auto& mesh_transform : references[i].transforms)
+		{
+			auto bounds = TransformBounds(mesh_bounds, mesh_transform);
+			info.bounds.min = first_bounds ? bounds.min : glm::min(info.bounds.min, bounds.min);
+			info.bounds.max = first_bounds ? bounds.max : glm::max(info.bounds.max, bounds.max);
+			first_bounds = false;
+		}
+
+		// LODs add about as many indices again at most
+		info.vertexCount += mesh->mNumVertices;
+		info.indexCount += size_t(mesh->mNumFaces) * 3 * (settings.generateLods ? 2 : 1);
+		scene_bytes += GetSceneMeshBytes(mesh);
 	}
 
-	if (scene->HasMaterials())
+	if (budget)
+		budget->Track(scene_bytes);
+
+	if (progress)
 	{
-		TextureLoader::Get()->LoadPromisedTextures();
+		progress->parsing = 1.0f;
+		progress->totalMeshes = references.size();
 	}
 
-	return true;
+	if (!onParsed(info))
+		return false;
+
+	// unpacking, remapping and the meshoptimizer passes only touch their own mesh,
+	// so they can be spread over all cores. With a budget, a mesh only starts processing
+	// once its working memory fits, and that memory stays counted until the receiver frees it.
+	std::atomic<bool> failed{ false };
+	std::for_each(std::execution::par, references.begin(), references.end(), [&](const MeshReference& reference) {
+		if (failed || (progress && progress->cancel))
+			return;
+
+		auto source = scene->mMeshes[reference.mesh];
+		auto source_bytes = GetSceneMeshBytes(source);
+
+		// source vertices and indices unpacked, plus their optimized copies
+		size_t working_bytes = 2 * (size_t(source->mNumVertices) * sizeof(MeshVertex) + size_t(source->mNumFaces) * 3 * sizeof(unsigned int));
+		if (budget && !budget->Acquire(working_bytes))
+		{
+			failed = true;
+			return;
+		}
+
+		MeshData mesh;
+		ProcessMesh(source, scene.get(), root, settings, mesh);
+		mesh.transforms = reference.transforms;
+
+		delete scene->mMeshes[reference.mesh];
+		scene->mMeshes[reference.mesh] = nullptr;
+
+		if (budget)
+		{
+			budget->Untrack(source_bytes);
+			budget->Resize(working_bytes, mesh.GetResidentBytes());
+		}
+
+		if (!onMesh(size_t(&reference - references.data()), mesh))
+			failed = true;
+
+		if (progress)
+			progress->processedMeshes++;
+	});
+
+	return !failed && !(progress && progress->cancel);
 }
 
-void Model::Destroy()
+size_t MeshData::GetResidentBytes() const
+{
+	return vertices.capacity() * sizeof(MeshVertex) + packedVertices.capacity() * sizeof(PackedVertex) +
+		indices.capacity() * sizeof(unsigned int) + meshlets.capacity() * sizeof(Meshlet) +
+		transforms.capacity() * sizeof(glm::mat4);
+}
+
+MeshView MeshData::View() const
+{
+	MeshView view = {
+		.vertices = packedVertices.empty() ? (const void*)vertices.data() : (const void*)packedVertices.data(),
+		.vertexCount = packedVertices.empty() ? vertices.size() : packedVertices.size(),
+		.vertexStride = packedVertices.empty() ? sizeof(MeshVertex) : sizeof(PackedVertex),
+		.indices = indices.data(),
+		.indexCount = indices.size(),
+		.lods = lods,
+		.lodCount = lodCount,
+		.meshlets = meshlets.data(),
+		.meshletCount = meshlets.size(),
+		.bounds = bounds,
+		.transforms = transforms.data(),
+		.transformCount = transforms.size(),
+	};
+
+	for (int i = 0; i < 6; i++)
+		view.texturePaths[i] = texturePaths[i];
+
+	return view;
+}
+
+uint64_t Model::GetCacheKey(const char* root, const char* filename, const ImportSettings& settings)
 {
-	std::set<Texture2D*> unique_textures;
+	char fullPath[256];
+	sprintf_s(fullPath, "%s\\%s", root, filename);
+
+	return MeshCache::MakeKey(fullPath, IMPORT_FLAGS, settings);
+}
+
+// Block compression per texture slot. A file used by several slots packs channels, glTF for one puts
+// roughness and metalness into one image, so it keeps all of them.
+static TextureFormat GetSlotFormat(const MeshView& data, int slot)
+{
+	for (int i = 0; i < 6; i++)
+	{
+		if (i != slot && data.texturePaths[i] == data.texturePaths[slot])
+			return TextureFormat::BC7;
+	}
+
+	switch (slot)
+	{
+	case 2: return TextureFormat::BC5;		// normals
+	case 3:									// shininess / roughness
+	case 4: return TextureFormat::BC4;		// lightmap / ambient occlusion
+	default: return TextureFormat::BC7;
+	}
+}
+
+void Model::AddMesh(const MeshView& data)
+{
+	// every mesh of a model has the same vertex layout, so they all share one arena
+	if (arena == nullptr)
+		arena = new MeshArena(data.vertexStride);
+
+	Mesh gpuMesh = {
+		.baseVertex = 0,
+		.firstIndex = 0,
+		.bounds = data.bounds,
+		.textures = {},
+		.visible = true,
+		.lods = {},
+		.lodCount = uint32_t(std::min<size_t>(data.lodCount, MAX_MESH_LODS)),
+		.firstMeshlet = uint32_t(meshlets.size()),
+		.meshletCount = uint32_t(data.meshletCount),
+	};
+
+	// straight from the source memory, which may be the decoded cache scratch
+	arena->Append(data.vertices, data.vertexCount, data.indices, data.indexCount, gpuMesh.baseVertex, gpuMesh.firstIndex);
+
+	std::copy_n(data.lods, gpuMesh.lodCount, gpuMesh.lods);
+	meshlets.insert(meshlets.end(), data.meshlets, data.meshlets + data.meshletCount);
+
+	for (int i = 0; i < 6; i++)
+	{
+		if (!data.texturePaths[i].empty())
+		{
+			auto& texture = textures[std::string(data.texturePaths[i])];
+			if (texture == nullptr)
+				texture = TextureStreamer::Get()->Load(std::string(data.texturePaths[i]), false, GetSlotFormat(data, i));
+
+			gpuMesh.textures[i] = texture;
+		}
+	}
 
-	for (int i = 0; i < meshes.size(); i++)
+	for (size_t i = 0; i < data.transformCount; i++)
 	{
-		for (int j = 0; j < 6; j++)
+		instances.push_back({ uint32_t(meshes.size()), data.transforms[i] });
+	}
+
+	meshes.push_back(gpuMesh);
+}
+
+bool Model::Load(const char* root, const char* filename, const ImportSettings& settings)
+{
+	auto key = GetCacheKey(root, filename, settings);
+
+	// textures keep streaming in after this returns
+	MeshCache cache;
+
+	if (cache.Open(key))
+	{
+		for (size_t i = 0; i < cache.GetMeshCount(); i++)
 		{
-			if (meshes[i].textures[j] != nullptr)
-			{
-				unique_textures.insert(meshes[i].textures[j]);
-			}
+			MeshView mesh;
+			if (!cache.GetMesh(i, mesh))
+				break;
+
+			AddMesh(mesh);
 		}
 
-		delete meshes[i].geometry;
+		bounds = cache.GetBounds();
+		packedVertices = cache.HasPackedVertices();
 	}
+	else
+	{
+		ModelData data;
+		if (!Import(root, filename, settings, data))
+			return false;
+
+		MeshCache::Write(key, data);
+
+		for (const auto& mesh : data.meshes)
+		{
+			AddMesh(mesh.View());
+		}
+
+		bounds = data.bounds;
+		packedVertices = data.packedVertices;
+	}
+
+	return true;
+}
+
+void Model::Destroy()
+{
+	delete arena;
+	arena = nullptr;
 
-	for (auto& t : unique_textures)
+	for (auto& [path, texture] : textures)
 	{
-		delete t;
+		TextureStreamer::Get()->Release(texture);
 	}
 
 	meshes.clear();
+	instances.clear();
+	meshlets.clear();
+	textures.clear();
 }
\ No newline at end of file
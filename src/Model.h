@@ -1,9 +1,15 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <vector>
 #include <string>
-#include "JinGL/Texture2D.h"
-#include "Geometry.h"
+#include <string_view>
+#include <unordered_map>
+#include "MeshArena.h"
+#include "Meshlets.h"
+#include "TextureStreamer.h"
 
 struct MeshVertex {
 	glm::vec3 position;
@@ -12,33 +18,159 @@ struct MeshVertex {
 	glm::vec2 uv;
 };
 
+// Compact layout, 20 bytes instead of 44. Positions are 16 bit unorm relative to the mesh bounds,
+// normal and tangent are octahedral encoded snorm16, uv is half float. Decoded in ModelInputVertex.glsl.
+struct PackedVertex {
+	uint16_t position[4];
+	int16_t normal[2];
+	int16_t tangent[2];
+	uint16_t uv[2];
+};
+
 struct AABB {
 	glm::vec3 min;
 	glm::vec3 max;
 };
 
+// Bounds of `bounds` after transforming it by `transform`
+AABB TransformBounds(const AABB& bounds, const glm::mat4& transform);
+
+constexpr int MAX_MESH_LODS = 8;
+
+// A range of the mesh index buffer. LOD 0 is the full mesh, the others are simplified versions
+// referencing the same vertices, `error` is relative to the mesh extents.
+struct MeshLod
+{
+	uint32_t indexOffset;
+	uint32_t indexCount;
+	float error;
+};
+
 struct Mesh
 {
-	Geometry* geometry;
+	uint32_t baseVertex;	// into the model's MeshArena
+	uint32_t firstIndex;
 	AABB bounds;
-	Texture2D* textures[6];
+	StreamedTexture* textures[6];	// referenced through Model::textures, may still be loading
 	bool visible;
+	MeshLod lods[MAX_MESH_LODS];
+	uint32_t lodCount;
+	uint32_t firstMeshlet;	// into Model::meshlets, meshlets split LOD 0
+	uint32_t meshletCount;
+};
+
+// One placement of a mesh in the scene, meshes referenced by several nodes have several
+struct MeshInstance
+{
+	uint32_t mesh;
 	glm::mat4 transform;
 };
 
-struct aiMesh;
-struct aiScene;
-struct aiNode;
+// Non-owning view of one processed mesh, either in a MeshData or in a mapped MeshCache
+struct MeshView
+{
+	const void* vertices;		// MeshVertex or PackedVertex, see vertexStride
+	size_t vertexCount;
+	size_t vertexStride;
+	const unsigned int* indices;
+	size_t indexCount;
+	const MeshLod* lods;
+	size_t lodCount;
+	const Meshlet* meshlets;
+	size_t meshletCount;
+	AABB bounds;
+	const glm::mat4* transforms;	// one per instance
+	size_t transformCount;
+	std::string_view texturePaths[6];
+};
+
+// CPU side result of importing one mesh, nothing in here touches GL
+struct MeshData
+{
+	std::vector<MeshVertex> vertices;
+	std::vector<PackedVertex> packedVertices;	// used instead of vertices when importing packed
+	std::vector<unsigned int> indices;	// all LODs one after another
+	MeshLod lods[MAX_MESH_LODS];
+	uint32_t lodCount{ 0 };
+	std::vector<Meshlet> meshlets;		// LOD 0 indices are stored in meshlet order when present
+	AABB bounds;
+	std::vector<glm::mat4> transforms;	// every node referencing the mesh
+	std::string texturePaths[6];
+
+	MeshView View() const;
+
+	// Heap memory held by the vectors above
+	size_t GetResidentBytes() const;
+};
+
+struct ModelData
+{
+	std::vector<MeshData> meshes;
+	AABB bounds;		// of all instances, in model space
+	bool packedVertices{ false };
+};
+
+struct ImportSettings
+{
+	float scale{ 1.0f };
+	bool packVertices{ false };
+	bool generateLods{ false };
+	bool buildMeshlets{ false };
+};
+
+// What an import knows once the file is parsed, before any mesh is processed
+struct ImportInfo
+{
+	size_t meshCount;
+	AABB bounds;			// of all instances, in model space
+	bool packedVertices;
+	size_t vertexCount;		// upper bounds, for sizing buffers up front
+	size_t indexCount;
+};
+
+// Receives each processed mesh by index, on the importing threads and in no particular order.
+// The mesh may be moved from. Returning false cancels the import.
+using MeshSink = std::function<bool(size_t index, MeshData& mesh)>;
+
+class MemoryBudget;
+
+// Shared between an import running on a worker thread and whoever is waiting for it
+struct ImportProgress
+{
+	std::atomic<float> parsing{};			// 0..1 as reported by Assimp
+	std::atomic<size_t> processedMeshes{};
+	std::atomic<size_t> totalMeshes{};
+	std::atomic<bool> cancel{};
+};
 
 struct Model
 {
 	std::vector<Mesh> meshes;
+	std::vector<MeshInstance> instances;
+	std::vector<Meshlet> meshlets;
+	std::unordered_map<std::string, StreamedTexture*> textures;	// one TextureStreamer reference per path
 	AABB bounds;
+	bool packedVertices{ false };
+	MeshArena* arena{ nullptr };
 
-	bool Load(const char* root, const char* filename, float scale = 1.0f);
+	bool Load(const char* root, const char* filename, const ImportSettings& settings = {});
 
 	void Destroy();
 
-	void ProcessMesh(aiMesh* mesh, const aiScene* scene, const char* root, const glm::mat4& transform);
-	void ProcessNode(aiNode* node, const aiScene* scene, const char* root, const glm::mat4& transform);
-};
\ No newline at end of file
+	// Parses and optimizes the file into `data`. Does not touch GL, safe to run on a worker thread.
+	static bool Import(const char* root, const char* filename, const ImportSettings& settings, ModelData& data, ImportProgress* progress = nullptr);
+
+	// Same as Import, but hands every mesh to `onMesh` as soon as it is processed and frees the
+	// parsed source mesh right away, so only the meshes in flight are in memory at once.
+	// With a budget, processing waits until the memory of a mesh fits into it. The processed meshes
+	// stay counted against the budget until the receiver releases their GetResidentBytes.
+	static bool ImportStreaming(const char* root, const char* filename, const ImportSettings& settings,
+		const std::function<bool(const ImportInfo&)>& onParsed, const MeshSink& onMesh,
+		ImportProgress* progress = nullptr, MemoryBudget* budget = nullptr);
+
+	// Key of this file in the MeshCache, includes the import flags and settings.
+	static uint64_t GetCacheKey(const char* root, const char* filename, const ImportSettings& settings);
+
+	// Uploads one imported mesh and queues its textures on the TextureStreamer, has to run on the GL thread.
+	void AddMesh(const MeshView& data);
+};
@@ -0,0 +1,200 @@
+#include "ModelImport.h"
+#include "Utils.h"
+
+ModelImport::ModelImport(const std::string& root, const std::string& filename, const ImportSettings& settings, size_t memoryBudget)
+	: root(root), filename(filename), memory(memoryBudget)
+{
+	task = std::async(std::launch::async, [this, settings] {
+		auto key = Model::GetCacheKey(this->root.c_str(), this->filename.c_str(), settings);
+
+		if (cache.Open(key))
+		{
+			fromCache = true;
+			info.meshCount = cache.GetMeshCount();
+			info.bounds = cache.GetBounds();
+			info.packedVertices = cache.HasPackedVertices();
+			cache.GetTotalCounts(info.vertexCount, info.indexCount);
+
+			progress.parsing = 1.0f;
+			progress.totalMeshes = cache.GetMeshCount();
+			progress.processedMeshes = cache.GetMeshCount();
+			parsed = true;
+			return true;
+		}
+
+		// the cache entry is written mesh by mesh as well, so it never needs the whole model either
+		MeshCache::Writer writer;
+		std::mutex writer_mutex;
+		bool caching = false;
+
+		auto on_parsed = [&](const ImportInfo& parsed_info) {
+			info = parsed_info;
+			caching = writer.Begin(key, info.meshCount, info.packedVertices);
+			parsed = true;
+			return true;
+		};
+
+		auto on_mesh = [&](size_t index, MeshData& mesh) {
+			{
+				std::lock_guard lock(writer_mutex);
+				if (caching)
+					caching = writer.AddMesh(index, mesh.View());
+			}
+
+			std::lock_guard lock(readyMutex);
+			ready.push_back(std::move(mesh));
+			return true;
+		};
+
+		if (!Model::ImportStreaming(this->root.c_str(), this->filename.c_str(), settings, on_parsed, on_mesh, &progress, &memory))
+			return false;
+
+		if (caching)
+			writer.Finish(info.bounds);
+
+		return true;
+	});
+}
+
+ModelImport::~ModelImport()
+{
+	progress.cancel = true;
+	memory.Cancel();
+	if (task.valid())
+		task.wait();
+
+	if (model)
+	{
+		model->Destroy();
+		delete model;
+	}
+}
+
+bool ModelImport::IsTaskFinished()
+{
+	if (!taskFinished && task.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+	{
+		taskFinished = true;
+		taskSucceeded = task.get();
+	}
+
+	return taskFinished;
+}
+
+bool ModelImport::Update(size_t byteBudget)
+{
+	if (done)
+		return true;
+
+	if (model == nullptr)
+	{
+		// uploading starts as soon as the mesh count and bounds are known
+		if (!parsed)
+		{
+			if (IsTaskFinished())
+				failed = done = true;
+			return done;
+		}
+
+		model = new Model;
+		model->bounds = info.bounds;
+		model->packedVertices = info.packedVertices;
+		model->meshes.reserve(info.meshCount);
+
+		// size the arena once so it does not regrow while meshes trickle in
+		model->arena = new MeshArena(model->packedVertices ? sizeof(PackedVertex) : sizeof(MeshVertex));
+		model->arena->Reserve(info.vertexCount, info.indexCount);
+	}
+
+	// always upload at least one mesh so a mesh larger than the budget still gets through
+	size_t uploaded_bytes = 0;
+	while (uploadedMeshes < info.meshCount && (uploaded_bytes == 0 || uploaded_bytes < byteBudget))
+	{
+		MeshView mesh;
+		MeshData data;
+
+		if (fromCache)
+		{
+			if (!cache.GetMesh(uploadedMeshes, mesh))
+			{
+				failed = done = true;
+				return true;
+			}
+		}
+		else
+		{
+			{
+				std::lock_guard lock(readyMutex);
+				if (ready.empty())
+					break;
+
+				data = std::move(ready.front());
+				ready.pop_front();
+			}
+
+			mesh = data.View();
+		}
+
+		model->AddMesh(mesh);
+		uploadedMeshes++;
+
+		uploaded_bytes += mesh.vertexCount * mesh.vertexStride + mesh.indexCount * sizeof(unsigned int);
+
+		// the GPU has its copy now, which makes room for the next mesh
+		if (!fromCache)
+		{
+			auto resident_bytes = data.GetResidentBytes();
+			data = {};
+			memory.Release(resident_bytes);
+		}
+	}
+
+	// a failed or cancelled import never delivers the rest, a successful one still finishes its cache entry
+	if (!IsTaskFinished())
+		return false;
+
+	if (!taskSucceeded)
+	{
+		failed = done = true;
+		return true;
+	}
+
+	if (uploadedMeshes < info.meshCount)
+		return false;
+
+	// textures keep streaming in through the TextureStreamer from here on
+	cache.Close();
+	processPeakMemory = get_peak_memory_usage();
+	done = true;
+	return true;
+}
+
+float ModelImport::GetProgress() const
+{
+	// parsing, processing and uploading weigh about the same on large files
+	float parsing = progress.parsing;
+	auto total = progress.totalMeshes.load();
+	float processing = total ? float(progress.processedMeshes) / float(total) : 0.0f;
+	float uploading = model && info.meshCount ? float(uploadedMeshes) / float(info.meshCount) : 0.0f;
+	return (parsing + processing + uploading) / 3.0f;
+}
+
+const char* ModelImport::GetStatus() const
+{
+	if (failed)
+		return "Failed";
+	if (done)
+		return "Done";
+	if (!parsed)
+		return "Parsing";
+	if (progress.processedMeshes < progress.totalMeshes)
+		return "Processing";
+	return "Uploading";
+}
+
+Model* ModelImport::TakeModel()
+{
+	auto m = model;
+	model = nullptr;
+	return m;
+}
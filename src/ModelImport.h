@@ -0,0 +1,72 @@
+#pragma once
+#include "Model.h"
+#include "MeshCache.h"
+#include "MemoryBudget.h"
+
+#include <atomic>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+
+// Imports a model on a background thread and uploads it to the GPU a few meshes per frame.
+// Meshes stream through one at a time: each is uploaded and freed while later ones are still
+// being processed, and processing waits whenever the meshes in flight would exceed the memory budget.
+// The caller keeps drawing whatever it had until Update reports the import as finished.
+class ModelImport
+{
+public:
+	static constexpr size_t DEFAULT_MEMORY_BUDGET = size_t(512) * 1024 * 1024;
+
+	ModelImport(const std::string& root, const std::string& filename, const ImportSettings& settings = {},
+		size_t memoryBudget = DEFAULT_MEMORY_BUDGET);
+	~ModelImport();
+
+	ModelImport(const ModelImport&) = delete;
+	ModelImport& operator=(const ModelImport&) = delete;
+
+	// Uploads finished meshes until about `byteBudget` bytes went to the GPU this call.
+	// Returns true once the import is done, successfully or not.
+	bool Update(size_t byteBudget);
+
+	bool Failed() const { return failed; }
+	float GetProgress() const;
+	const char* GetStatus() const;
+	const std::string& GetFileName() const { return filename; }
+
+	// Most CPU memory the import held at once: parsed source meshes plus processed meshes waiting
+	// for upload. The process wide peak is reported next to it since the parser's own is not included.
+	size_t GetPeakMemory() const { return memory.GetPeak(); }
+	size_t GetMemoryBudget() const { return memory.GetLimit(); }
+	size_t GetProcessPeakMemory() const { return processPeakMemory; }
+
+	// Hands over the finished model, the import no longer owns it afterwards.
+	Model* TakeModel();
+
+private:
+	bool IsTaskFinished();
+
+	std::string root;
+	std::string filename;
+
+	ImportProgress progress;
+	MemoryBudget memory;
+	std::future<bool> task;
+	MeshCache cache;
+
+	// written by the task before `parsed` is set, read only afterwards
+	ImportInfo info{};
+	bool fromCache{ false };
+	std::atomic<bool> parsed{ false };
+
+	std::mutex readyMutex;
+	std::deque<MeshData> ready;		// processed, waiting for upload
+
+	Model* model{ nullptr };
+	size_t uploadedMeshes{ 0 };
+	size_t processPeakMemory{ 0 };
+	bool taskFinished{ false };
+	bool taskSucceeded{ false };
+	bool failed{ false };
+	bool done{ false };
+};
@@ -6,6 +6,8 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <imgui.h>
 
+#include <algorithm>
+
 void ModelInputRenderPass::Init()
 {
 	RenderPass::Init();
@@ -39,19 +41,80 @@ void ModelInputRenderPass::Init()
 			shader->SetFragmentSource(source);
 		}
 
-		shader->Link(nullptr, nullptr);
+		if (shader->Link(nullptr, nullptr))
+			shader->ReflectSamplers();
+
 		shader->SetName("Model Input");
 	}
 
+	// VertexInput only describes float attributes, the exact formats, the shared vertex buffer
+	// binding and the per draw mesh index are set on its vertex array directly
 	vertexInput = new VertexInput();
 	vertexInput->AddVec3();
 	vertexInput->AddVec3();
 	vertexInput->AddVec3();
 	vertexInput->AddVec2();
+	vertexInput->Bind();
+	MeshDrawList::SetupVertexInput(false);
+
+	packedVertexInput = new VertexInput();
+	packedVertexInput->AddVec4();
+	packedVertexInput->AddVec2();
+	packedVertexInput->AddVec2();
+	packedVertexInput->AddVec2();
+	packedVertexInput->Bind();
+	MeshDrawList::SetupVertexInput(true);
+
+	glBindVertexArray(0);
+}
+
+void ModelInputRenderPass::UpdateImport()
+{
+	if (!pendingImport || !pendingImport->Update(size_t(uploadBudgetMB) * 1024 * 1024))
+		return;
+
+	if (pendingImport->Failed())
+	{
+		Application::Log("Failed to import %s\n", pendingImport->GetFileName().c_str());
+	}
+	else
+	{
+		if (model)
+		{
+			// drops the bindless handles before the textures go away
+			drawList.Clear();
+			model->Destroy();
+			delete model;
+		}
+
+		model = pendingImport->TakeModel();
+		modelDirty = true;
+
+		importPeakMemory = pendingImport->GetPeakMemory();
+		processPeakMemory = pendingImport->GetProcessPeakMemory();
+		Application::Log("Imported %s, peak import memory %.1f MB (budget %.1f MB), process peak %.1f MB\n",
+			pendingImport->GetFileName().c_str(), importPeakMemory / (1024.0 * 1024.0),
+			pendingImport->GetMemoryBudget() / (1024.0 * 1024.0), processPeakMemory / (1024.0 * 1024.0));
+
+		cameraOffsetY = abs(model->bounds.min.y) * 0.5f;
+		cameraOffsetZ = abs(model->bounds.min.z) * 2.5f;
+
+		cameraPosition = {0, 0, 0};
+		cameraRotation = {0, 0, 0};
+		objectPosition = {0, 0, 0};
+		objectRotation = {0, 0, 0};
+		objectScale = {1, 1, 1};
+	}
+
+	delete pendingImport;
+	pendingImport = nullptr;
 }
 
 void ModelInputRenderPass::Draw()
 {
+	// the previous model keeps drawing until the new one is fully uploaded
+	UpdateImport();
+
 	if (model != nullptr && shader->IsValid())
 	{
 		output->ClearAttachments();
@@ -84,6 +147,9 @@ void ModelInputRenderPass::Draw()
 
 		shader->UniformMat4("u_ModelMatrix", glm::value_ptr(modelMatrix));
 
+		auto modelViewMatrix = viewMatrix * modelMatrix;
+		float projectionScale = projectionMatrix[1][1] * float(output->GetHeight()) * 0.5f;
+
 		auto app = Application::instance;
 
 		float resolution[3] = { float(output->GetWidth()), float(output->GetHeight()) , 0.0f };
@@ -94,29 +160,17 @@ void ModelInputRenderPass::Draw()
 			float channelResolutions[16 * 3] = {};
 			float channelTimes[16] = {};
 
-			int i = 0;
-			for (auto& c : channels)
+			for (int i = 0; i < int(channels.size()); i++)
 			{
-				if (c == nullptr || c->texture == nullptr) continue;
-				if (c->type == ChannelType::EXTERNAL_IMAGE)
-				{
-					channelResolutions[i + 0] = (float)c->texture->GetWidth();
-					channelResolutions[i + 1] = (float)c->texture->GetHeight();
-					channelResolutions[i + 2] = 0.0f;
-				}
-				else if (c->type == ChannelType::RENDERPASS)
-				{
-					channelResolutions[i + 0] = (float)c->pass->GetOutput()->GetWidth();
-					channelResolutions[i + 1] = (float)c->pass->GetOutput()->GetHeight();
-					channelResolutions[i + 2] = 0.0f;
-				}
+				auto c = channels[i];
+				GetChannelResolution(i, channelResolutions + i * 3);
 
-				channelTimes[i] = app->time;
-				i++;
+				// videos loop, their channel time is that of the frame on screen
+				channelTimes[i] = c && c->type == ChannelType::VIDEO && c->video ? c->video->GetFrameTime() : app->time;
 			}
 
 			shader->UniformVec3Array("iChannelResolution", 16, channelResolutions);
-			shader->UniformVec3Array("iChannelTime", 16, channelTimes);
+			shader->UniformFloatArray("iChannelTime", 16, channelTimes);
 		}
 
 		shader->UniformVec3("iResolution", resolution);
@@ -129,29 +183,79 @@ void ModelInputRenderPass::Draw()
 
 		shader->Bind();
 
-		glEnable(GL_DEPTH_TEST);
-		vertexInput->Bind();
-		for (const auto& mesh : model->meshes)
+		auto input = model->packedVertices ? packedVertexInput : vertexInput;
+		shader->UniformInt("u_PackedVertices", model->packedVertices ? 1 : 0);
+
+		if (modelDirty)
+		{
+			culling.Build(*model, useBvh);
+			drawList.Build(*model);
+			modelDirty = false;
+		}
+
+		if (frustumCulling)
+			culling.Cull(projectionMatrix * modelViewMatrix, instanceVisibility);
+		else
+			instanceVisibility.assign(model->instances.size(), 1);
+
+		drawnInstances = 0;
+		culledInstances = 0;
+
+		drawList.Begin();
+		if (clusterCulling)
+			drawList.SetClusterView(modelViewMatrix, projectionMatrix);
+
+		for (size_t i = 0; i < model->instances.size(); i++)
 		{
+			const auto& instance = model->instances[i];
+			const auto& mesh = model->meshes[instance.mesh];
 			if (!mesh.visible)
 				continue;
 
-			mesh.geometry->Bind(vertexInput, sizeof(MeshVertex));
-			
-			for (int i = 0; i < 5; i++)
+			if (!instanceVisibility[i])
 			{
-				if (mesh.textures[i] != nullptr)
-				{
-					mesh.textures[i]->Bind(i);
-				}
+				culledInstances++;
+				continue;
 			}
 
-			glDrawElements(GL_TRIANGLES, mesh.geometry->GetIndicesCount(), GL_UNSIGNED_INT, mesh.geometry->GetIndicesOffset());
+			auto lod = SelectLod(mesh, modelViewMatrix * instance.transform, projectionScale);
+			drawList.Add(uint32_t(i), instance.mesh, lod);
+
+			drawnInstances++;
 		}
+
+		glEnable(GL_DEPTH_TEST);
+		input->Bind();
+		drawList.Submit(*model);
 		glDisable(GL_DEPTH_TEST);
 	}
 }
 
+uint32_t ModelInputRenderPass::SelectLod(const Mesh& mesh, const glm::mat4& modelViewMatrix, float projectionScale) const
+{
+	if (forcedLod >= 0)
+		return std::min(uint32_t(forcedLod), mesh.lodCount - 1);
+
+	// bounding sphere of the AABB in view space
+	auto center = glm::vec3(modelViewMatrix * glm::vec4((mesh.bounds.min + mesh.bounds.max) * 0.5f, 1.0f));
+	float scale = glm::max(glm::length(glm::vec3(modelViewMatrix[0])),
+		glm::max(glm::length(glm::vec3(modelViewMatrix[1])), glm::length(glm::vec3(modelViewMatrix[2]))));
+	float radius = glm::length(mesh.bounds.max - mesh.bounds.min) * 0.5f * scale;
+	float distance = glm::length(center);
+
+	if (distance <= radius)
+		return 0;
+
+	// projected diameter in pixels, LOD errors are relative to the mesh size so this turns them into pixels
+	float screenSize = 2.0f * radius * projectionScale / distance;
+
+	uint32_t lod = 0;
+	while (lod + 1 < mesh.lodCount && mesh.lods[lod + 1].error * screenSize <= lodErrorPixels)
+		lod++;
+
+	return lod;
+}
+
 void ModelInputRenderPass::OnImGui()
 {
 	auto size = ImVec2{ 120, 120 };
@@ -184,34 +288,17 @@ void ModelInputRenderPass::OnImGui()
 		{
 			if (item.ends_with(".gltf") || item.ends_with(".fbx") || item.ends_with(".obj"))
 			{
-				auto m = new Model;
-
 				std::filesystem::path full_path(item);
 				auto root = full_path.parent_path().string();
 				auto file_name = full_path.filename().string();
 
-				if (!m->Load(root.c_str(), file_name.c_str()))
-				{
-					delete m;
-					continue;
-				}
-				
-				if (model) 
-				{
-					model->Destroy();
-					delete model;
-				}
-
-				model = m;
-
-				cameraOffsetY = abs(model->bounds.min.y) * 0.5f;
-				cameraOffsetZ = abs(model->bounds.min.z) * 2.5f;
-
-				cameraPosition = {0, 0, 0};
-				cameraRotation = {0, 0, 0};
-				objectPosition = {0, 0, 0};
-				objectRotation = {0, 0, 0};
-				objectScale = {1, 1, 1};
+				// replacing an import that has not finished yet cancels it
+				delete pendingImport;
+				ImportSettings settings;
+				settings.packVertices = packVertices;
+				settings.generateLods = generateLods;
+				settings.buildMeshlets = buildMeshlets;
+				pendingImport = new ModelImport(root, file_name, settings, size_t(importMemoryBudgetMB) * 1024 * 1024);
 
 				break;
 			}
@@ -220,10 +307,70 @@ void ModelInputRenderPass::OnImGui()
 		Application::instance->drop_items.clear();
 	}
 
+	if (pendingImport)
+	{
+		ImGui::Text("%s %s", pendingImport->GetStatus(), pendingImport->GetFileName().c_str());
+		ImGui::ProgressBar(pendingImport->GetProgress());
+	}
+
+	ImGui::DragInt("Upload Budget (MB / frame)", &uploadBudgetMB, 1.0f, 1, 1024);
+	ImGui::DragInt("Texture Upload Budget (MB / frame)", &Application::instance->textureUploadBudgetMB, 1.0f, 1, 1024);
+	ImGui::DragInt("Texture Memory Budget (MB)", &Application::instance->textureMemoryBudgetMB, 8.0f, 64, 65536);
+	ImGui::SetItemTooltip("Textures and pass outputs, textures not drawn for a while lose mips or are evicted above it");
+	{
+		auto streamer = TextureStreamer::Get();
+		auto used = streamer->GetTextureBytes() + streamer->GetAttachmentBytes();
+		auto budget = streamer->GetMemoryBudget();
+
+		char label[96];
+		snprintf(label, sizeof(label), "%.1f / %.0f MB (pass outputs %.1f MB)", used / (1024.0 * 1024.0),
+			budget / (1024.0 * 1024.0), streamer->GetAttachmentBytes() / (1024.0 * 1024.0));
+		ImGui::ProgressBar(budget ? float(double(used) / double(budget)) : 0.0f, ImVec2(-FLT_MIN, 0.0f), label);
+
+		size_t reduced = 0, evicted = 0;
+		streamer->GetEvictedCounts(reduced, evicted);
+		if (reduced + evicted > 0)
+			ImGui::Text("Textures at lower mips: %zu, evicted: %zu", reduced, evicted);
+	}
+	ImGui::DragInt("Import Memory Budget (MB)", &importMemoryBudgetMB, 4.0f, 16, 16384);
+	ImGui::SetItemTooltip("Processed meshes waiting for upload are held to about this much, applies to the next dropped model");
+	if (importPeakMemory > 0)
+	{
+		ImGui::Text("Last import peak: %.1f MB, process peak: %.1f MB",
+			importPeakMemory / (1024.0 * 1024.0), processPeakMemory / (1024.0 * 1024.0));
+	}
+	ImGui::Checkbox("Compact Vertices", &packVertices);
+	ImGui::SetItemTooltip("Quantized 20 byte vertices instead of 44, applies to the next dropped model");
+	ImGui::Checkbox("Generate LODs", &generateLods);
+	ImGui::SetItemTooltip("Simplified versions of every mesh, applies to the next dropped model");
+	ImGui::Checkbox("Build Meshlets", &buildMeshlets);
+	ImGui::SetItemTooltip("Splits meshes into clusters of up to 124 triangles for cluster culling, applies to the next dropped model");
+
+	ImGui::DragFloat("LOD Error (px)", &lodErrorPixels, 0.05f, 0.0f, 64.0f);
+	ImGui::SliderInt("Force LOD", &forcedLod, -1, MAX_MESH_LODS - 1, forcedLod < 0 ? "Auto" : "%d");
+
 	if (model)
 	{
 		ImGui::SeparatorText("Meshes");
 
+		ImGui::Checkbox("Frustum Culling", &frustumCulling);
+		ImGui::SameLine();
+		if (ImGui::Checkbox("BVH", &useBvh))
+			modelDirty = true;
+		ImGui::SetItemTooltip("Culls groups of meshes at once, pays off with thousands of meshes");
+		ImGui::Checkbox("Cluster Culling", &clusterCulling);
+		ImGui::SetItemTooltip("Frustum and backface culls the meshlets of full detail meshes, %s",
+			drawList.IsClusterCullingOnGpu() ? "in a compute shader" : "on the CPU");
+
+		ImGui::Text("Meshes: %zu, instances: %zu", model->meshes.size(), model->instances.size());
+		ImGui::Text("Instances drawn: %zu, culled: %zu", drawnInstances, culledInstances);
+		ImGui::Text("Triangles submitted: %zu, rendered: %zu", drawList.GetSubmittedTriangles(), drawList.GetRenderedTriangles());
+		ImGui::Text("Draw calls: %zu (%s textures)", drawList.GetDrawCalls(), MeshDrawList::IsBindless() ? "bindless" : "grouped");
+
+		auto streamer = TextureStreamer::Get();
+		if (auto pending = streamer->GetPendingCount())
+			ImGui::Text("Textures loading: %zu (%u decode threads)", pending, streamer->GetThreadCount());
+
 		for (size_t i = 0; i < model->meshes.size(); i++)
 		{
 			if (ImGui::TreeNode((void*)(model + i), "Mesh %d", (int)(i + 1)))
@@ -234,6 +381,14 @@ void ModelInputRenderPass::OnImGui()
 				ImGui::Checkbox("Visible", &mesh.visible);
 				ImGui::PopID();
 
+				for (uint32_t j = 0; j < mesh.lodCount; j++)
+				{
+					ImGui::Text("LOD %u: %u triangles, error %.4f", j, mesh.lods[j].indexCount / 3, mesh.lods[j].error);
+				}
+
+				if (mesh.meshletCount > 0)
+					ImGui::Text("Meshlets: %u", mesh.meshletCount);
+
 				const char* names[6] = {
 					"Diffuse / Base Color",
 					"Specular / Metallness",
@@ -245,11 +400,19 @@ void ModelInputRenderPass::OnImGui()
 
 				for (int j = 0; j < 6; j++)
 				{
-					if (mesh.textures[j] != nullptr)
+					auto texture = mesh.textures[j];
+					if (texture == nullptr)
+						continue;
+
+					ImGui::Text("%s", names[j]);
+					if (texture->IsReady())
 					{
-						ImGui::Text("%s", names[j]);
-						auto id = mesh.textures[j]->GetID();
-						ImGui::Image(((ImTextureID)(id)), size, { 0, 1 }, { 1, 0 });
+						// streamed textures are stored top row first, like ImGui expects
+						ImGui::Image(ImTextureID(texture->id), size);
+					}
+					else
+					{
+						ImGui::TextDisabled("Loading %s", texture->path.c_str());
 					}
 				}
 
@@ -260,110 +423,16 @@ void ModelInputRenderPass::OnImGui()
 
 	ImGui::SeparatorText("Channels");
 
-	{
-		ImGui::Columns(2);
-
-		auto size = ImVec2{ 120, 120 };
-
-		for (int i = 0; i < channels.size(); i++)
-		{
-			if (i > 7) 
-			{
-				ImGui::Text("Channel %d", i);
-
-				auto channel = channels[i];
-				auto is_image_clicked = false;
-
-				char buff[128];
-				sprintf_s(buff, "%sChannel%d%d", name.c_str(), i, int(this));
-				if (channel && channel->type == ChannelType::EXTERNAL_IMAGE && channel->texture)
-				{
-					is_image_clicked = ImGui::ImageButton(buff, ((ImTextureID)(channel->texture->GetID())), size, { 0, 1 }, { 1, 0 });
-				}
-				else if (channel && channel->type == ChannelType::RENDERPASS && channel->pass)
-				{
-					auto& [texture, is_draw] = channel->pass->GetOutput()->GetColorAttachments()[0];
-					auto id = texture->GetID();
-					is_image_clicked = ImGui::ImageButton(buff,
-						((ImTextureID)(id)), size, { 0, 1 }, { 1, 0 });
-				}
-				else
-				{
-					is_image_clicked = ImGui::ImageButton(buff, null_image, size);
-				}
-
-				if (is_image_clicked)
-				{
-					open_channel_settings = true;
-					selected_channel = i;
-				}
-
-				if (ImGui::BeginDragDropTarget())
-				{
-					auto payload = ImGui::AcceptDragDropPayload("dropped_files");
-					ImGui::EndDragDropTarget();
-
-					for (const auto& item : Application::instance->drop_items)
-					{
-						if (item.ends_with(".png") || item.ends_with(".jpg") || item.ends_with(".jpeg"))
-						{
-							auto c = new Channel;
-							c->texture = new Texture2D(item.c_str(), false);
-							c->type = ChannelType::EXTERNAL_IMAGE;
-							SetChannel(i, c);
-							break;
-						}
-					}
-
-					Application::instance->drop_items.clear();
-				}
-				ImGui::NextColumn();
-			}
-
-		}
-
-		ImGui::Columns(1);
-
-		if (open_channel_settings)
-		{
-			ImGui::OpenPopup("Channel Settings");
-			ImVec2 center(ImGui::GetIO().DisplaySize.x * 0.5f, ImGui::GetIO().DisplaySize.y * 0.5f);
-			ImGui::SetNextWindowPos(center, ImGuiCond_Appearing, ImVec2(0.5f, 0.5f));
-			if (ImGui::BeginPopupModal("Channel Settings", &open_channel_settings, ImGuiWindowFlags_AlwaysAutoResize))
-			{
-				ImGui::Text("%s Channel %d Settings", GetName().c_str(), selected_channel);
+	ImGui::Columns(2);
 
-				auto c = GetChannel(selected_channel);
-
-				ImGui::Combo("Channel Type", (int*)(&c->type), "ImageFile\0RenderPass\0");
-
-				if (c->type == ChannelType::RENDERPASS)
-				{
-					static int current_item = 0;
-
-					if (ImGui::BeginCombo("Render Pass", c->pass ? c->pass->GetName().c_str() : "Select Render Pass"))
-					{
-						for (size_t i = 0; i < Application::instance->passes.size(); i++)
-						{
-							bool selected = c->pass == Application::instance->passes[i];
-							if (ImGui::Selectable(Application::instance->passes[i]->GetName().c_str(), selected))
-							{
-								c->pass = Application::instance->passes[i];
-							}
-						}
-						ImGui::EndCombo();
-					}
-				}
-				else
-				{
-					c->pass = nullptr;
-				}
-
-				ImGui::EndPopup();
-			}
-		}
+	// the lower channels are not editable here, units 0-5 hold the mesh textures
+	for (int i = 8; i < channels.size(); i++)
+	{
+		OnChannelImGui(i, false);
+		ImGui::NextColumn();
 	}
 
+	ImGui::Columns(1);
 
-
+	OnChannelSettingsImGui();
 }
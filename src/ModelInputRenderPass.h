@@ -1,6 +1,9 @@
 #pragma once
 #include "RenderPass.h"
 #include "Model.h"
+#include "ModelImport.h"
+#include "MeshCulling.h"
+#include "MeshDrawList.h"
 #include "JinGL/VertexInput.h"
 
 class ModelInputRenderPass : public RenderPass {
@@ -9,13 +12,38 @@ public:
 	virtual void Init() override;
 	virtual void Draw() override;
 	virtual void OnImGui() override;
+	virtual size_t GetOutputBytes() override { return GetFramebufferBytes(output, true); }
 
-	inline void SetModel(Model* model) { this->model = model; }
+	inline void SetModel(Model* model) { this->model = model; modelDirty = true; }
 	inline void SetVertexInput(VertexInput* vertexInput) { this->vertexInput = vertexInput; }
 
 private:
-	Model* model;
+	void UpdateImport();
+	uint32_t SelectLod(const Mesh& mesh, const glm::mat4& modelViewMatrix, float projectionScale) const;
+
+	Model* model{ nullptr };
+	ModelImport* pendingImport{ nullptr };
+	int uploadBudgetMB{ 64 };
+	int importMemoryBudgetMB{ 512 };
+	size_t importPeakMemory{ 0 };
+	size_t processPeakMemory{ 0 };
+	bool packVertices{ false };
+	bool generateLods{ false };
+	bool buildMeshlets{ false };
+	float lodErrorPixels{ 1.0f };
+	int forcedLod{ -1 };
+
+	MeshCulling culling;
+	MeshDrawList drawList;
+	std::vector<uint8_t> instanceVisibility;
+	bool frustumCulling{ true };
+	bool useBvh{ true };
+	bool clusterCulling{ true };
+	bool modelDirty{ true };
+	size_t drawnInstances{ 0 };
+	size_t culledInstances{ 0 };
 	VertexInput* vertexInput;
+	VertexInput* packedVertexInput;
 	
 	glm::vec3 cameraPosition{};
 	glm::vec3 cameraRotation{};
@@ -26,7 +54,5 @@ private:
 
 	float cameraOffsetY;
 	float cameraOffsetZ;
-	bool open_channel_settings{ false };
-	int selected_channel{ 0 };
 
 };
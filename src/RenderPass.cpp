@@ -1,4 +1,154 @@
 #include "RenderPass.h"
+#include "Application.h"
+#include "FloatImage.h"
+#include "JinGL/JinGL.h"
+#include "Utils.h"
+#include <imgui.h>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+
+namespace
+{
+	// pages copied into a virtual texture's atlas per frame, 64 KB each
+	constexpr int VIRTUAL_PAGE_UPLOADS = 16;
+
+	bool IsIdentifierChar(char c)
+	{
+		return isalnum((unsigned char)c) || c == '_';
+	}
+
+	size_t SkipSpaces(const std::string& text, size_t at)
+	{
+		while (at < text.size() && isspace((unsigned char)text[at]))
+			at++;
+		return at;
+	}
+
+	// Top left corners of the faces in GL order +X -X +Y -Y +Z -Z, in a horizontal cross or a strip of six
+	bool GetCubemapFaces(int width, int height, int corners[6][2], int& size)
+	{
+		static const int cross[6][2] = { { 2, 1 }, { 0, 1 }, { 1, 0 }, { 1, 2 }, { 1, 1 }, { 3, 1 } };
+
+		for (int face = 0; face < 6; face++)
+		{
+			if (width * 3 == height * 4)
+			{
+				size = width / 4;
+				corners[face][0] = cross[face][0] * size;
+				corners[face][1] = cross[face][1] * size;
+			}
+			else if (width == height * 6 || height == width * 6)
+			{
+				size = std::min(width, height);
+				corners[face][0] = width > height ? face * size : 0;
+				corners[face][1] = width > height ? 0 : face * size;
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		return size > 0;
+	}
+
+	// Copies the faces of a cubemap image, or the square slices side by side of a volume image, into a
+	// texture of their own. Faces start at their top row like GL expects, slices keep the image's rows.
+	void LayOutChannelImage(Channel* c)
+	{
+		auto image = c->texture;
+		if (c->layoutTexture)
+			glDeleteTextures(1, &c->layoutTexture);
+
+		c->layoutTexture = 0;
+		c->layoutSource = image->id;
+
+		int corners[6][2] = {};
+		int size = 0, layers = 0;
+		bool cubemap = c->layout == ChannelDimension::CUBEMAP;
+		if (cubemap)
+		{
+			if (!GetCubemapFaces(image->width, image->height, corners, size))
+				return;
+			layers = 6;
+		}
+		else
+		{
+			size = image->height;
+			layers = size > 0 && image->width % size == 0 ? image->width / size : 0;
+		}
+
+		if (layers == 0)
+			return;
+
+		auto internal_format = image->format == TextureFormat::RGBA16F ? GL_RGBA16F : GL_RGBA8;
+		int levels = GetMipLevelCount(size, cubemap ? size : std::max(size, layers));
+
+		GLuint id = 0;
+		glCreateTextures(cubemap ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_3D, 1, &id);
+		if (cubemap)
+			glTextureStorage2D(id, levels, internal_format, size, size);
+		else
+			glTextureStorage3D(id, levels, internal_format, size, size, layers);
+
+		glTextureParameteri(id, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTextureParameteri(id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTextureParameteri(id, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+		// blits rather than image copies, they can turn the rows of flipped images around
+		GLuint framebuffers[2] = {};
+		glCreateFramebuffers(2, framebuffers);
+		glNamedFramebufferTexture(framebuffers[0], GL_COLOR_ATTACHMENT0, image->id, 0);
+
+		bool turn = cubemap && image->flipVertically;
+		for (int layer = 0; layer < layers; layer++)
+		{
+			int x = cubemap ? corners[layer][0] : layer * size;
+			int y = cubemap ? corners[layer][1] : 0;
+			if (image->flipVertically)
+				y = image->height - y - size;
+
+			glNamedFramebufferTextureLayer(framebuffers[1], GL_COLOR_ATTACHMENT0, id, 0, layer);
+			glBlitNamedFramebuffer(framebuffers[0], framebuffers[1], x, y, x + size, y + size,
+				0, turn ? size : 0, size, turn ? 0 : size, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		}
+
+		glDeleteFramebuffers(2, framebuffers);
+		glGenerateTextureMipmap(id);
+
+		c->layoutTexture = id;
+		c->layoutSize[0] = size;
+		c->layoutSize[1] = size;
+		c->layoutSize[2] = cubemap ? 0 : layers;
+	}
+
+	// One sampler object per filter and wrap combination, shared by every channel for the life of the context
+	GLuint GetSampler(ChannelFilter filter, ChannelWrap wrap)
+	{
+		static GLuint samplers[3][3] = {};
+
+		auto& sampler = samplers[int(filter)][int(wrap)];
+		if (sampler)
+			return sampler;
+
+		static const GLint min_filters[] = { GL_NEAREST, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR };
+		static const GLint mag_filters[] = { GL_NEAREST, GL_LINEAR, GL_LINEAR };
+		static const GLint wraps[] = { GL_CLAMP_TO_EDGE, GL_REPEAT, GL_MIRRORED_REPEAT };
+
+		glCreateSamplers(1, &sampler);
+		glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, min_filters[int(filter)]);
+		glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, mag_filters[int(filter)]);
+		glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, wraps[int(wrap)]);
+		glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, wraps[int(wrap)]);
+		glSamplerParameteri(sampler, GL_TEXTURE_WRAP_R, wraps[int(wrap)]);
+		return sampler;
+	}
+}
 
 void RenderPass::Init()
 {
@@ -17,33 +167,702 @@ void RenderPass::Resize(int width, int height) {
 	}
 }
 
+size_t GetFramebufferBytes(Framebuffer* framebuffer, bool depthStencil)
+{
+	if (framebuffer == nullptr)
+		return 0;
+
+	// every attachment is RGBA8, depth is 24 bit with 8 bit stencil
+	auto texels = size_t(framebuffer->GetWidth()) * size_t(framebuffer->GetHeight());
+	return texels * 4 * (framebuffer->GetColorAttachments().size() + (depthStencil ? 1 : 0));
+}
+
+size_t RenderPass::GetOutputBytes()
+{
+	return GetFramebufferBytes(output);
+}
+
+unsigned int RenderPass::GetOutputTexture()
+{
+	if (output == nullptr)
+		return 0;
+
+	auto& [texture, is_draw] = output->GetColorAttachments()[0];
+	return texture->GetID();
+}
+
+void RenderPass::GetOutputSize(int& width, int& height, int& depth)
+{
+	width = output ? output->GetWidth() : 0;
+	height = output ? output->GetHeight() : 0;
+	depth = 0;
+}
+
+unsigned int RenderPass::RequestOutputMipmaps()
+{
+	mipmapsRequested = true;
+	return mipmappedOutput;
+}
+
+void RenderPass::UpdateOutputMipmaps()
+{
+	auto source = GetOutputTexture();
+	if (!mipmapsRequested || source == 0)
+	{
+		// no channel sampled the mips since the last draw
+		if (mipmappedOutput)
+			glDeleteTextures(1, &mipmappedOutput);
+		mipmappedOutput = 0;
+		return;
+	}
+	mipmapsRequested = false;
+
+	int size[3] = {};
+	GetOutputSize(size[0], size[1], size[2]);
+
+	GLint format = 0;
+	glGetTextureLevelParameteriv(source, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+	if (format == GL_RGBA)
+		format = GL_RGBA8;
+
+	// the framebuffer attachment has a single level, so the mips go into a copy that follows its size
+	if (mipmappedOutput && (!std::equal(size, size + 3, mipmappedSize) || format != mipmappedFormat))
+	{
+		glDeleteTextures(1, &mipmappedOutput);
+		mipmappedOutput = 0;
+	}
+
+	auto dimension = GetOutputDimension();
+	if (mipmappedOutput == 0)
+	{
+		int levels = GetMipLevelCount(size[0], std::max(size[1], size[2]));
+		if (dimension == ChannelDimension::VOLUME)
+		{
+			glCreateTextures(GL_TEXTURE_3D, 1, &mipmappedOutput);
+			glTextureStorage3D(mipmappedOutput, levels, GLenum(format), size[0], size[1], size[2]);
+		}
+		else
+		{
+			glCreateTextures(dimension == ChannelDimension::CUBEMAP ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D, 1, &mipmappedOutput);
+			glTextureStorage2D(mipmappedOutput, levels, GLenum(format), size[0], size[1]);
+		}
+
+		glTextureParameteri(mipmappedOutput, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTextureParameteri(mipmappedOutput, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		std::copy_n(size, 3, mipmappedSize);
+		mipmappedFormat = format;
+	}
+
+	auto target = dimension == ChannelDimension::VOLUME ? GL_TEXTURE_3D : dimension == ChannelDimension::CUBEMAP ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
+	auto layers = dimension == ChannelDimension::VOLUME ? size[2] : dimension == ChannelDimension::CUBEMAP ? 6 : 1;
+	glCopyImageSubData(source, target, 0, 0, 0, 0, mipmappedOutput, target, 0, 0, 0, 0, size[0], size[1], layers);
+	glGenerateTextureMipmap(mipmappedOutput);
+}
+
+size_t RenderPass::GetOutputMipmapBytes()
+{
+	if (mipmappedOutput == 0)
+		return 0;
+
+	// a full chain adds a third, a volume's an eighth
+	auto texel_bytes = mipmappedFormat == GL_RGBA16F ? 8 : 4;
+	auto texels = size_t(mipmappedSize[0]) * size_t(mipmappedSize[1]) * size_t(std::max(mipmappedSize[2], 1));
+	if (GetOutputDimension() == ChannelDimension::CUBEMAP)
+		texels *= 6;
+	return GetOutputDimension() == ChannelDimension::VOLUME ? texels * texel_bytes * 8 / 7 : texels * texel_bytes * 4 / 3;
+}
+
 void RenderPass::SetChannel(int index, Channel* channel) {
 	auto& c = channels[index];
+	if (c == channel)
+		return;
+
 	if (c != nullptr)
 	{
-		if (c->type == ChannelType::EXTERNAL_IMAGE && c->texture)
-		{
-			delete c->texture;
-		}
+		// other channels and models may use the same image, this only drops our reference
+		TextureStreamer::Get()->Release(c->texture);
+		delete c->video;
+		delete c->virtualTexture;
+		if (c->layoutTexture)
+			glDeleteTextures(1, &c->layoutTexture);
 		delete c;
 	}
 	c = channel;
 }
 
 void RenderPass::BindChannels(int offset) {
+	if (!shader)
+		return;
+
+	// only the units the linked program samples from, in a single multi-bind call
+	auto active = shader->GetActiveSamplerMask();
+
+	GLuint textures[16] = {};
+	GLuint samplers[16] = {};
+	int first = int(channels.size());
+	int last = -1;
+
 	for (size_t i = 0; i < channels.size(); i++)
 	{
+		int unit = int(i) + offset;
+		if (unit >= 32 || (active & (1u << unit)) == 0)
+			continue;
+
+		first = std::min(first, int(i));
+		last = std::max(last, int(i));
+
 		auto& c = channels[i];
 		if (c != nullptr) {
-			if (c->type == ChannelType::EXTERNAL_IMAGE && c->texture)
+			if (c->type == ChannelType::EXTERNAL_IMAGE && c->layout != ChannelDimension::TEXTURE_2D)
+			{
+				textures[i] = GLuint(c->layoutTexture);
+			}
+			else if (c->type == ChannelType::EXTERNAL_IMAGE && c->texture)
 			{
-				c->texture->Bind(int(i) + offset);
+				TextureStreamer::Get()->Touch(c->texture);
+				textures[i] = GLuint(c->texture->id);
 			}
 			else if (c->type == ChannelType::RENDERPASS && c->pass)
 			{
-				auto& [texture, is_draw] = c->pass->GetOutput()->GetColorAttachments()[0];
-				texture->Bind(int(i) + offset);
+				// a mip chain costs a copy and a downsample per draw, so only while a channel filters with it
+				auto mipmapped = c->overrideSampler && c->filter == ChannelFilter::MIPMAP ? c->pass->RequestOutputMipmaps() : 0;
+				textures[i] = GLuint(mipmapped ? mipmapped : c->pass->GetOutputTexture());
+			}
+			else if (c->type == ChannelType::VIDEO && c->video)
+			{
+				textures[i] = GLuint(c->video->GetTextureID());
+			}
+			else if (c->type == ChannelType::VIRTUAL_TEXTURE && c->virtualTexture)
+			{
+				// the channel's own unit gets the atlas, its page table goes on a unit past the channels
+				textures[i] = GLuint(c->virtualTexture->GetAtlasTexture());
+
+				auto table_unit = VirtualTexture::PAGE_TABLE_BINDING + unsigned(i);
+				if (table_unit < 32 && (active & (1u << table_unit)) != 0)
+					glBindTextureUnit(table_unit, c->virtualTexture->GetPageTableTexture());
+			}
+
+			if (c->overrideSampler && textures[i])
+			{
+				// until the first mips are generated the output has a single level
+				auto filter = c->filter;
+				if (filter == ChannelFilter::MIPMAP && c->type == ChannelType::RENDERPASS && textures[i] == c->pass->GetOutputTexture())
+					filter = ChannelFilter::LINEAR;
+
+				samplers[i] = GetSampler(filter, c->wrap);
 			}
 		}
 	}
+
+	if (feedbackBuffer)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, VirtualTexture::FEEDBACK_BINDING, feedbackBuffer);
+
+	if (last >= first)
+	{
+		glBindTextures(GLuint(first + offset), GLsizei(last - first + 1), textures + first);
+		glBindSamplers(GLuint(first + offset), GLsizei(last - first + 1), samplers + first);
+	}
+}
+
+void RenderPass::UpdateChannels(float time)
+{
+	for (auto c : channels)
+	{
+		if (c && c->type == ChannelType::VIDEO && c->video)
+			c->video->Update(time);
+
+		if (c && c->type == ChannelType::VIRTUAL_TEXTURE && c->virtualTexture)
+			c->virtualTexture->Update(VIRTUAL_PAGE_UPLOADS);
+
+		if (c && c->type == ChannelType::EXTERNAL_IMAGE && c->texture && c->layout != ChannelDimension::TEXTURE_2D)
+		{
+			// the image is only needed, and only kept at full resolution, until it was copied
+			if (c->layoutSource == 0)
+				TextureStreamer::Get()->Touch(c->texture);
+
+			if (c->texture->id && c->texture->droppedLevels == 0 && c->layoutSource != c->texture->id)
+				LayOutChannelImage(c);
+		}
+	}
+
+	UpdateVirtualTextureFeedback();
+}
+
+void RenderPass::UpdateVirtualTextureFeedback()
+{
+	size_t bytes = 0;
+	for (size_t i = 0; i < channels.size(); i++)
+	{
+		auto c = channels[i];
+		if (c && c->type == ChannelType::VIRTUAL_TEXTURE && c->virtualTexture)
+			bytes = (i + 1) * VirtualTexture::FEEDBACK_WORDS * sizeof(uint32_t);
+	}
+
+	// sized up to the last virtual channel, gone again once there is none
+	if (bytes != feedbackBytes)
+	{
+		for (int i = 0; i < FEEDBACK_READBACKS; i++)
+		{
+			if (feedbackFences[i])
+				glDeleteSync(GLsync(feedbackFences[i]));
+			feedbackFences[i] = nullptr;
+			feedbackData[i] = nullptr;
+		}
+
+		if (feedbackBuffer)
+		{
+			glDeleteBuffers(1, &feedbackBuffer);
+			glDeleteBuffers(FEEDBACK_READBACKS, feedbackReadbacks);
+		}
+
+		feedbackBuffer = 0;
+		std::fill_n(feedbackReadbacks, FEEDBACK_READBACKS, 0u);
+		feedbackBytes = bytes;
+
+		if (bytes == 0)
+			return;
+
+		glCreateBuffers(1, &feedbackBuffer);
+		glNamedBufferStorage(feedbackBuffer, GLsizeiptr(bytes), nullptr, 0);
+		glClearNamedBufferData(feedbackBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+		auto flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glCreateBuffers(FEEDBACK_READBACKS, feedbackReadbacks);
+		for (int i = 0; i < FEEDBACK_READBACKS; i++)
+		{
+			glNamedBufferStorage(feedbackReadbacks[i], GLsizeiptr(bytes), nullptr, flags);
+			feedbackData[i] = (const uint32_t*)glMapNamedBufferRange(feedbackReadbacks[i], 0, GLsizeiptr(bytes), flags);
+		}
+		return;
+	}
+
+	if (feedbackBuffer == 0)
+		return;
+
+	// the oldest copy is read once the GPU got to it, never waited for, and then takes the next one
+	auto& fence = feedbackFences[feedbackReadback];
+	if (fence)
+	{
+		if (glClientWaitSync(GLsync(fence), 0, 0) == GL_TIMEOUT_EXPIRED)
+			return;
+
+		glDeleteSync(GLsync(fence));
+		fence = nullptr;
+
+		for (size_t i = 0; i < channels.size(); i++)
+		{
+			auto c = channels[i];
+			if (c && c->type == ChannelType::VIRTUAL_TEXTURE && c->virtualTexture)
+				c->virtualTexture->RequestPages(feedbackData[feedbackReadback] + i * VirtualTexture::FEEDBACK_WORDS);
+		}
+	}
+
+	// bits of the frames that were not copied keep piling up until one is
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glCopyNamedBufferSubData(feedbackBuffer, feedbackReadbacks[feedbackReadback], 0, 0, GLsizeiptr(feedbackBytes));
+	glClearNamedBufferData(feedbackBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	feedbackReadback = (feedbackReadback + 1) % FEEDBACK_READBACKS;
+}
+
+ChannelDimension RenderPass::GetChannelDimension(int index)
+{
+	auto c = channels[index];
+	if (c && c->type == ChannelType::RENDERPASS && c->pass)
+		return c->pass->GetOutputDimension();
+	if (c && c->type == ChannelType::EXTERNAL_IMAGE)
+		return c->layout;
+	return ChannelDimension::TEXTURE_2D;
+}
+
+void RenderPass::SetChannelLayout(int index, ChannelDimension layout)
+{
+	auto c = channels[index];
+	if (c == nullptr || c->layout == layout)
+		return;
+
+	// copied again from the image by UpdateChannels
+	if (c->layoutTexture)
+		glDeleteTextures(1, &c->layoutTexture);
+
+	c->layout = layout;
+	c->layoutTexture = 0;
+	c->layoutSource = 0;
+	std::fill_n(c->layoutSize, 3, 0);
+}
+
+void RenderPass::OnChannelSamplerImGui(Channel* channel)
+{
+	ImGui::SeparatorText("Sampler");
+	ImGui::Checkbox("Override Sampler", &channel->overrideSampler);
+	if (!channel->overrideSampler)
+		return;
+
+	ImGui::Combo("Filter", (int*)(&channel->filter), "Nearest\0Linear\0Mipmap\0");
+	ImGui::Combo("Wrap", (int*)(&channel->wrap), "Clamp\0Repeat\0Mirror\0");
+
+	if (channel->filter == ChannelFilter::MIPMAP && channel->type == ChannelType::RENDERPASS && channel->pass)
+	{
+		ImGui::TextDisabled("%s generates mips after each draw, %.1f MB",
+			channel->pass->GetName().c_str(), double(channel->pass->GetOutputMipmapBytes()) / (1024.0 * 1024.0));
+	}
+	else if (channel->filter == ChannelFilter::MIPMAP && channel->type == ChannelType::VIDEO)
+	{
+		ImGui::TextDisabled("Video frames have no mips, they sample level 0");
+	}
+}
+
+void RenderPass::OnChannelImGui(int index, bool flipVertically)
+{
+	ImGui::Text("Channel %d", index);
+
+	auto channel = channels[index];
+	auto size = ImVec2{ 120, 120 };
+	auto is_image_clicked = false;
+
+	char buff[128];
+	sprintf_s(buff, "%sChannel%d%llu", name.c_str(), index, (uint64_t)this);
+	if (channel && channel->type == ChannelType::EXTERNAL_IMAGE && channel->texture)
+	{
+		is_image_clicked = ImGui::ImageButton(buff, ((ImTextureID)(channel->texture->id)), size, { 0, 1 }, { 1, 0 });
+	}
+	else if (channel && channel->type == ChannelType::RENDERPASS && channel->pass &&
+		channel->pass->GetOutputDimension() == ChannelDimension::TEXTURE_2D)
+	{
+		is_image_clicked = ImGui::ImageButton(buff,
+			((ImTextureID)(channel->pass->GetOutputTexture())), size, { 0, 1 }, { 1, 0 });
+	}
+	else if (channel && channel->type == ChannelType::VIDEO && channel->video)
+	{
+		is_image_clicked = ImGui::ImageButton(buff, ((ImTextureID)(channel->video->GetTextureID())), size, { 0, 1 }, { 1, 0 });
+	}
+	else if (channel && channel->type == ChannelType::VIRTUAL_TEXTURE && channel->virtualTexture &&
+		channel->virtualTexture->GetAtlasTexture())
+	{
+		// the atlas, which pages are resident is more telling than a thumbnail
+		is_image_clicked = ImGui::ImageButton(buff, ((ImTextureID)(channel->virtualTexture->GetAtlasTexture())), size);
+	}
+	else
+	{
+		ImTextureRef null_image(ImTextureID(0));
+		is_image_clicked = ImGui::ImageButton(buff, null_image, size);
+	}
+
+	if (is_image_clicked)
+	{
+		open_channel_settings = true;
+		selected_channel = index;
+	}
+
+	if (ImGui::BeginDragDropTarget())
+	{
+		auto payload = ImGui::AcceptDragDropPayload("dropped_files");
+		ImGui::EndDragDropTarget();
+
+		for (const auto& item : Application::instance->drop_items)
+		{
+			// too large for a texture, or dropped on a channel set to virtual textures
+			bool is_image = item.ends_with(".png") || item.ends_with(".jpg") || item.ends_with(".jpeg");
+			if (is_image && ((channel && channel->type == ChannelType::VIRTUAL_TEXTURE) || VirtualTexture::IsLargeImage(item)))
+			{
+				auto c = new Channel;
+				c->virtualTexture = new VirtualTexture(item, flipVertically);
+				c->type = ChannelType::VIRTUAL_TEXTURE;
+				SetChannel(index, c);
+				break;
+			}
+
+			if (is_image)
+			{
+				auto c = new Channel;
+				c->texture = TextureStreamer::Get()->Load(item, flipVertically);
+				c->type = ChannelType::EXTERNAL_IMAGE;
+				SetChannel(index, c);
+				break;
+			}
+
+			// HDR images stay linear and unclamped as half floats
+			if (IsFloatImageFile(item))
+			{
+				auto c = new Channel;
+				c->texture = TextureStreamer::Get()->Load(item, flipVertically, TextureFormat::RGBA16F);
+				c->type = ChannelType::EXTERNAL_IMAGE;
+				SetChannel(index, c);
+				break;
+			}
+
+			if (VideoStream::IsVideoFile(item))
+			{
+				auto c = new Channel;
+				c->video = new VideoStream(item, flipVertically);
+				c->type = ChannelType::VIDEO;
+				SetChannel(index, c);
+				break;
+			}
+		}
+
+		Application::instance->UpdateSamplerDeclarations(this);
+		Application::instance->drop_items.clear();
+	}
+}
+
+void RenderPass::OnChannelSettingsImGui()
+{
+	if (!open_channel_settings)
+		return;
+
+	ImGui::OpenPopup("Channel Settings");
+	ImVec2 center(ImGui::GetIO().DisplaySize.x * 0.5f, ImGui::GetIO().DisplaySize.y * 0.5f);
+	ImGui::SetNextWindowPos(center, ImGuiCond_Appearing, ImVec2(0.5f, 0.5f));
+	if (!ImGui::BeginPopupModal("Channel Settings", &open_channel_settings, ImGuiWindowFlags_AlwaysAutoResize))
+		return;
+
+	ImGui::Text("%s Channel %d Settings", GetName().c_str(), selected_channel);
+
+	auto c = GetChannel(selected_channel);
+	auto dimension = GetChannelDimension(selected_channel);
+	bool was_virtual = c->type == ChannelType::VIRTUAL_TEXTURE;
+
+	ImGui::Combo("Channel Type", (int*)(&c->type), "ImageFile\0RenderPass\0Video\0Virtual Texture\0");
+
+	if (c->type == ChannelType::RENDERPASS)
+	{
+		if (ImGui::BeginCombo("Render Pass", c->pass ? c->pass->GetName().c_str() : "Select Render Pass"))
+		{
+			for (size_t i = 0; i < Application::instance->passes.size(); i++)
+			{
+				bool selected = c->pass == Application::instance->passes[i];
+				if (ImGui::Selectable(Application::instance->passes[i]->GetName().c_str(), selected))
+				{
+					c->pass = Application::instance->passes[i];
+				}
+			}
+			ImGui::EndCombo();
+		}
+	}
+	else
+	{
+		c->pass = nullptr;
+	}
+
+	if (c->type == ChannelType::EXTERNAL_IMAGE)
+	{
+		int layout = int(c->layout);
+		if (ImGui::Combo("Layout", &layout, "2D\0Cubemap (cross or strip of faces)\0Volume (square slices side by side)\0"))
+			SetChannelLayout(selected_channel, ChannelDimension(layout));
+
+		if (c->layout != ChannelDimension::TEXTURE_2D && c->layoutSource && !c->layoutTexture)
+			ImGui::TextDisabled("%dx%d does not split into %s", c->texture->width, c->texture->height,
+				c->layout == ChannelDimension::CUBEMAP ? "cubemap faces" : "square slices");
+	}
+
+	if (c->type == ChannelType::EXTERNAL_IMAGE && c->texture && c->texture->format == TextureFormat::RGBA16F)
+	{
+		// the prefiltered chain is a texture of its own, swapped in for the plain one
+		bool prefiltered = c->texture->prefiltered;
+		if (ImGui::Checkbox("Prefiltered Environment", &prefiltered))
+		{
+			auto texture = TextureStreamer::Get()->Load(c->texture->path, c->texture->flipVertically, TextureFormat::RGBA16F, prefiltered);
+			TextureStreamer::Get()->Release(c->texture);
+			c->texture = texture;
+		}
+
+		if (prefiltered)
+			ImGui::TextDisabled("GGX roughness r is at lod r * (textureQueryLevels - 1)");
+	}
+
+	if (c->type == ChannelType::VIRTUAL_TEXTURE && !c->virtualTexture && c->texture)
+	{
+		// switching an image channel over reads the same file into pages
+		c->virtualTexture = new VirtualTexture(c->texture->path, c->texture->flipVertically);
+	}
+
+	if (c->type == ChannelType::VIRTUAL_TEXTURE && c->virtualTexture)
+	{
+		auto vt = c->virtualTexture;
+		if (vt->HasFailed())
+			ImGui::TextDisabled("Could not read %s into pages", vt->GetPath().c_str());
+		else if (!vt->IsOpen())
+			ImGui::TextDisabled("Cutting %s into pages...", vt->GetPath().c_str());
+		else
+			ImGui::Text("%dx%d, %d levels, %d / %d pages resident, %.1f MB", vt->GetWidth(), vt->GetHeight(), vt->GetLevelCount(),
+				vt->GetResidentPageCount(), vt->GetAtlasPageCount(), double(vt->GetVideoMemoryBytes()) / (1024.0 * 1024.0));
+
+		ImGui::TextDisabled("Sample it with textureVirtual(iChannel%d, %d, uv)", selected_channel, selected_channel);
+	}
+	else if (c->type == ChannelType::VIRTUAL_TEXTURE)
+	{
+		ImGui::TextDisabled("Drop an image on the channel");
+	}
+
+	if (c->type == ChannelType::VIDEO && c->video)
+	{
+		auto video = c->video;
+		if (video->HasFailed())
+			ImGui::TextDisabled("Could not play %s", video->GetPath().c_str());
+		else
+			ImGui::Text("%dx%d, %.2f fps, iChannelTime %.2f / %.1f s", video->GetWidth(), video->GetHeight(), video->GetFrameRate(), video->GetFrameTime(), video->GetDuration());
+	}
+
+	OnChannelSamplerImGui(c);
+
+	// the fragment shader is edited to declare the sampler type the channel needs now
+	if (GetChannelDimension(selected_channel) != dimension || was_virtual != (c->type == ChannelType::VIRTUAL_TEXTURE))
+		Application::instance->UpdateSamplerDeclarations(this);
+
+	ImGui::EndPopup();
+}
+
+void RenderPass::GetChannelResolution(int index, float* resolution)
+{
+	int size[3] = {};
+
+	auto c = channels[index];
+	if (c && c->type == ChannelType::EXTERNAL_IMAGE && c->layout != ChannelDimension::TEXTURE_2D)
+	{
+		std::copy_n(c->layoutSize, 3, size);
+	}
+	else if (c && c->type == ChannelType::EXTERNAL_IMAGE && c->texture)
+	{
+		size[0] = c->texture->width;
+		size[1] = c->texture->height;
+	}
+	else if (c && c->type == ChannelType::RENDERPASS && c->pass)
+	{
+		c->pass->GetOutputSize(size[0], size[1], size[2]);
+	}
+	else if (c && c->type == ChannelType::VIDEO && c->video)
+	{
+		size[0] = c->video->GetWidth();
+		size[1] = c->video->GetHeight();
+	}
+	else if (c && c->type == ChannelType::VIRTUAL_TEXTURE && c->virtualTexture)
+	{
+		size[0] = c->virtualTexture->GetWidth();
+		size[1] = c->virtualTexture->GetHeight();
+	}
+
+	for (int i = 0; i < 3; i++)
+		resolution[i] = float(size[i]);
+}
+
+bool RenderPass::UpdateSamplerDeclarations(std::string& source)
+{
+	static const char* types[] = { "sampler2D", "samplerCube", "sampler3D" };
+
+	std::string result;
+	result.reserve(source.size());
+	bool changed = false;
+	size_t copied = 0;
+	size_t last = std::string::npos;	// end of the last declaration in `source`
+
+	// uniform <type> iChannel<n>, a plain scan, this runs on every channel change
+	for (size_t at = source.find("uniform"); at != std::string::npos; at = source.find("uniform", at + 1))
+	{
+		if (at > 0 && IsIdentifierChar(source[at - 1]))
+			continue;
+
+		auto type_start = SkipSpaces(source, at + 7);
+		if (type_start == at + 7)
+			continue;
+
+		int current = 0;
+		while (current < 3 && source.compare(type_start, strlen(types[current]), types[current]) != 0)
+			current++;
+		if (current == 3)
+			continue;
+
+		auto type_end = type_start + strlen(types[current]);
+		auto name_start = SkipSpaces(source, type_end);
+		if (name_start == type_end || source.compare(name_start, 8, "iChannel") != 0)
+			continue;
+
+		auto digits = name_start + 8;
+		auto name_end = digits;
+		while (name_end < source.size() && isdigit((unsigned char)source[name_end]))
+			name_end++;
+		if (name_end == digits || (name_end < source.size() && IsIdentifierChar(source[name_end])))
+			continue;
+
+		int index = -1;
+		std::from_chars(source.data() + digits, source.data() + name_end, index);
+		if (index < 0 || index >= int(channels.size()))
+			continue;
+
+		auto type = int(GetChannelDimension(index));
+		changed |= type != current;
+
+		result.append(source, copied, type_start - copied);
+		result += types[type];
+		copied = type_end;
+		last = name_end;
+	}
+
+	auto tail = result.size();
+	result.append(source, copied);
+
+	// the helper goes after the declarations, it reads iChannelResolution and iFrame
+	bool has_virtual = std::any_of(channels.begin(), channels.end(), [](Channel* c) { return c && c->type == ChannelType::VIRTUAL_TEXTURE; });
+	std::string helper;
+	if (has_virtual && result.find("textureVirtual(") == std::string::npos && read_entire_file("Shaders\\VirtualTexture.glsl", helper))
+	{
+		auto at = last == std::string::npos ? result.find('\n') : result.find('\n', tail + (last - copied));
+		result.insert(at == std::string::npos ? result.size() : at + 1, "\n" + helper + "\n");
+		changed = true;
+	}
+
+	if (!changed)
+		return false;
+
+	source = std::move(result);
+	return true;
+}
+
+void RenderPass::SetShaderCost(ShaderType type, const ShaderCost& cost)
+{
+	if (type == ShaderType::Vertex)
+		vertexCost = cost;
+	else
+		fragmentCost = cost;
+}
+
+void RenderPass::OnShaderCostImGui()
+{
+	ImGui::SeparatorText("Shader Cost");
+
+	if (!vertexCost.valid && !fragmentCost.valid)
+	{
+		ImGui::TextDisabled("Not analyzed yet");
+		return;
+	}
+
+	if (ImGui::BeginTable("ShaderCost", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+	{
+		ImGui::TableSetupColumn("");
+		ImGui::TableSetupColumn("Vertex");
+		ImGui::TableSetupColumn("Fragment");
+		ImGui::TableHeadersRow();
+
+		auto row = [](const char* label, int vs, int fs) {
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(label);
+			ImGui::TableNextColumn();
+			ImGui::Text("%d", vs);
+			ImGui::TableNextColumn();
+			ImGui::Text("%d", fs);
+		};
+
+		row("ALU ops", vertexCost.aluOps, fragmentCost.aluOps);
+		row("Texture fetches", vertexCost.textureFetches, fragmentCost.textureFetches);
+		row("Loops", vertexCost.loops, fragmentCost.loops);
+		row("Max loop nesting", vertexCost.maxLoopDepth, fragmentCost.maxLoopDepth);
+		row("Branches", vertexCost.branches, fragmentCost.branches);
+		row("Temp registers (vec4)", vertexCost.tempRegisters, fragmentCost.tempRegisters);
+
+		ImGui::EndTable();
+	}
+
+	ImGui::TextDisabled("Static estimate, loop bodies are counted once (%.2f ms)",
+		vertexCost.milliseconds + fragmentCost.milliseconds);
 }
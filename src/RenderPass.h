@@ -1,25 +1,68 @@
 #pragma once
 #include "ShaderProgramSource.h"
+#include "ShaderCost.h"
 #include "JinGL/Texture2D.h"
 #include "JinGL/Framebuffer.h"
+#include "TextureStreamer.h"
+#include "VideoStream.h"
+#include "VirtualTexture.h"
 #include <array>
 
 enum class ChannelType : int
 {
 	EXTERNAL_IMAGE,
-	RENDERPASS
+	RENDERPASS,
+	VIDEO,
+	VIRTUAL_TEXTURE
+};
+
+// How a channel is sampled, the fragment shader declares a matching sampler type for it
+enum class ChannelDimension : int
+{
+	TEXTURE_2D,
+	CUBEMAP,
+	VOLUME
+};
+
+// Filtering and wrapping of a channel's sampler object, MIPMAP on a pass output has that pass generate mips
+enum class ChannelFilter : int
+{
+	NEAREST,
+	LINEAR,
+	MIPMAP
+};
+
+enum class ChannelWrap : int
+{
+	CLAMP,
+	REPEAT,
+	MIRROR
 };
 
 class RenderPass;
 
+// Video memory of the framebuffer's attachments
+size_t GetFramebufferBytes(Framebuffer* framebuffer, bool depthStencil = false);
+
+// Not a union, switching the type in the channel settings must not reinterpret the other pointer
 struct Channel
 {
 	ChannelType type;
-	union
-	{
-		RenderPass* pass;
-		Texture2D* texture;
-	};
+	RenderPass* pass{ nullptr };
+	StreamedTexture* texture{ nullptr };	// one reference held in the TextureStreamer
+	VideoStream* video{ nullptr };			// owned
+	VirtualTexture* virtualTexture{ nullptr };	// owned
+
+	// external images read as cubemap faces or volume slices, copied once the image is loaded
+	ChannelDimension layout{ ChannelDimension::TEXTURE_2D };
+	unsigned int layoutTexture{ 0 };		// owned
+	unsigned int layoutSource{ 0 };			// image texture it was copied from
+	int layoutSize[3]{};
+
+	// without an override the texture's own parameters apply, those differ between images, videos and passes
+	bool overrideSampler{ false };
+	ChannelFilter filter{ ChannelFilter::MIPMAP };
+	ChannelWrap wrap{ ChannelWrap::REPEAT };
 };
 
 class RenderPass
@@ -37,15 +80,72 @@ public:
 	void SetName(const std::string& name) { this->name = name; }
 	const std::string& GetName() { return name; }
 	Framebuffer* GetOutput() { return output; }
+	virtual size_t GetOutputBytes();
+
+	// What channels reading this pass bind, the first color attachment unless the pass renders a cubemap or volume
+	virtual unsigned int GetOutputTexture();
+	virtual ChannelDimension GetOutputDimension() { return ChannelDimension::TEXTURE_2D; }
+	virtual void GetOutputSize(int& width, int& height, int& depth);
+
+	// A copy of the output with a full mip chain, 0 until it was first generated. Asking for it keeps
+	// UpdateOutputMipmaps generating it after every draw, the copy is dropped once no channel asks anymore.
+	unsigned int RequestOutputMipmaps();
+	void UpdateOutputMipmaps();
+	size_t GetOutputMipmapBytes();
 	ShaderProgramSource* GetShader() { return shader; }
 	
 	void SetChannel(int index, Channel* channel);
 	Channel* GetChannel(int index) { return channels[index]; }
 	void BindChannels(int offset = 0);
 
+	// Advances video channels to `time` and lays out loaded images as cubemaps or volumes, before BindChannels
+	void UpdateChannels(float time);
+
+	ChannelDimension GetChannelDimension(int index);
+	void SetChannelLayout(int index, ChannelDimension layout);
+	void OnChannelSamplerImGui(Channel* channel);
+
+	// The thumbnail of a channel, a drop target for images, HDR images and videos, opens the settings
+	// popup when clicked. Screen space passes flip images so uv (0, 0) is their bottom left, model
+	// passes keep them as the mesh uvs expect.
+	void OnChannelImGui(int index, bool flipVertically);
+	void OnChannelSettingsImGui();
+
+	// As iChannelResolution gives it, depth is 0 for 2D textures and cubemaps
+	void GetChannelResolution(int index, float* resolution);
+
+	// Rewrites the iChannel sampler declarations in `source` to the channel dimensions and adds
+	// VirtualTexture.glsl when a channel holds a virtual texture, false when nothing changed
+	bool UpdateSamplerDeclarations(std::string& source);
+
+	void SetShaderCost(ShaderType type, const ShaderCost& cost);
+	void OnShaderCostImGui();
+
 protected:
 	Framebuffer* output { nullptr };
 	ShaderProgramSource* shader{ nullptr };
 	std::string name;
 	std::array<Channel*, 16> channels{};
+	ShaderCost vertexCost;
+	ShaderCost fragmentCost;
+
+	unsigned int mipmappedOutput{ 0 };
+	int mipmappedSize[3]{};
+	int mipmappedFormat{ 0 };
+	bool mipmapsRequested{ false };
+
+	bool open_channel_settings{ false };
+	int selected_channel{ 0 };
+
+private:
+	void UpdateVirtualTextureFeedback();
+
+	// virtual textures report the pages they want here, read back through a ring of mapped copies
+	static constexpr int FEEDBACK_READBACKS = 3;
+	unsigned int feedbackBuffer{ 0 };
+	size_t feedbackBytes{ 0 };
+	unsigned int feedbackReadbacks[FEEDBACK_READBACKS]{};
+	const uint32_t* feedbackData[FEEDBACK_READBACKS]{};
+	void* feedbackFences[FEEDBACK_READBACKS]{};
+	int feedbackReadback{ 0 };
 };
@@ -0,0 +1,164 @@
+#include "ShaderCost.h"
+
+#include <glslang/Public/ShaderLang.h>
+#include <glslang/Include/intermediate.h>
+#include <glslang/MachineIndependent/localintermediate.h>
+
+#include <algorithm>
+#include <unordered_set>
+
+namespace
+{
+	int Components(const glslang::TType& type)
+	{
+		if (type.isMatrix())
+			return type.getMatrixCols() * type.getMatrixRows();
+		return std::max(1, type.getVectorSize());
+	}
+
+	// rough per component weight of an operator, 0 for things that are free or not ALU work
+	int OperatorWeight(glslang::TOperator op)
+	{
+		using namespace glslang;
+
+		switch (op)
+		{
+		case EOpSin: case EOpCos: case EOpTan:
+		case EOpAsin: case EOpAcos: case EOpAtan:
+		case EOpSinh: case EOpCosh: case EOpTanh:
+		case EOpAsinh: case EOpAcosh: case EOpAtanh:
+		case EOpPow: case EOpExp: case EOpLog: case EOpExp2: case EOpLog2:
+		case EOpSqrt: case EOpInverseSqrt:
+		case EOpDiv: case EOpDivAssign: case EOpMod: case EOpModAssign:
+			return 4;
+
+		case EOpNormalize: case EOpLength: case EOpDistance:
+		case EOpReflect: case EOpRefract: case EOpFaceForward:
+		case EOpSmoothStep: case EOpCross:
+			return 3;
+
+		case EOpVectorTimesMatrix: case EOpMatrixTimesVector: case EOpMatrixTimesMatrix:
+		case EOpVectorTimesMatrixAssign: case EOpMatrixTimesMatrixAssign:
+			return 4;
+
+		case EOpAdd: case EOpSub: case EOpMul:
+		case EOpAddAssign: case EOpSubAssign: case EOpMulAssign:
+		case EOpVectorTimesScalar: case EOpMatrixTimesScalar:
+		case EOpVectorTimesScalarAssign: case EOpMatrixTimesScalarAssign:
+		case EOpNegative: case EOpLogicalNot: case EOpVectorLogicalNot: case EOpBitwiseNot:
+		case EOpPreIncrement: case EOpPreDecrement: case EOpPostIncrement: case EOpPostDecrement:
+		case EOpEqual: case EOpNotEqual: case EOpVectorEqual: case EOpVectorNotEqual:
+		case EOpLessThan: case EOpGreaterThan: case EOpLessThanEqual: case EOpGreaterThanEqual:
+		case EOpLogicalOr: case EOpLogicalXor: case EOpLogicalAnd:
+		case EOpAnd: case EOpInclusiveOr: case EOpExclusiveOr: case EOpLeftShift: case EOpRightShift:
+		case EOpRadians: case EOpDegrees:
+		case EOpAbs: case EOpSign: case EOpFloor: case EOpTrunc: case EOpRound: case EOpRoundEven:
+		case EOpCeil: case EOpFract: case EOpMin: case EOpMax: case EOpClamp: case EOpMix: case EOpStep:
+		case EOpDot:
+			return 1;
+
+		default:
+			return 0;
+		}
+	}
+
+	bool IsTextureFetch(glslang::TIntermOperator* node)
+	{
+		using namespace glslang;
+
+		if (!node->isTexture())
+			return false;
+
+		auto op = node->getOp();
+		return op != EOpTextureQuerySize && op != EOpTextureQueryLod &&
+			op != EOpTextureQueryLevels && op != EOpTextureQuerySamples;
+	}
+
+	class CostCounter : public glslang::TIntermTraverser
+	{
+	public:
+		explicit CostCounter(ShaderCost& cost)
+			: glslang::TIntermTraverser(true, false, true), cost(cost) {}
+
+		bool visitBinary(glslang::TVisit visit, glslang::TIntermBinary* node) override
+		{
+			if (visit == glslang::EvPreVisit)
+				CountOperator(node);
+			return true;
+		}
+
+		bool visitUnary(glslang::TVisit visit, glslang::TIntermUnary* node) override
+		{
+			if (visit == glslang::EvPreVisit)
+				CountOperator(node);
+			return true;
+		}
+
+		bool visitAggregate(glslang::TVisit visit, glslang::TIntermAggregate* node) override
+		{
+			if (visit == glslang::EvPreVisit)
+				CountOperator(node);
+			return true;
+		}
+
+		bool visitSelection(glslang::TVisit visit, glslang::TIntermSelection* node) override
+		{
+			if (visit == glslang::EvPreVisit)
+				cost.branches++;
+			return true;
+		}
+
+		bool visitLoop(glslang::TVisit visit, glslang::TIntermLoop* node) override
+		{
+			if (visit == glslang::EvPreVisit)
+			{
+				cost.loops++;
+				loopDepth++;
+				cost.maxLoopDepth = std::max(cost.maxLoopDepth, loopDepth);
+			}
+			else if (visit == glslang::EvPostVisit)
+			{
+				loopDepth--;
+			}
+			return true;
+		}
+
+		void visitSymbol(glslang::TIntermSymbol* node) override
+		{
+			if (node->getQualifier().storage != glslang::EvqTemporary)
+				return;
+
+			if (temporaries.insert(node->getId()).second)
+				cost.tempRegisters += (node->getType().computeNumComponents() + 3) / 4;
+		}
+
+	private:
+		void CountOperator(glslang::TIntermOperator* node)
+		{
+			if (IsTextureFetch(node))
+			{
+				cost.textureFetches++;
+				return;
+			}
+
+			cost.aluOps += OperatorWeight(node->getOp()) * Components(node->getType());
+		}
+
+		ShaderCost& cost;
+		int loopDepth{};
+		std::unordered_set<long long> temporaries;
+	};
+}
+
+void AnalyzeShaderCost(glslang::TShader& shader, ShaderCost& cost)
+{
+	cost = {};
+
+	auto intermediate = shader.getIntermediate();
+	if (intermediate == nullptr || intermediate->getTreeRoot() == nullptr)
+		return;
+
+	CostCounter counter(cost);
+	intermediate->getTreeRoot()->traverse(&counter);
+	cost.valid = true;
+}
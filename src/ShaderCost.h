@@ -0,0 +1,20 @@
+#pragma once
+
+namespace glslang { class TShader; }
+
+// Static, per stage estimate of how expensive a shader is. Loop bodies are counted once,
+// so these numbers are meant for comparing passes / edits, not for predicting frame time.
+struct ShaderCost
+{
+	bool valid{};
+	int aluOps{};			// arithmetic weighted by component count, transcendentals count extra
+	int textureFetches{};	// texture*() / texelFetch*() call sites
+	int loops{};
+	int maxLoopDepth{};
+	int branches{};
+	int tempRegisters{};	// vec4 registers needed if every local stayed live, a register pressure hint
+	float milliseconds{};
+};
+
+// Walks the AST of an already parsed shader.
+void AnalyzeShaderCost(glslang::TShader& shader, ShaderCost& cost);
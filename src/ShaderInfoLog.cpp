@@ -0,0 +1,174 @@
+#include "ShaderInfoLog.h"
+
+namespace
+{
+	struct Cursor
+	{
+		std::string_view text;
+
+		bool Empty() const { return text.empty(); }
+
+		void SkipSpaces()
+		{
+			while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+				text.remove_prefix(1);
+		}
+
+		bool Consume(char c)
+		{
+			if (text.empty() || text.front() != c)
+				return false;
+			text.remove_prefix(1);
+			return true;
+		}
+
+		bool Consume(std::string_view prefix)
+		{
+			if (!text.starts_with(prefix))
+				return false;
+			text.remove_prefix(prefix.size());
+			return true;
+		}
+
+		bool Integer(int& value)
+		{
+			if (text.empty() || text.front() < '0' || text.front() > '9')
+				return false;
+
+			value = 0;
+			while (!text.empty() && text.front() >= '0' && text.front() <= '9')
+			{
+				value = value * 10 + (text.front() - '0');
+				text.remove_prefix(1);
+			}
+			return true;
+		}
+
+		std::string_view Message()
+		{
+			while (!text.empty() && (text.front() == ' ' || text.front() == '\t' || text.front() == ':'))
+				text.remove_prefix(1);
+			while (!text.empty() && (text.back() == ' ' || text.back() == '\t'))
+				text.remove_suffix(1);
+			return text;
+		}
+	};
+
+	bool ParseSeverityKeyword(Cursor& c, ShaderLogSeverity& severity)
+	{
+		if (c.Consume("error"))
+		{
+			severity = ShaderLogSeverity::Error;
+			return true;
+		}
+
+		if (c.Consume("warning"))
+		{
+			severity = ShaderLogSeverity::Warning;
+			return true;
+		}
+
+		return false;
+	}
+
+	bool ParseLine(std::string_view line, ShaderLogEntry& entry)
+	{
+		Cursor c{ line };
+		c.SkipSpaces();
+
+		// AMD / Intel (and glslang): "ERROR: 0:12: message"
+		bool prefixed = false;
+		if (c.Consume("ERROR:"))
+		{
+			entry.severity = ShaderLogSeverity::Error;
+			prefixed = true;
+		}
+		else if (c.Consume("WARNING:"))
+		{
+			entry.severity = ShaderLogSeverity::Warning;
+			prefixed = true;
+		}
+
+		if (prefixed)
+		{
+			c.SkipSpaces();
+
+			Cursor located = c;
+			if (located.Integer(entry.file) && located.Consume(':') && located.Integer(entry.line) && located.Consume(':'))
+			{
+				c = located;
+			}
+			else
+			{
+				entry.file = 0;
+				entry.line = 0;
+			}
+
+			entry.message = c.Message();
+			return true;
+		}
+
+		if (!c.Integer(entry.file))
+		{
+			// unlocated linker output, e.g. "error: undefined reference to mainImage"
+			if (!ParseSeverityKeyword(c, entry.severity) || !c.Consume(':'))
+				return false;
+
+			entry.file = 0;
+			entry.message = c.Message();
+			return true;
+		}
+
+		if (c.Consume('('))
+		{
+			// NVIDIA: "0(12) : error C1008: message"
+			if (!c.Integer(entry.line) || !c.Consume(')'))
+				return false;
+		}
+		else if (c.Consume(':'))
+		{
+			// Mesa: "0:12(5): error: message"
+			if (!c.Integer(entry.line))
+				return false;
+
+			if (c.Consume('(') && (!c.Integer(entry.column) || !c.Consume(')')))
+				return false;
+		}
+		else
+		{
+			return false;
+		}
+
+		c.SkipSpaces();
+		if (!c.Consume(':'))
+			return false;
+
+		c.SkipSpaces();
+		if (!ParseSeverityKeyword(c, entry.severity))
+			return false;
+
+		entry.message = c.Message();
+		return true;
+	}
+}
+
+size_t ParseShaderInfoLog(std::string_view log, std::vector<ShaderLogEntry>& entries)
+{
+	entries.clear();
+
+	while (!log.empty())
+	{
+		auto end = log.find('\n');
+		auto line = log.substr(0, end);
+		log.remove_prefix(end == std::string_view::npos ? log.size() : end + 1);
+
+		if (!line.empty() && line.back() == '\r')
+			line.remove_suffix(1);
+
+		ShaderLogEntry entry{};
+		if (ParseLine(line, entry))
+			entries.push_back(entry);
+	}
+
+	return entries.size();
+}
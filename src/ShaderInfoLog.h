@@ -0,0 +1,26 @@
+#pragma once
+#include <string_view>
+#include <vector>
+
+enum class ShaderLogSeverity
+{
+	Error,
+	Warning
+};
+
+struct ShaderLogEntry
+{
+	ShaderLogSeverity severity{};
+	int file{};					// source string index reported by the driver
+	int line{};					// 1 based, 0 when the driver gave no location
+	int column{};				// 1 based, 0 when the driver gave no column
+	std::string_view message;	// points into the parsed log, valid as long as the log is
+};
+
+// Parses a GLSL compile / link info log into entries without regex or per line allocations.
+// Understood formats:
+//   NVIDIA         0(12) : error C1008: undefined variable "foo"
+//   AMD / Intel    ERROR: 0:12: 'foo' : undeclared identifier
+//   Mesa           0:12(5): error: `foo' undeclared
+// Entries are appended to `entries` (which is cleared first) and the number of entries is returned.
+size_t ParseShaderInfoLog(std::string_view log, std::vector<ShaderLogEntry>& entries);
@@ -1 +1,82 @@
 #include "ShaderProgramSource.h"
+#include "JinGL/JinGL.h"
+
+static bool IsSamplerType(GLenum type)
+{
+	switch (type)
+	{
+	case GL_SAMPLER_1D:
+	case GL_SAMPLER_2D:
+	case GL_SAMPLER_3D:
+	case GL_SAMPLER_CUBE:
+	case GL_SAMPLER_1D_SHADOW:
+	case GL_SAMPLER_2D_SHADOW:
+	case GL_SAMPLER_1D_ARRAY:
+	case GL_SAMPLER_2D_ARRAY:
+	case GL_SAMPLER_CUBE_MAP_ARRAY:
+	case GL_SAMPLER_2D_ARRAY_SHADOW:
+	case GL_SAMPLER_CUBE_SHADOW:
+	case GL_SAMPLER_2D_MULTISAMPLE:
+	case GL_SAMPLER_BUFFER:
+	case GL_SAMPLER_2D_RECT:
+	case GL_INT_SAMPLER_2D:
+	case GL_INT_SAMPLER_3D:
+	case GL_INT_SAMPLER_CUBE:
+	case GL_INT_SAMPLER_2D_ARRAY:
+	case GL_UNSIGNED_INT_SAMPLER_2D:
+	case GL_UNSIGNED_INT_SAMPLER_3D:
+	case GL_UNSIGNED_INT_SAMPLER_CUBE:
+	case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+		return true;
+	default:
+		return false;
+	}
+}
+
+void ShaderProgramSource::ReflectSamplers()
+{
+	active_sampler_mask = 0;
+
+	if (!IsValid())
+		return;
+
+	Bind();
+
+	GLint program = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+	GLint count = 0;
+	glGetProgramInterfaceiv(program, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+
+	const GLenum properties[] = { GL_TYPE, GL_LOCATION, GL_ARRAY_SIZE };
+
+	for (GLint i = 0; i < count; i++)
+	{
+		GLint values[3] = {};
+		glGetProgramResourceiv(program, GL_UNIFORM, i, 3, properties, 3, nullptr, values);
+
+		auto [type, location, array_size] = values;
+		if (!IsSamplerType(GLenum(type)) || location < 0)
+			continue;
+
+		for (GLint element = 0; element < array_size; element++)
+		{
+			GLint unit = 0;
+			glGetUniformiv(program, location + element, &unit);
+			if (unit >= 0 && unit < 32)
+			{
+				active_sampler_mask |= 1u << unit;
+			}
+		}
+	}
+}
+
+void ShaderProgramSource::UniformFloatArray(const char* uniformName, int count, const float* values)
+{
+	GLint program = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+
+	auto location = glGetUniformLocation(GLuint(program), uniformName);
+	if (location >= 0)
+		glUniform1fv(location, count, values);
+}
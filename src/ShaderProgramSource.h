@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <cstdint>
 #include "JinGL/Shader.h"
 
 class ShaderProgramSource : public ShaderProgram
@@ -14,9 +15,18 @@ public:
 	void SetFragmentSource(const std::string& source) { this->fragment_source = source; }
 	const std::string& GetFragmentSource() { return fragment_source; }
 
+	// Records which texture units the linked program actually samples from.
+	// Has to be called again after every successful Link.
+	void ReflectSamplers();
+	uint32_t GetActiveSamplerMask() const { return active_sampler_mask; }
+
+	// float[] uniforms, ShaderProgram only sets vector arrays. The program has to be bound.
+	void UniformFloatArray(const char* uniformName, int count, const float* values);
+
 private:
 	std::string name;
 	std::string vertex_source;
 	std::string fragment_source;
+	uint32_t active_sampler_mask{};
 };
 
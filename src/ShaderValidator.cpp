@@ -0,0 +1,156 @@
+#include "ShaderValidator.h"
+
+#include <glslang/Public/ShaderLang.h>
+#include <glslang/Public/ResourceLimits.h>
+
+#include <chrono>
+
+void ShaderValidator::Init()
+{
+	glslang::InitializeProcess();
+
+	running = true;
+	worker = std::thread(&ShaderValidator::WorkerLoop, this);
+}
+
+void ShaderValidator::Shutdown()
+{
+	{
+		std::lock_guard lock(mutex);
+		running = false;
+	}
+	condition.notify_all();
+
+	if (worker.joinable())
+		worker.join();
+
+	glslang::FinalizeProcess();
+}
+
+void ShaderValidator::Submit(const void* owner, ShaderType type, std::string source, uint64_t revision)
+{
+	{
+		std::lock_guard lock(mutex);
+		pending[owner] = Job{ type, std::move(source), revision };
+	}
+	condition.notify_one();
+}
+
+bool ShaderValidator::Poll(const void* owner, ShaderValidationResult& result)
+{
+	std::lock_guard lock(mutex);
+
+	auto it = finished.find(owner);
+	if (it == finished.end())
+		return false;
+
+	result = std::move(it->second);
+	finished.erase(it);
+	return true;
+}
+
+void ShaderValidator::SubmitCostAnalysis(const void* owner, ShaderType type, std::string source)
+{
+	{
+		std::lock_guard lock(mutex);
+		pendingCosts[owner] = Job{ type, std::move(source) };
+	}
+	condition.notify_one();
+}
+
+bool ShaderValidator::PollCost(const void* owner, ShaderCost& cost)
+{
+	std::lock_guard lock(mutex);
+
+	auto it = finishedCosts.find(owner);
+	if (it == finishedCosts.end())
+		return false;
+
+	cost = it->second;
+	finishedCosts.erase(it);
+	return true;
+}
+
+bool ShaderValidator::Validate(ShaderType type, const std::string& source, std::string& log, ShaderCost* cost)
+{
+	auto stage = type == ShaderType::Vertex ? EShLangVertex : EShLangFragment;
+	auto messages = EShMessages(EShMsgDefault);
+
+	glslang::TShader shader(stage);
+	const char* strings[] = { source.c_str() };
+	shader.setStrings(strings, 1);
+
+	if (!shader.parse(GetDefaultResources(), 450, false, messages))
+	{
+		log = shader.getInfoLog();
+		return false;
+	}
+
+	if (cost)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		AnalyzeShaderCost(shader, *cost);
+		auto end = std::chrono::high_resolution_clock::now();
+		cost->milliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+	}
+
+	// linking the single stage catches missing definitions such as an undefined mainImage
+	glslang::TProgram program;
+	program.addShader(&shader);
+	if (!program.link(messages))
+	{
+		log = program.getInfoLog();
+		return false;
+	}
+
+	log.clear();
+	return true;
+}
+
+void ShaderValidator::WorkerLoop()
+{
+	while (true)
+	{
+		std::unique_lock lock(mutex);
+		condition.wait(lock, [this] { return !running || !pending.empty() || !pendingCosts.empty(); });
+
+		if (!running)
+			break;
+
+		// validation keeps the editors responsive, so it goes before cost analysis
+		if (!pending.empty())
+		{
+			auto it = pending.begin();
+			auto owner = it->first;
+			auto job = std::move(it->second);
+			pending.erase(it);
+			lock.unlock();
+
+			ShaderValidationResult result;
+			result.revision = job.revision;
+
+			auto start = std::chrono::high_resolution_clock::now();
+			result.valid = Validate(job.type, job.source, result.log);
+			auto end = std::chrono::high_resolution_clock::now();
+			result.milliseconds = std::chrono::duration<float, std::milli>(end - start).count();
+
+			lock.lock();
+			finished[owner] = std::move(result);
+		}
+		else
+		{
+			auto it = pendingCosts.begin();
+			auto owner = it->first;
+			auto job = std::move(it->second);
+			pendingCosts.erase(it);
+			lock.unlock();
+
+			std::string log;
+			ShaderCost cost;
+			Validate(job.type, job.source, log, &cost);
+
+			lock.lock();
+			finishedCosts[owner] = cost;
+		}
+	}
+}
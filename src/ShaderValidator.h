@@ -0,0 +1,61 @@
+#pragma once
+#include "JinGL/Shader.h"
+#include "ShaderCost.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+struct ShaderValidationResult
+{
+	uint64_t revision{};
+	bool valid{};
+	float milliseconds{};
+	std::string log;	// glslang info log, same "ERROR: 0:12: ..." layout ParseShaderInfoLog understands
+};
+
+// Parses and validates GLSL with the glslang reference front-end on a background thread,
+// so editors get error markers while typing without going through the driver.
+class ShaderValidator
+{
+public:
+	void Init();
+	void Shutdown();
+
+	// Queues `source` for validation. A newer submission from the same owner replaces one that has not started yet.
+	void Submit(const void* owner, ShaderType type, std::string source, uint64_t revision);
+
+	// Takes the latest finished result for `owner`, if there is one.
+	bool Poll(const void* owner, ShaderValidationResult& result);
+
+	// Queues a static cost estimate of a source that compiled successfully.
+	void SubmitCostAnalysis(const void* owner, ShaderType type, std::string source);
+	bool PollCost(const void* owner, ShaderCost& cost);
+
+	// Validates on the calling thread, used when a result is needed right away (e.g. on save).
+	// When `cost` is given and the source is valid the cost estimate is filled in from the same parse.
+	bool Validate(ShaderType type, const std::string& source, std::string& log, ShaderCost* cost = nullptr);
+
+private:
+	struct Job
+	{
+		ShaderType type;
+		std::string source;
+		uint64_t revision{};
+	};
+
+	void WorkerLoop();
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable condition;
+	bool running{};
+
+	std::unordered_map<const void*, Job> pending;
+	std::unordered_map<const void*, ShaderValidationResult> finished;
+	std::unordered_map<const void*, Job> pendingCosts;
+	std::unordered_map<const void*, ShaderCost> finishedCosts;
+};
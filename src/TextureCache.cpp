@@ -0,0 +1,251 @@
+#include "TextureCache.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	constexpr uint8_t IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+	// bumped whenever the encoders change, so old entries are never hit again
+	constexpr uint32_t VERSION = 1;
+
+	// VkFormat values
+	constexpr uint32_t VK_FORMAT_R8G8B8A8_UNORM = 37;
+	constexpr uint32_t VK_FORMAT_R16G16B16A16_SFLOAT = 97;
+	constexpr uint32_t VK_FORMAT_BC4_UNORM_BLOCK = 139;
+	constexpr uint32_t VK_FORMAT_BC5_UNORM_BLOCK = 141;
+	constexpr uint32_t VK_FORMAT_BC7_UNORM_BLOCK = 145;
+
+	// Khronos data format descriptor color models
+	constexpr uint32_t KHR_DF_MODEL_RGBSDA = 1;
+	constexpr uint32_t KHR_DF_MODEL_BC4 = 131;
+	constexpr uint32_t KHR_DF_MODEL_BC5 = 132;
+	constexpr uint32_t KHR_DF_MODEL_BC7 = 134;
+
+	// sample channel qualifiers
+	constexpr uint32_t KHR_DF_SAMPLE_DATATYPE_SIGNED = 0x40;
+	constexpr uint32_t KHR_DF_SAMPLE_DATATYPE_FLOAT = 0x80;
+
+	struct Header
+	{
+		uint8_t identifier[12];
+		uint32_t vkFormat;
+		uint32_t typeSize;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t layerCount;
+		uint32_t faceCount;
+		uint32_t levelCount;
+		uint32_t supercompressionScheme;
+		uint32_t dfdByteOffset;
+		uint32_t dfdByteLength;
+		uint32_t kvdByteOffset;
+		uint32_t kvdByteLength;
+		uint64_t sgdByteOffset;
+		uint64_t sgdByteLength;
+	};
+
+	struct LevelIndex
+	{
+		uint64_t byteOffset;
+		uint64_t byteLength;
+		uint64_t uncompressedByteLength;
+	};
+
+	static_assert(sizeof(Header) == 80);
+	static_assert(sizeof(LevelIndex) == 24);
+
+	uint32_t GetVkFormat(TextureFormat format)
+	{
+		switch (format)
+		{
+		case TextureFormat::BC7: return VK_FORMAT_BC7_UNORM_BLOCK;
+		case TextureFormat::BC5: return VK_FORMAT_BC5_UNORM_BLOCK;
+		case TextureFormat::BC4: return VK_FORMAT_BC4_UNORM_BLOCK;
+		case TextureFormat::RGBA16F: return VK_FORMAT_R16G16B16A16_SFLOAT;
+		default: return VK_FORMAT_R8G8B8A8_UNORM;
+		}
+	}
+
+	// Basic descriptor block with one sample per channel, the spec requires it even for known formats
+	std::vector<uint32_t> MakeDataFormatDescriptor(TextureFormat format)
+	{
+		struct Sample
+		{
+			uint32_t bitOffset;
+			uint32_t bitLength;
+			uint32_t channel;
+		};
+
+		std::vector<Sample> samples;
+		uint32_t model = 0, block_size = 0, bytes = 0;
+		switch (format)
+		{
+		case TextureFormat::BC7:
+			model = KHR_DF_MODEL_BC7, block_size = 3, bytes = 16;
+			samples = { { 0, 128, 0 } };
+			break;
+		case TextureFormat::BC5:
+			model = KHR_DF_MODEL_BC5, block_size = 3, bytes = 16;
+			samples = { { 0, 64, 0 }, { 64, 64, 1 } };
+			break;
+		case TextureFormat::BC4:
+			model = KHR_DF_MODEL_BC4, block_size = 3, bytes = 8;
+			samples = { { 0, 64, 0 } };
+			break;
+		case TextureFormat::RGBA16F:
+		{
+			constexpr uint32_t half = KHR_DF_SAMPLE_DATATYPE_SIGNED | KHR_DF_SAMPLE_DATATYPE_FLOAT;
+			model = KHR_DF_MODEL_RGBSDA, block_size = 0, bytes = 8;
+			samples = { { 0, 16, 0 | half }, { 16, 16, 1 | half }, { 32, 16, 2 | half }, { 48, 16, 15 | half } };
+			break;
+		}
+		default:
+			model = KHR_DF_MODEL_RGBSDA, block_size = 0, bytes = 4;
+			samples = { { 0, 8, 0 }, { 8, 8, 1 }, { 16, 8, 2 }, { 24, 8, 15 } };
+			break;
+		}
+
+		uint32_t descriptor_size = 24 + 16 * uint32_t(samples.size());
+		std::vector<uint32_t> words = {
+			4 + descriptor_size,
+			0,										// vendor Khronos, basic descriptor
+			2 | (descriptor_size << 16),			// version
+			model | (1 << 8) | (1 << 16),			// BT.709 primaries, linear transfer
+			block_size | (block_size << 8),			// texel block dimensions minus one
+			bytes,
+			0,
+		};
+
+		for (auto& sample : samples)
+		{
+			words.push_back(sample.bitOffset | ((sample.bitLength - 1) << 16) | (sample.channel << 24));
+			// float samples give their range as the float values -1 and 1
+			bool is_float = sample.channel & KHR_DF_SAMPLE_DATATYPE_FLOAT;
+			words.push_back(0);
+			words.push_back(is_float ? 0xBF800000 : 0);
+			words.push_back(is_float ? 0x3F800000 : sample.bitLength == 8 ? 255 : 0xFFFFFFFF);
+		}
+
+		return words;
+	}
+
+	uint64_t Align(uint64_t offset, uint64_t alignment)
+	{
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+}
+
+uint64_t TextureCache::MakeKey(std::string_view source, TextureFormat format)
+{
+	uint64_t key = FNV_OFFSET_BASIS;
+	key = Hash(key, source.data(), source.size());
+	key = Hash(key, &format, sizeof(format));
+	key = Hash(key, &VERSION, sizeof(VERSION));
+	return key;
+}
+
+std::filesystem::path TextureCache::GetPath(uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.ktx2", (unsigned long long)key);
+	return directory / name;
+}
+
+bool TextureCache::Write(uint64_t key, const CompressedTexture& texture)
+{
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+
+	auto descriptor = MakeDataFormatDescriptor(texture.format);
+	auto level_count = uint32_t(texture.levels.size());
+
+	Header header = {};
+	memcpy(header.identifier, IDENTIFIER, sizeof(IDENTIFIER));
+	header.vkFormat = GetVkFormat(texture.format);
+	header.typeSize = texture.format == TextureFormat::RGBA16F ? 2 : 1;
+	header.pixelWidth = uint32_t(texture.width);
+	header.pixelHeight = uint32_t(texture.height);
+	header.faceCount = 1;
+	header.levelCount = level_count;
+	header.dfdByteOffset = uint32_t(sizeof(Header) + sizeof(LevelIndex) * level_count);
+	header.dfdByteLength = uint32_t(descriptor.size() * sizeof(uint32_t));
+
+	// the format wants the smallest level first in the file, each aligned to the block size
+	auto alignment = std::max<uint64_t>(GetLevelBytes(texture.format, 1, 1), 4);
+	std::vector<LevelIndex> index(level_count);
+	uint64_t offset = header.dfdByteOffset + header.dfdByteLength;
+	for (uint32_t i = level_count; i-- > 0;)
+	{
+		offset = Align(offset, alignment);
+		index[i] = { offset, texture.levels[i].size, texture.levels[i].size };
+		offset += texture.levels[i].size;
+	}
+
+	return write_file_atomically(GetPath(key), [&](std::ofstream& stream) {
+		stream.write((const char*)&header, sizeof(header));
+		stream.write((const char*)index.data(), index.size() * sizeof(LevelIndex));
+		stream.write((const char*)descriptor.data(), descriptor.size() * sizeof(uint32_t));
+
+		for (uint32_t i = level_count; i-- > 0;)
+		{
+			static const char zeros[16] = {};
+			stream.write(zeros, std::streamsize(index[i].byteOffset - uint64_t(stream.tellp())));
+			stream.write((const char*)texture.data.data() + texture.levels[i].offset, texture.levels[i].size);
+		}
+		return true;
+	});
+}
+
+bool TextureCache::Read(uint64_t key, TextureFormat format, CompressedTexture& texture)
+{
+	std::ifstream stream(GetPath(key), std::ios::binary | std::ios::ate);
+	if (!stream)
+		return false;
+
+	auto size = uint64_t(stream.tellg());
+	if (size < sizeof(Header))
+		return false;
+
+	texture.data.resize(size);
+	stream.seekg(0);
+	if (!stream.read((char*)texture.data.data(), std::streamsize(size)))
+		return false;
+
+	Header header;
+	memcpy(&header, texture.data.data(), sizeof(header));
+
+	if (memcmp(header.identifier, IDENTIFIER, sizeof(IDENTIFIER)) != 0 ||
+		header.vkFormat != GetVkFormat(format) ||
+		header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelDepth != 0 ||
+		header.layerCount > 1 || header.faceCount != 1 ||
+		header.supercompressionScheme != 0 ||
+		header.levelCount != uint32_t(GetMipLevelCount(int(header.pixelWidth), int(header.pixelHeight))) ||
+		sizeof(Header) + uint64_t(header.levelCount) * sizeof(LevelIndex) > size)
+	{
+		return false;
+	}
+
+	texture.format = format;
+	texture.width = int(header.pixelWidth);
+	texture.height = int(header.pixelHeight);
+	texture.levels.clear();
+
+	for (uint32_t i = 0; i < header.levelCount; i++)
+	{
+		LevelIndex level;
+		memcpy(&level, texture.data.data() + sizeof(Header) + i * sizeof(LevelIndex), sizeof(level));
+
+		auto expected = GetLevelBytes(format, std::max(1, texture.width >> i), std::max(1, texture.height >> i));
+		if (level.byteLength != expected || level.byteOffset > size || level.byteLength > size - level.byteOffset)
+			return false;
+
+		texture.levels.push_back({ size_t(level.byteOffset), size_t(level.byteLength) });
+	}
+
+	return true;
+}
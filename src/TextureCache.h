@@ -0,0 +1,25 @@
+#pragma once
+#include "TextureCompression.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <string_view>
+
+// Block compressed textures with their mip chain, stored as KTX2 files so the transcoding
+// cost is paid once per image. Any KTX2 viewer can open the entries.
+class TextureCache
+{
+public:
+	static inline std::filesystem::path directory = "Cache\\Textures\\";
+
+	// `source` identifies the image, the streamer passes its own cache key with path and modification time
+	static uint64_t MakeKey(std::string_view source, TextureFormat format);
+
+	static bool Write(uint64_t key, const CompressedTexture& texture);
+
+	// Fails when the entry is missing, truncated or not in `format`
+	static bool Read(uint64_t key, TextureFormat format, CompressedTexture& texture);
+
+private:
+	static std::filesystem::path GetPath(uint64_t key);
+};
@@ -0,0 +1,431 @@
+#include "TextureCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	// BC7 4 bit index interpolation weights, out of 64
+	constexpr int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	struct BitWriter
+	{
+		uint8_t* data;
+		int position{ 0 };
+
+		void Write(uint32_t value, int bits)
+		{
+			for (int i = 0; i < bits; i++, position++)
+			{
+				if ((value >> i) & 1)
+					data[position >> 3] |= uint8_t(1 << (position & 7));
+			}
+		}
+	};
+
+	// 7 bit endpoint plus a shared p-bit per endpoint, the p-bit is picked per endpoint for the least error
+	void QuantizeEndpoint(const float* color, int* code, int& pbit)
+	{
+		float best_error = INFINITY;
+		for (int p = 0; p < 2; p++)
+		{
+			int candidate[4];
+			float error = 0.0f;
+			for (int c = 0; c < 4; c++)
+			{
+				candidate[c] = std::clamp(int((color[c] - p) * 0.5f + 0.5f), 0, 127);
+				float d = float((candidate[c] << 1) | p) - color[c];
+				error += d * d;
+			}
+
+			if (error < best_error)
+			{
+				best_error = error;
+				pbit = p;
+				std::copy_n(candidate, 4, code);
+			}
+		}
+	}
+
+	// Picks the closest palette entry per texel, returns the squared error
+	float FindBC7Indices(const uint8_t* texels, const int codes[2][4], const int pbits[2], int* indices)
+	{
+		int palette[16][4];
+		for (int i = 0; i < 16; i++)
+		{
+			for (int c = 0; c < 4; c++)
+			{
+				int e0 = (codes[0][c] << 1) | pbits[0];
+				int e1 = (codes[1][c] << 1) | pbits[1];
+				palette[i][c] = ((64 - BC7_WEIGHTS[i]) * e0 + BC7_WEIGHTS[i] * e1 + 32) >> 6;
+			}
+		}
+
+		float total = 0.0f;
+		for (int t = 0; t < 16; t++)
+		{
+			int best = 0;
+			int best_error = INT32_MAX;
+			for (int i = 0; i < 16; i++)
+			{
+				int error = 0;
+				for (int c = 0; c < 4; c++)
+				{
+					int d = palette[i][c] - texels[t * 4 + c];
+					error += d * d;
+				}
+
+				if (error < best_error)
+				{
+					best_error = error;
+					best = i;
+				}
+			}
+
+			indices[t] = best;
+			total += float(best_error);
+		}
+
+		return total;
+	}
+
+	void GetBlock(const uint8_t* pixels, int width, int height, int bx, int by, uint8_t* texels)
+	{
+		// edge blocks repeat the last row and column
+		for (int y = 0; y < 4; y++)
+		{
+			int sy = std::min(by * 4 + y, height - 1);
+			for (int x = 0; x < 4; x++)
+			{
+				int sx = std::min(bx * 4 + x, width - 1);
+				memcpy(texels + (y * 4 + x) * 4, pixels + (size_t(sy) * width + sx) * 4, 4);
+			}
+		}
+	}
+
+	void Downsample(const uint8_t* source, int width, int height, uint8_t* target, bool normals)
+	{
+		int target_width = std::max(1, width / 2);
+		int target_height = std::max(1, height / 2);
+
+		for (int y = 0; y < target_height; y++)
+		{
+			int y0 = std::min(y * 2, height - 1);
+			int y1 = std::min(y * 2 + 1, height - 1);
+
+			for (int x = 0; x < target_width; x++)
+			{
+				int x0 = std::min(x * 2, width - 1);
+				int x1 = std::min(x * 2 + 1, width - 1);
+
+				const uint8_t* texels[4] = {
+					source + (size_t(y0) * width + x0) * 4,
+					source + (size_t(y0) * width + x1) * 4,
+					source + (size_t(y1) * width + x0) * 4,
+					source + (size_t(y1) * width + x1) * 4,
+				};
+
+				auto out = target + (size_t(y) * target_width + x) * 4;
+				for (int c = 0; c < 4; c++)
+					out[c] = uint8_t((texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4);
+
+				// averaged normals get shorter, which would show up as darker shading in the distance
+				if (normals)
+				{
+					float n[3];
+					for (int c = 0; c < 3; c++)
+						n[c] = out[c] / 127.5f - 1.0f;
+
+					float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+					if (length > 0.0f)
+					{
+						for (int c = 0; c < 3; c++)
+							out[c] = uint8_t(std::clamp((n[c] / length + 1.0f) * 127.5f + 0.5f, 0.0f, 255.0f));
+					}
+				}
+			}
+		}
+	}
+}
+
+size_t GetBlockBytes(TextureFormat format)
+{
+	switch (format)
+	{
+	case TextureFormat::BC7:
+	case TextureFormat::BC5:
+		return 16;
+	case TextureFormat::BC4:
+		return 8;
+	default:
+		return 0;
+	}
+}
+
+size_t GetLevelBytes(TextureFormat format, int width, int height)
+{
+	if (format == TextureFormat::RGBA8)
+		return size_t(width) * size_t(height) * 4;
+	if (format == TextureFormat::RGBA16F)
+		return size_t(width) * size_t(height) * 8;
+
+	return size_t((width + 3) / 4) * size_t((height + 3) / 4) * GetBlockBytes(format);
+}
+
+int GetMipLevelCount(int width, int height)
+{
+	int levels = 1;
+	while ((std::max(width, height) >> levels) > 0)
+		levels++;
+	return levels;
+}
+
+size_t CompressedTexture::GetBytes() const
+{
+	size_t bytes = 0;
+	for (auto& level : levels)
+		bytes += level.size;
+	return bytes;
+}
+
+void CompressTexture(const uint8_t* pixels, int width, int height, TextureFormat format, CompressedTexture& result)
+{
+	result.format = format;
+	result.width = width;
+	result.height = height;
+	result.levels.clear();
+
+	int level_count = GetMipLevelCount(width, height);
+	size_t total = 0;
+	for (int i = 0; i < level_count; i++)
+	{
+		auto size = GetLevelBytes(format, std::max(1, width >> i), std::max(1, height >> i));
+		result.levels.push_back({ total, size });
+		total += size;
+	}
+
+	result.data.assign(total, 0);
+
+	std::vector<uint8_t> current, next;
+	const uint8_t* source = pixels;
+	int level_width = width;
+	int level_height = height;
+
+	for (int i = 0; i < level_count; i++)
+	{
+		auto target = result.data.data() + result.levels[i].offset;
+
+		if (format == TextureFormat::RGBA8)
+		{
+			memcpy(target, source, result.levels[i].size);
+		}
+		else
+		{
+			auto block_bytes = GetBlockBytes(format);
+			int blocks_x = (level_width + 3) / 4;
+			int blocks_y = (level_height + 3) / 4;
+
+			uint8_t texels[64];
+			for (int by = 0; by < blocks_y; by++)
+			{
+				for (int bx = 0; bx < blocks_x; bx++)
+				{
+					GetBlock(source, level_width, level_height, bx, by, texels);
+
+					auto block = target + (size_t(by) * blocks_x + bx) * block_bytes;
+					if (format == TextureFormat::BC7)
+						EncodeBC7(texels, block);
+					else if (format == TextureFormat::BC5)
+						EncodeBC5(texels, block);
+					else
+						EncodeBC4(texels, 0, block);
+				}
+			}
+		}
+
+		if (i + 1 < level_count)
+		{
+			next.resize(size_t(std::max(1, level_width / 2)) * size_t(std::max(1, level_height / 2)) * 4);
+			Downsample(source, level_width, level_height, next.data(), format == TextureFormat::BC5);
+
+			std::swap(current, next);
+			source = current.data();
+			level_width = std::max(1, level_width / 2);
+			level_height = std::max(1, level_height / 2);
+		}
+	}
+}
+
+void EncodeBC4(const uint8_t* texels, int channel, uint8_t* block)
+{
+	int low = 255, high = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		low = std::min<int>(low, texels[i * 4 + channel]);
+		high = std::max<int>(high, texels[i * 4 + channel]);
+	}
+
+	memset(block, 0, 8);
+	block[0] = uint8_t(high);
+	block[1] = uint8_t(low);
+	if (high == low)
+		return;
+
+	// red0 > red1 selects the 8 value mode: both endpoints and six steps between them
+	int palette[8] = { high, low };
+	for (int i = 2; i < 8; i++)
+		palette[i] = ((8 - i) * high + (i - 1) * low + 3) / 7;
+
+	uint64_t bits = 0;
+	for (int t = 0; t < 16; t++)
+	{
+		int value = texels[t * 4 + channel];
+		int best = 0;
+		for (int i = 1; i < 8; i++)
+		{
+			if (std::abs(palette[i] - value) < std::abs(palette[best] - value))
+				best = i;
+		}
+		bits |= uint64_t(best) << (t * 3);
+	}
+
+	for (int i = 0; i < 6; i++)
+		block[2 + i] = uint8_t(bits >> (i * 8));
+}
+
+void EncodeBC5(const uint8_t* texels, uint8_t* block)
+{
+	EncodeBC4(texels, 0, block);
+	EncodeBC4(texels, 1, block + 8);
+}
+
+// Mode 6 only: one subset, RGBA endpoints and 4 bit indices. Endpoints start at the extremes along
+// the principal axis and get one least squares refit, good enough for textures on a model.
+void EncodeBC7(const uint8_t* texels, uint8_t* block)
+{
+	float mean[4] = {};
+	for (int t = 0; t < 16; t++)
+	{
+		for (int c = 0; c < 4; c++)
+			mean[c] += texels[t * 4 + c] / 16.0f;
+	}
+
+	float covariance[4][4] = {};
+	for (int t = 0; t < 16; t++)
+	{
+		float d[4];
+		for (int c = 0; c < 4; c++)
+			d[c] = texels[t * 4 + c] - mean[c];
+
+		for (int a = 0; a < 4; a++)
+		{
+			for (int b = 0; b < 4; b++)
+				covariance[a][b] += d[a] * d[b];
+		}
+	}
+
+	// power iteration converges on the axis of largest variance
+	float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float next[4] = {};
+		for (int a = 0; a < 4; a++)
+		{
+			for (int b = 0; b < 4; b++)
+				next[a] += covariance[a][b] * axis[b];
+		}
+
+		float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+		if (length < 1e-6f)
+			break;
+
+		for (int c = 0; c < 4; c++)
+			axis[c] = next[c] / length;
+	}
+
+	float low = INFINITY, high = -INFINITY;
+	for (int t = 0; t < 16; t++)
+	{
+		float projection = 0.0f;
+		for (int c = 0; c < 4; c++)
+			projection += (texels[t * 4 + c] - mean[c]) * axis[c];
+
+		low = std::min(low, projection);
+		high = std::max(high, projection);
+	}
+
+	float endpoints[2][4];
+	for (int c = 0; c < 4; c++)
+	{
+		endpoints[0][c] = std::clamp(mean[c] + axis[c] * low, 0.0f, 255.0f);
+		endpoints[1][c] = std::clamp(mean[c] + axis[c] * high, 0.0f, 255.0f);
+	}
+
+	int codes[2][4], pbits[2];
+	int indices[16];
+	QuantizeEndpoint(endpoints[0], codes[0], pbits[0]);
+	QuantizeEndpoint(endpoints[1], codes[1], pbits[1]);
+	float error = FindBC7Indices(texels, codes, pbits, indices);
+
+	// refit both endpoints to the chosen indices
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float ax[4] = {}, bx[4] = {};
+	for (int t = 0; t < 16; t++)
+	{
+		float w = BC7_WEIGHTS[indices[t]] / 64.0f;
+		aa += (1.0f - w) * (1.0f - w);
+		ab += (1.0f - w) * w;
+		bb += w * w;
+		for (int c = 0; c < 4; c++)
+		{
+			ax[c] += (1.0f - w) * texels[t * 4 + c];
+			bx[c] += w * texels[t * 4 + c];
+		}
+	}
+
+	float determinant = aa * bb - ab * ab;
+	if (std::abs(determinant) > 1e-6f)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			endpoints[0][c] = std::clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.0f, 255.0f);
+			endpoints[1][c] = std::clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.0f, 255.0f);
+		}
+
+		int refit_codes[2][4], refit_pbits[2];
+		int refit_indices[16];
+		QuantizeEndpoint(endpoints[0], refit_codes[0], refit_pbits[0]);
+		QuantizeEndpoint(endpoints[1], refit_codes[1], refit_pbits[1]);
+		if (FindBC7Indices(texels, refit_codes, refit_pbits, refit_indices) < error)
+		{
+			memcpy(codes, refit_codes, sizeof(codes));
+			memcpy(pbits, refit_pbits, sizeof(pbits));
+			memcpy(indices, refit_indices, sizeof(indices));
+		}
+	}
+
+	// the first index is stored without its top bit, swapping the endpoints keeps it below 8
+	if (indices[0] >= 8)
+	{
+		std::swap(codes[0], codes[1]);
+		std::swap(pbits[0], pbits[1]);
+		for (auto& index : indices)
+			index = 15 - index;
+	}
+
+	memset(block, 0, 16);
+	BitWriter writer{ block };
+	writer.Write(1 << 6, 7);
+	for (int c = 0; c < 4; c++)
+	{
+		writer.Write(codes[0][c], 7);
+		writer.Write(codes[1][c], 7);
+	}
+	writer.Write(pbits[0], 1);
+	writer.Write(pbits[1], 1);
+
+	writer.Write(indices[0], 3);
+	for (int t = 1; t < 16; t++)
+		writer.Write(indices[t], 4);
+}
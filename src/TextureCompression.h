@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// How a texture is stored on the GPU. The BC formats are block compressed in 4x4 texel blocks.
+enum class TextureFormat
+{
+	RGBA8,
+	BC7,		// color, 1 byte per texel
+	BC5,		// two channels, normal maps keep x and y, z is reconstructed
+	BC4,		// one channel, ambient occlusion, roughness
+	RGBA16F,	// HDR color from .hdr and .exr files, 8 bytes per texel
+};
+
+// Bytes of one 4x4 block, 0 for uncompressed formats
+size_t GetBlockBytes(TextureFormat format);
+
+// Bytes of one mip level
+size_t GetLevelBytes(TextureFormat format, int width, int height);
+
+int GetMipLevelCount(int width, int height);
+
+// A full mip chain, levels point into `data`
+struct CompressedTexture
+{
+	struct Level
+	{
+		size_t offset;
+		size_t size;
+	};
+
+	TextureFormat format{ TextureFormat::RGBA8 };
+	int width{ 0 };
+	int height{ 0 };
+	std::vector<uint8_t> data;
+	std::vector<Level> levels;
+
+	size_t GetBytes() const;
+};
+
+// Box filters RGBA8 `pixels` down to 1x1 and encodes every level. Slow compared to a decode,
+// meant for worker threads, see TextureCache for keeping the result around.
+void CompressTexture(const uint8_t* pixels, int width, int height, TextureFormat format, CompressedTexture& result);
+
+// Single block encoders, `texels` are 16 RGBA8 texels in row order
+void EncodeBC4(const uint8_t* texels, int channel, uint8_t* block);
+void EncodeBC5(const uint8_t* texels, uint8_t* block);
+void EncodeBC7(const uint8_t* texels, uint8_t* block);
@@ -0,0 +1,664 @@
+#include "TextureStreamer.h"
+#include "TextureCache.h"
+#include "EnvironmentFilter.h"
+#include "FloatImage.h"
+#include "ImageDecoder.h"
+#include "JinGL/JinGL.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	// decoded images waiting for upload, workers pause above this
+	constexpr size_t MAX_DECODED_BYTES = size_t(512) * 1024 * 1024;
+
+	// smallest staging half, so small budgets still batch a few textures
+	constexpr size_t MIN_STAGING_HALF = size_t(4) * 1024 * 1024;
+
+	constexpr size_t STAGING_ALIGNMENT = 256;
+
+	// textures bound this recently are never evicted, so what is on screen does not thrash
+	constexpr uint64_t KEEP_FRAMES = 8;
+
+	// mips a texture keeps before it is evicted entirely, 64x64 and below
+	constexpr int MIN_RESIDENT_LEVELS = 7;
+
+	// replaced texture objects are deleted this many frames later
+	constexpr uint64_t RETIRE_FRAMES = 3;
+
+	GLenum GetInternalFormat(TextureFormat format)
+	{
+		switch (format)
+		{
+		case TextureFormat::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+		case TextureFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+		case TextureFormat::BC4: return GL_COMPRESSED_RED_RGTC1;
+		case TextureFormat::RGBA16F: return GL_RGBA16F;
+		default: return GL_RGBA8;
+		}
+	}
+
+	const char* GetFormatSuffix(TextureFormat format)
+	{
+		switch (format)
+		{
+		case TextureFormat::BC7: return "|bc7";
+		case TextureFormat::BC5: return "|bc5";
+		case TextureFormat::BC4: return "|bc4";
+		case TextureFormat::RGBA16F: return "|f16";
+		default: return "";
+		}
+	}
+
+	GLuint CreateTexture(TextureFormat format, int width, int height, int levels)
+	{
+		GLuint id = 0;
+		glCreateTextures(GL_TEXTURE_2D, 1, &id);
+		glTextureStorage2D(id, levels, GetInternalFormat(format), width, height);
+		glTextureParameteri(id, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTextureParameteri(id, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTextureParameteri(id, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTextureParameteri(id, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+		// single channel textures read as grey rather than red
+		if (format == TextureFormat::BC4)
+		{
+			glTextureParameteri(id, GL_TEXTURE_SWIZZLE_G, GL_RED);
+			glTextureParameteri(id, GL_TEXTURE_SWIZZLE_B, GL_RED);
+		}
+
+		return id;
+	}
+
+	// Level 0 as half floats, or the whole prefiltered chain which is cached like compressed textures
+	bool LoadHalfFloat(const StreamedTexture* texture, CompressedTexture& result)
+	{
+		auto cache_key = TextureCache::MakeKey(texture->key, texture->format);
+		if (texture->prefiltered && TextureCache::Read(cache_key, texture->format, result))
+			return true;
+
+		FloatImage image;
+		if (!LoadFloatImage(texture->path, texture->flipVertically, image))
+			return false;
+
+		if (texture->prefiltered)
+		{
+			PrefilterEnvironment(image, result);
+			TextureCache::Write(cache_key, result);
+			return true;
+		}
+
+		result.format = texture->format;
+		result.width = image.width;
+		result.height = image.height;
+		result.data.resize(GetLevelBytes(result.format, image.width, image.height));
+		result.levels = { { 0, result.data.size() } };
+
+		auto target = (uint16_t*)result.data.data();
+		for (size_t i = 0; i < image.pixels.size(); i++)
+			target[i] = FloatToHalf(image.pixels[i]);
+
+		return true;
+	}
+
+	// Bytes of the mip chain from `firstLevel` down
+	size_t GetChainBytes(TextureFormat format, int width, int height, int firstLevel)
+	{
+		size_t bytes = 0;
+		for (int level = firstLevel; level < GetMipLevelCount(width, height); level++)
+			bytes += GetLevelBytes(format, std::max(1, width >> level), std::max(1, height >> level));
+		return bytes;
+	}
+}
+
+TextureStreamer::TextureStreamer(unsigned int threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency() - 1);
+
+	for (unsigned int i = 0; i < threadCount; i++)
+		workers.emplace_back([this] { Work(); });
+}
+
+TextureStreamer::~TextureStreamer()
+{
+	{
+		std::lock_guard lock(mutex);
+		stopping = true;
+	}
+
+	wake.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+
+	// whatever is still in flight is only referenced from here
+	for (auto texture : queue)
+	{
+		if (texture->released)
+			delete texture;
+	}
+
+	for (auto& image : decoded)
+	{
+		FreeDecodedImage(image.pixels);
+		if (image.texture->released)
+			delete image.texture;
+	}
+
+	for (auto& [id, resident] : residentHandles)
+		glMakeTextureHandleNonResidentARB(resident.handle);
+
+	for (auto& [id, frame] : retired)
+		glDeleteTextures(1, &id);
+
+	DestroyStaging();
+}
+
+StreamedTexture* TextureStreamer::Load(const std::filesystem::path& path, bool flipVertically, TextureFormat format, bool prefilterEnvironment)
+{
+	prefilterEnvironment = prefilterEnvironment && format == TextureFormat::RGBA16F;
+
+	std::error_code error;
+	auto canonical = std::filesystem::weakly_canonical(path, error);
+	auto time = std::filesystem::last_write_time(canonical, error).time_since_epoch().count();
+
+	// the same file flipped, in another format or prefiltered is a different image
+	auto key = (error ? path : canonical).generic_string() + "|" + std::to_string(time) + (flipVertically ? "|flip" : "") +
+		GetFormatSuffix(format) + (prefilterEnvironment ? "|env" : "");
+
+	auto& cached = cache[key];
+	if (cached)
+	{
+		cached->references++;
+		return cached;
+	}
+
+	auto texture = new StreamedTexture;
+	texture->path = path.string();
+	texture->flipVertically = flipVertically;
+	texture->format = format;
+	texture->prefiltered = prefilterEnvironment;
+	texture->references = 1;
+	texture->key = key;
+	cached = texture;
+
+	{
+		std::lock_guard lock(mutex);
+		queue.push_back(texture);
+		pending++;
+	}
+
+	wake.notify_one();
+	return texture;
+}
+
+void TextureStreamer::Release(StreamedTexture* texture)
+{
+	if (texture == nullptr || --texture->references > 0)
+		return;
+
+	cache.erase(texture->key);
+
+	// may still be drawn with this frame
+	if (texture->id)
+	{
+		Retire(texture->id);
+		textureBytes -= texture->residentBytes;
+		texture->id = 0;
+	}
+
+	std::lock_guard lock(mutex);
+
+	// still owned by a worker or the upload queue, they delete it once they see the flag
+	if (texture->state == StreamedTexture::State::Queued ||
+		texture->state == StreamedTexture::State::Decoding ||
+		texture->state == StreamedTexture::State::Decoded)
+	{
+		texture->released = true;
+		pending--;
+		return;
+	}
+
+	delete texture;
+}
+
+void TextureStreamer::Touch(StreamedTexture* texture)
+{
+	if (texture == nullptr)
+		return;
+
+	texture->lastUsedFrame = frame;
+
+	// draws keep using whatever is left of it, or the fallback, until it is back
+	if (texture->droppedLevels > 0 && !texture->restoring)
+	{
+		texture->restoring = true;
+		{
+			std::lock_guard lock(mutex);
+			texture->state = StreamedTexture::State::Queued;
+			queue.push_back(texture);
+			pending++;
+		}
+		wake.notify_one();
+	}
+}
+
+void TextureStreamer::SetMemoryBudget(size_t budget, size_t attachments)
+{
+	memoryBudget = budget;
+	attachmentBytes = attachments;
+}
+
+void TextureStreamer::GetEvictedCounts(size_t& reduced, size_t& evicted) const
+{
+	reduced = evicted = 0;
+	for (auto& [key, texture] : cache)
+	{
+		if (texture->droppedLevels > 0 && texture->id)
+			reduced++;
+		else if (texture->droppedLevels > 0)
+			evicted++;
+	}
+}
+
+void TextureStreamer::Work()
+{
+	for (;;)
+	{
+		StreamedTexture* texture = nullptr;
+		{
+			std::unique_lock lock(mutex);
+			wake.wait(lock, [&] { return stopping || (!queue.empty() && decodedBytes < MAX_DECODED_BYTES); });
+			if (stopping)
+				return;
+
+			texture = queue.front();
+			queue.pop_front();
+
+			if (texture->released)
+			{
+				delete texture;
+				continue;
+			}
+
+			texture->state = StreamedTexture::State::Decoding;
+		}
+
+		DecodedImage image;
+		image.texture = texture;
+		bool loaded = false;
+
+		if (texture->format == TextureFormat::RGBA8)
+		{
+			// always 4 channels, RGBA8 rows never need an unpack alignment other than the default
+			image.pixels = DecodeImage(texture->path, texture->flipVertically, image.width, image.height);
+			image.bytes = size_t(image.width) * size_t(image.height) * 4;
+			loaded = image.pixels != nullptr;
+		}
+		else if (texture->format == TextureFormat::RGBA16F)
+		{
+			loaded = LoadHalfFloat(texture, image.chain);
+			image.width = image.chain.width;
+			image.height = image.chain.height;
+			image.bytes = image.chain.GetBytes();
+		}
+		else
+		{
+			// the streamer key already tells flipped images and edited files apart
+			auto cache_key = TextureCache::MakeKey(texture->key, texture->format);
+			loaded = TextureCache::Read(cache_key, texture->format, image.chain);
+
+			if (!loaded)
+			{
+				int width = 0, height = 0;
+				if (auto pixels = DecodeImage(texture->path, texture->flipVertically, width, height))
+				{
+					CompressTexture(pixels, width, height, texture->format, image.chain);
+					FreeDecodedImage(pixels);
+
+					TextureCache::Write(cache_key, image.chain);
+					loaded = true;
+				}
+			}
+
+			image.width = image.chain.width;
+			image.height = image.chain.height;
+			image.bytes = image.chain.GetBytes();
+		}
+
+		std::lock_guard lock(mutex);
+		if (texture->released)
+		{
+			FreeDecodedImage(image.pixels);
+			delete texture;
+			continue;
+		}
+
+		if (!loaded)
+		{
+			texture->state = StreamedTexture::State::Failed;
+			pending--;
+			continue;
+		}
+
+		texture->state = StreamedTexture::State::Decoded;
+		decodedBytes += image.bytes;
+		decoded.push_back(std::move(image));
+	}
+}
+
+void TextureStreamer::Update(size_t byteBudget)
+{
+	frame++;
+
+	std::erase_if(retired, [&](const std::pair<unsigned int, uint64_t>& texture) {
+		if (frame - texture.second < RETIRE_FRAMES)
+			return false;
+		glDeleteTextures(1, &texture.first);
+		return true;
+	});
+
+	size_t half_size = std::max(byteBudget, MIN_STAGING_HALF);
+	if (stagingSize != half_size * 2)
+		CreateStaging(half_size * 2);
+
+	auto half = stagingFrame % 2;
+	size_t offset = 0;
+	size_t uploaded = 0;
+
+	for (;;)
+	{
+		DecodedImage image;
+		{
+			std::lock_guard lock(mutex);
+			if (decoded.empty())
+				break;
+
+			auto bytes = decoded.front().bytes;
+			if (uploaded > 0 && uploaded + bytes > byteBudget)
+				break;
+
+			image = std::move(decoded.front());
+			decoded.pop_front();
+			decodedBytes -= bytes;
+		}
+		wake.notify_all();
+
+		if (image.texture->released)
+		{
+			FreeDecodedImage(image.pixels);
+			delete image.texture;
+			continue;
+		}
+
+		auto bytes = image.bytes;
+
+		// the half written two frames ago has to be consumed by the GPU before it is reused
+		if (offset == 0 && stagingFences[half])
+		{
+			auto fence = GLsync(stagingFences[half]);
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(-1));
+			glDeleteSync(fence);
+			stagingFences[half] = nullptr;
+		}
+
+		auto format = image.texture->format;
+		auto internal_format = GetInternalFormat(format);
+
+		auto id = CreateTexture(format, image.width, image.height, GetMipLevelCount(image.width, image.height));
+
+		// copied into mapped memory, the driver pulls it from there asynchronously. Larger than
+		// what is left of the staging half only happens for the first image of a frame.
+		bool staged = offset + bytes <= half_size;
+		auto staging_offset = half * half_size + offset;
+		if (staged)
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+
+		if (format == TextureFormat::RGBA8)
+		{
+			const void* source = image.pixels;
+			if (staged)
+			{
+				memcpy(stagingData + staging_offset, image.pixels, bytes);
+				source = (const void*)staging_offset;
+			}
+
+			glTextureSubImage2D(id, 0, 0, 0, image.width, image.height, GL_RGBA, GL_UNSIGNED_BYTE, source);
+			glGenerateTextureMipmap(id);
+		}
+		else
+		{
+			// the whole chain was built offline, levels go up as they are
+			for (size_t level = 0; level < image.chain.levels.size(); level++)
+			{
+				auto& range = image.chain.levels[level];
+				const void* source = image.chain.data.data() + range.offset;
+				if (staged)
+				{
+					memcpy(stagingData + staging_offset, source, range.size);
+					source = (const void*)staging_offset;
+					staging_offset += range.size;
+				}
+
+				auto level_width = std::max(1, image.width >> level);
+				auto level_height = std::max(1, image.height >> level);
+				if (GetBlockBytes(format) > 0)
+					glCompressedTextureSubImage2D(id, GLint(level), 0, 0, level_width, level_height, internal_format, GLsizei(range.size), source);
+				else
+					glTextureSubImage2D(id, GLint(level), 0, 0, level_width, level_height, GL_RGBA, GL_HALF_FLOAT, source);
+			}
+
+			// plain HDR images bring level 0 only
+			if (int(image.chain.levels.size()) < GetMipLevelCount(image.width, image.height))
+				glGenerateTextureMipmap(id);
+		}
+
+		if (staged)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			offset += (bytes + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+		}
+
+		FreeDecodedImage(image.pixels);
+
+		// a texture coming back replaces what was left of it
+		auto texture = image.texture;
+		if (texture->id)
+		{
+			Retire(texture->id);
+			textureBytes -= texture->residentBytes;
+		}
+
+		texture->droppedLevels = 0;
+		texture->restoring = false;
+		texture->residentBytes = GetChainBytes(format, image.width, image.height, 0);
+		textureBytes += texture->residentBytes;
+
+		{
+			std::lock_guard lock(mutex);
+			texture->id = id;
+			texture->width = image.width;
+			texture->height = image.height;
+			texture->state = StreamedTexture::State::Ready;
+			pending--;
+		}
+
+		uploaded += bytes;
+		uploadCount++;
+	}
+
+	if (offset > 0)
+	{
+		stagingFences[half] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		stagingFrame++;
+	}
+
+	Evict();
+}
+
+void TextureStreamer::Evict()
+{
+	if (memoryBudget == 0 || textureBytes + attachmentBytes <= memoryBudget)
+		return;
+
+	std::vector<StreamedTexture*> candidates;
+	for (auto& [key, texture] : cache)
+	{
+		if (texture->id && !texture->restoring && frame - texture->lastUsedFrame > KEEP_FRAMES)
+			candidates.push_back(texture);
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [](const StreamedTexture* a, const StreamedTexture* b) {
+		return a->lastUsedFrame < b->lastUsedFrame;
+	});
+
+	// first textures drop top mips, only as many as needed, then whole textures go
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (auto texture : candidates)
+		{
+			auto used = textureBytes + attachmentBytes;
+			if (used <= memoryBudget)
+				return;
+
+			int levels = GetMipLevelCount(texture->width, texture->height);
+			if (pass == 1)
+			{
+				if (texture->id)
+					Shrink(texture, levels);
+				continue;
+			}
+
+			// the shaders find roughness at a fixed lod of a prefiltered chain, it goes whole or not at all
+			int max_dropped = levels - MIN_RESIDENT_LEVELS;
+			if (texture->prefiltered || texture->droppedLevels >= max_dropped)
+				continue;
+
+			auto excess = used - memoryBudget;
+			int dropped = texture->droppedLevels;
+			do
+			{
+				dropped++;
+			} while (dropped < max_dropped &&
+				texture->residentBytes - GetChainBytes(texture->format, texture->width, texture->height, dropped) < excess);
+
+			Shrink(texture, dropped);
+		}
+	}
+}
+
+void TextureStreamer::Shrink(StreamedTexture* texture, int droppedLevels)
+{
+	int levels = GetMipLevelCount(texture->width, texture->height);
+
+	// the remaining mips are copied on the GPU into a smaller texture
+	GLuint id = 0;
+	if (droppedLevels < levels)
+	{
+		id = CreateTexture(texture->format, std::max(1, texture->width >> droppedLevels),
+			std::max(1, texture->height >> droppedLevels), levels - droppedLevels);
+
+		for (int level = droppedLevels; level < levels; level++)
+		{
+			glCopyImageSubData(texture->id, GL_TEXTURE_2D, level - texture->droppedLevels, 0, 0, 0,
+				id, GL_TEXTURE_2D, level - droppedLevels, 0, 0, 0,
+				std::max(1, texture->width >> level), std::max(1, texture->height >> level), 1);
+		}
+	}
+
+	Retire(texture->id);
+	textureBytes -= texture->residentBytes;
+
+	texture->id = id;
+	texture->droppedLevels = droppedLevels;
+	texture->residentBytes = id ? GetChainBytes(texture->format, texture->width, texture->height, droppedLevels) : 0;
+	textureBytes += texture->residentBytes;
+
+	if (id == 0)
+	{
+		std::lock_guard lock(mutex);
+		texture->state = StreamedTexture::State::Evicted;
+	}
+
+	uploadCount++;
+}
+
+void TextureStreamer::Retire(unsigned int id)
+{
+	retired.push_back({ id, frame });
+
+	// draw lists still holding the handle pick up the new id before the texture is deleted
+	auto resident = residentHandles.find(id);
+	if (resident != residentHandles.end())
+	{
+		glMakeTextureHandleNonResidentARB(resident->second.handle);
+		residentHandles.erase(resident);
+		uploadCount++;
+	}
+}
+
+uint64_t TextureStreamer::AcquireTextureHandle(unsigned int id)
+{
+	auto& resident = residentHandles[id];
+	if (resident.references++ == 0)
+	{
+		resident.handle = glGetTextureHandleARB(id);
+		glMakeTextureHandleResidentARB(resident.handle);
+	}
+	return resident.handle;
+}
+
+void TextureStreamer::ReleaseTextureHandle(unsigned int id, uint64_t handle)
+{
+	// a retired texture's handle is non-resident already, its id may belong to a new texture by now
+	auto resident = residentHandles.find(id);
+	if (resident == residentHandles.end() || resident->second.handle != handle)
+		return;
+
+	if (--resident->second.references == 0)
+	{
+		glMakeTextureHandleNonResidentARB(handle);
+		residentHandles.erase(resident);
+	}
+}
+
+size_t TextureStreamer::GetPendingCount() const
+{
+	std::lock_guard lock(mutex);
+	return pending;
+}
+
+void TextureStreamer::CreateStaging(size_t size)
+{
+	DestroyStaging();
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers(1, &stagingBuffer);
+	glNamedBufferStorage(stagingBuffer, GLsizeiptr(size), nullptr, flags);
+	stagingData = (uint8_t*)glMapNamedBufferRange(stagingBuffer, 0, GLsizeiptr(size), flags);
+	stagingSize = size;
+}
+
+void TextureStreamer::DestroyStaging()
+{
+	for (auto& fence : stagingFences)
+	{
+		if (fence)
+		{
+			glClientWaitSync(GLsync(fence), GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(-1));
+			glDeleteSync(GLsync(fence));
+			fence = nullptr;
+		}
+	}
+
+	if (stagingBuffer)
+	{
+		glUnmapNamedBuffer(stagingBuffer);
+		glDeleteBuffers(1, &stagingBuffer);
+	}
+
+	stagingBuffer = 0;
+	stagingData = nullptr;
+	stagingSize = 0;
+}
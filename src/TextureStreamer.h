@@ -0,0 +1,155 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "TextureCompression.h"
+
+// A texture that is decoded on a worker thread and uploaded some frames later.
+// `id` stays 0 until then, users draw with a fallback meanwhile.
+struct StreamedTexture
+{
+	enum class State { Queued, Decoding, Decoded, Ready, Evicted, Failed };
+
+	std::string path;
+	unsigned int id{ 0 };
+	int width{ 0 };
+	int height{ 0 };
+	bool flipVertically{ false };
+	TextureFormat format{ TextureFormat::RGBA8 };
+	bool prefiltered{ false };		// RGBA16F environment with a GGX prefiltered mip chain
+	State state{ State::Queued };	// guarded by the streamer
+	bool released{ false };
+	int references{ 0 };			// GL thread only
+	std::string key;				// in the streamer's cache
+
+	// residency, GL thread only
+	int droppedLevels{ 0 };			// top mips evicted to save memory, all of them when evicted entirely
+	size_t residentBytes{ 0 };
+	uint64_t lastUsedFrame{ 0 };
+	bool restoring{ false };		// queued again to come back at full resolution
+
+	bool IsReady() const { return id != 0; }
+};
+
+// Decodes images through DecodeImage on a pool of worker threads and uploads the results through a
+// persistently mapped staging buffer, a limited number of bytes per frame, so a model with
+// hundreds of large textures neither blocks the GL thread nor stalls a single frame.
+// Block compressed textures are transcoded once and kept in the TextureCache, later loads read the
+// blocks from there and skip both decoding and encoding. HDR images load as RGBA16F and get their
+// mips on the GPU, or are prefiltered for image based lighting on the worker and cached the same way.
+// Textures are shared process wide: loading a file that is already loaded or loading returns the
+// same texture with one more reference, so every image is decoded and uploaded only once.
+// Texture memory is kept under a budget together with the render targets: textures nobody bound
+// for a few frames lose their top mips, then their storage altogether, least recently bound first,
+// and stream back in at full resolution once they are bound again.
+class TextureStreamer
+{
+public:
+	static inline TextureStreamer* instance{ nullptr };
+	static TextureStreamer* Get() { return instance; }
+
+	// 0 threads keeps one core free for the GL thread
+	explicit TextureStreamer(unsigned int threadCount = 0);
+	~TextureStreamer();
+
+	TextureStreamer(const TextureStreamer&) = delete;
+	TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+	// Adds a reference to the texture of this file, queueing it for decoding when it is new.
+	// Files are identified by canonical path and modification time, so an edited file loads anew.
+	// `prefilterEnvironment` only applies to RGBA16F, see PrefilterEnvironment.
+	// GL thread only, like everything below.
+	StreamedTexture* Load(const std::filesystem::path& path, bool flipVertically = false,
+		TextureFormat format = TextureFormat::RGBA8, bool prefilterEnvironment = false);
+
+	// Drops one reference. The last one deletes the texture, or drops it wherever it is in the pipeline.
+	void Release(StreamedTexture* texture);
+
+	size_t GetCachedCount() const { return cache.size(); }
+
+	// Marks the texture as bound this frame, a texture that was evicted is queued to come back.
+	void Touch(StreamedTexture* texture);
+
+	// `attachmentBytes` of render targets count against the budget but are never evicted. 0 is unlimited.
+	void SetMemoryBudget(size_t budget, size_t attachmentBytes);
+
+	// Uploads decoded images until about `byteBudget` bytes went out, at least one per call,
+	// then evicts down to the memory budget.
+	void Update(size_t byteBudget);
+
+	// Bindless handles are made resident once per GL texture, however many draw lists sample it.
+	// The first acquire makes the handle resident, the last release, or the texture being replaced,
+	// evicted or released, makes it non-resident again. Works for textures of any owner.
+	uint64_t AcquireTextureHandle(unsigned int id);
+	void ReleaseTextureHandle(unsigned int id, uint64_t handle);
+
+	size_t GetPendingCount() const;
+	uint64_t GetUploadCount() const { return uploadCount; }	// changes whenever a texture id changed
+	unsigned int GetThreadCount() const { return unsigned(workers.size()); }
+
+	size_t GetMemoryBudget() const { return memoryBudget; }
+	size_t GetTextureBytes() const { return textureBytes; }
+	size_t GetAttachmentBytes() const { return attachmentBytes; }
+	void GetEvictedCounts(size_t& reduced, size_t& evicted) const;
+
+private:
+	struct DecodedImage
+	{
+		StreamedTexture* texture{ nullptr };
+		unsigned char* pixels{ nullptr };	// RGBA8 level 0, mips are generated on upload
+		CompressedTexture chain;			// or the levels in the texture's format, mips missing here are generated
+		int width{ 0 };
+		int height{ 0 };
+		size_t bytes{ 0 };
+	};
+
+	void Work();
+	void CreateStaging(size_t size);
+	void DestroyStaging();
+
+	void Evict();
+	void Shrink(StreamedTexture* texture, int droppedLevels);
+	void Retire(unsigned int id);
+
+	std::vector<std::thread> workers;
+	mutable std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<StreamedTexture*> queue;
+	std::deque<DecodedImage> decoded;
+	size_t decodedBytes{ 0 };
+	size_t pending{ 0 };
+	bool stopping{ false };
+
+	// two halves used on alternating frames, each fenced before it is written again
+	unsigned int stagingBuffer{ 0 };
+	uint8_t* stagingData{ nullptr };
+	size_t stagingSize{ 0 };
+	void* stagingFences[2]{};
+	uint32_t stagingFrame{ 0 };
+
+	uint64_t uploadCount{ 0 };
+
+	uint64_t frame{ 0 };
+	size_t memoryBudget{ 0 };
+	size_t attachmentBytes{ 0 };
+	size_t textureBytes{ 0 };
+
+	// replaced textures live on for a few frames, draw lists drop their bindless handles meanwhile
+	std::vector<std::pair<unsigned int, uint64_t>> retired;
+
+	struct ResidentHandle
+	{
+		uint64_t handle;
+		int references;
+	};
+	std::unordered_map<unsigned int, ResidentHandle> residentHandles;	// by texture id
+
+	std::unordered_map<std::string, StreamedTexture*> cache;
+};
@@ -1,6 +1,16 @@
 #include "Utils.h"
+#include <algorithm>
 #include <fstream>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
 bool read_entire_file(const std::filesystem::path& path, std::string& string)
 {
 	std::ifstream file(path);
@@ -11,4 +21,74 @@ bool read_entire_file(const std::filesystem::path& path, std::string& string)
 	ss << file.rdbuf();
 	string = std::move(ss.str());
 	return true;
-}
\ No newline at end of file
+}
+
+std::string get_lowercase_extension(const std::filesystem::path& path)
+{
+	auto extension = path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(tolower(c)); });
+	return extension;
+}
+
+size_t get_peak_memory_usage()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters = {};
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return size_t(counters.PeakWorkingSetSize);
+#else
+	rusage usage = {};
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#ifdef __APPLE__
+	return size_t(usage.ru_maxrss);
+#else
+	return size_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+uint64_t Hash(uint64_t hash, const void* data, size_t size)
+{
+	auto bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+bool write_file_atomically(const std::filesystem::path& path, const std::function<bool(std::ofstream&)>& write)
+{
+	bool written = false;
+	{
+		std::ofstream stream(get_temporary_path(path), std::ios::binary | std::ios::trunc);
+		written = stream && write(stream) && stream;
+	}
+	return replace_with_temporary_file(path, written);
+}
+
+std::filesystem::path get_temporary_path(const std::filesystem::path& path)
+{
+	auto temp_path = path;
+	temp_path += ".tmp";
+	return temp_path;
+}
+
+bool replace_with_temporary_file(const std::filesystem::path& path, bool written)
+{
+	auto temp_path = get_temporary_path(path);
+
+	std::error_code error;
+	if (written)
+		std::filesystem::rename(temp_path, path, error);
+
+	if (!written || error)
+	{
+		std::filesystem::remove(temp_path, error);
+		return false;
+	}
+	return true;
+}
@@ -1,5 +1,33 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <filesystem>
+#include <fstream>
+#include <functional>
 #include <string>
 
-bool read_entire_file(const std::filesystem::path& path, std::string& string);
\ No newline at end of file
+bool read_entire_file(const std::filesystem::path& path, std::string& string);
+// ".png" for "Image.PNG", empty without an extension
+std::string get_lowercase_extension(const std::filesystem::path& path);
+// Highest resident memory of the whole process so far, 0 where the platform does not report it.
+size_t get_peak_memory_usage();
+
+// FNV-1a, start from FNV_OFFSET_BASIS
+constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+uint64_t Hash(uint64_t hash, const void* data, size_t size);
+
+template<typename T>
+uint64_t Hash(uint64_t hash, const T& value)
+{
+	return Hash(hash, &value, sizeof(T));
+}
+
+// Files are written under a temporary name and renamed into place once complete, so a crash never
+// leaves a half written file behind. Another thread writing the same file meanwhile is fine, either
+// copy wins. `write` returns false to give up, the temporary file is removed then.
+bool write_file_atomically(const std::filesystem::path& path, const std::function<bool(std::ofstream&)>& write);
+
+// The same for writers that keep the stream open across calls: write to get_temporary_path, close it,
+// then replace_with_temporary_file renames it into place if `written` or removes it.
+std::filesystem::path get_temporary_path(const std::filesystem::path& path);
+bool replace_with_temporary_file(const std::filesystem::path& path, bool written);
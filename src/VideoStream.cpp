@@ -0,0 +1,495 @@
+#include "VideoStream.h"
+#include "JinGL/JinGL.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <regex>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+namespace
+{
+#ifdef _WIN32
+	// copied next to the executable by the build
+	constexpr const char* FFMPEG = "ffmpeg.exe";
+#else
+	// from the PATH
+	constexpr const char* FFMPEG = "ffmpeg";
+#endif
+
+	// ffmpeg with its output on a pipe. Started from an argument list rather than through a shell,
+	// a dropped file name is never parsed as a command line.
+	struct Process
+	{
+		FILE* output{ nullptr };
+#ifdef _WIN32
+		HANDLE handle{ nullptr };
+#else
+		pid_t pid{ -1 };
+#endif
+	};
+
+#ifdef _WIN32
+	// the rules CommandLineToArgvW undoes, backslashes only need escaping before a quote
+	void AppendArgument(std::string& command_line, const std::string& argument)
+	{
+		command_line += command_line.empty() ? "\"" : " \"";
+		size_t backslashes = 0;
+		for (auto c : argument)
+		{
+			if (c == '\\')
+			{
+				backslashes++;
+				continue;
+			}
+
+			command_line.append(c == '"' ? backslashes * 2 + 1 : backslashes, '\\');
+			command_line += c;
+			backslashes = 0;
+		}
+		command_line.append(backslashes * 2, '\\');
+		command_line += '"';
+	}
+
+	Process StartProcess(const std::vector<std::string>& arguments, bool capture_errors)
+	{
+		SECURITY_ATTRIBUTES attributes{ sizeof(attributes), nullptr, TRUE };
+		HANDLE read_end, write_end;
+		if (!CreatePipe(&read_end, &write_end, &attributes, 0))
+			return {};
+		SetHandleInformation(read_end, HANDLE_FLAG_INHERIT, 0);
+
+		std::string command_line;
+		for (auto& argument : arguments)
+			AppendArgument(command_line, argument);
+
+		STARTUPINFOA startup{ sizeof(startup) };
+		startup.dwFlags = STARTF_USESTDHANDLES;
+		startup.hStdInput = nullptr;
+		startup.hStdOutput = write_end;
+		startup.hStdError = capture_errors ? write_end : GetStdHandle(STD_ERROR_HANDLE);
+
+		PROCESS_INFORMATION info{};
+		bool started = CreateProcessA(nullptr, command_line.data(), nullptr, nullptr, TRUE, CREATE_NO_WINDOW,
+			nullptr, nullptr, &startup, &info);
+		CloseHandle(write_end);
+		if (!started)
+		{
+			CloseHandle(read_end);
+			return {};
+		}
+		CloseHandle(info.hThread);
+
+		Process process;
+		process.output = _fdopen(_open_osfhandle(intptr_t(read_end), _O_RDONLY | _O_BINARY), "rb");
+		process.handle = info.hProcess;
+		return process;
+	}
+
+	// closing the pipe ends ffmpeg if it is still writing
+	void FinishProcess(Process& process)
+	{
+		if (process.output)
+			fclose(process.output);
+		if (process.handle)
+		{
+			WaitForSingleObject(process.handle, INFINITE);
+			CloseHandle(process.handle);
+		}
+		process = {};
+	}
+#else
+	Process StartProcess(const std::vector<std::string>& arguments, bool capture_errors)
+	{
+		int fds[2];
+		if (pipe(fds) != 0)
+			return {};
+
+		// other threads may spawn processes too, none of them should hold on to this pipe
+		fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+		fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+		posix_spawn_file_actions_t actions;
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+		if (capture_errors)
+			posix_spawn_file_actions_adddup2(&actions, fds[1], STDERR_FILENO);
+
+		std::vector<char*> argv;
+		for (auto& argument : arguments)
+			argv.push_back(const_cast<char*>(argument.c_str()));
+		argv.push_back(nullptr);
+
+		pid_t pid;
+		bool started = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ) == 0;
+		posix_spawn_file_actions_destroy(&actions);
+		close(fds[1]);
+		if (!started)
+		{
+			close(fds[0]);
+			return {};
+		}
+
+		Process process;
+		process.output = fdopen(fds[0], "r");
+		process.pid = pid;
+		return process;
+	}
+
+	// closing the pipe ends ffmpeg if it is still writing
+	void FinishProcess(Process& process)
+	{
+		if (process.output)
+			fclose(process.output);
+		if (process.pid > 0)
+			waitpid(process.pid, nullptr, 0);
+		process = {};
+	}
+#endif
+
+	// a time further ahead of the decoder than this seeks instead of waiting for it to catch up
+	constexpr float MAX_CATCH_UP_SECONDS = 1.0f;
+
+	// signed distance from b to a on a loop of `count` frames
+	int64_t GetLoopDistance(int64_t a, int64_t b, int64_t count)
+	{
+		auto distance = ((a - b) % count + count) % count;
+		return distance > count / 2 ? distance - count : distance;
+	}
+}
+
+bool VideoStream::IsVideoFile(const std::filesystem::path& path)
+{
+	auto extension = get_lowercase_extension(path);
+	return extension == ".mp4" || extension == ".mov" || extension == ".mkv" ||
+		extension == ".webm" || extension == ".avi" || extension == ".m4v";
+}
+
+VideoStream::VideoStream(const std::filesystem::path& path, bool flipVertically)
+	: path(path.string()), flipVertically(flipVertically)
+{
+	// even probing the file takes ffmpeg a moment, all of it happens on the decoder
+	decoder = std::thread([this] { Decode(); });
+}
+
+VideoStream::~VideoStream()
+{
+	{
+		std::lock_guard lock(mutex);
+		stopping = true;
+	}
+
+	wake.notify_all();
+	decoder.join();
+
+	DestroyResources();
+}
+
+bool VideoStream::Probe()
+{
+	// without an output ffmpeg only prints what it found in the input, to stderr
+	auto process = StartProcess({ FFMPEG, "-hide_banner", "-nostdin", "-i", path }, true);
+	if (process.output == nullptr)
+	{
+		FinishProcess(process);
+		return false;
+	}
+
+	std::string output;
+	char buffer[256];
+	while (fgets(buffer, sizeof(buffer), process.output) != nullptr)
+		output += buffer;
+	FinishProcess(process);
+
+	// "Duration: 00:01:02.50, start: ..." and "Stream #0:0: Video: h264 ..., 1920x1080 [SAR 1:1], 30 fps, 30 tbr"
+	int hours = 0, minutes = 0;
+	float seconds = 0.0f;
+	auto duration_at = output.find("Duration: ");
+	if (duration_at == std::string::npos ||
+		sscanf(output.c_str() + duration_at, "Duration: %d:%d:%f", &hours, &minutes, &seconds) != 3)
+	{
+		return false;
+	}
+
+	auto video_at = output.find("Video: ");
+	if (video_at == std::string::npos)
+		return false;
+
+	auto stream = output.substr(video_at, output.find('\n', video_at) - video_at);
+
+	std::smatch match;
+	if (!std::regex_search(stream, match, std::regex(R"(\b(\d{2,5})x(\d{2,5})\b)")))
+		return false;
+	width = std::stoi(match[1].str());
+	height = std::stoi(match[2].str());
+
+	if (std::regex_search(stream, match, std::regex(R"(([\d.]+) fps)")) ||
+		std::regex_search(stream, match, std::regex(R"(([\d.]+)k? tbr)")))
+	{
+		frameRate = std::stof(match[1].str());
+	}
+
+	duration = hours * 3600.0f + minutes * 60.0f + seconds;
+	frameCount = int64_t(duration * frameRate);
+	frameBytes = size_t(width) * size_t(height) * 4;
+
+	return frameRate > 0.0f && frameCount > 0;
+}
+
+void VideoStream::Decode()
+{
+	if (!Probe())
+	{
+		failed = true;
+		return;
+	}
+	probed = true;
+
+	Process ffmpeg;
+	uint64_t pipe_generation = 0;
+	int64_t start_frame = 0;
+	int64_t next_frame = 0;
+	int64_t frames_read = 0;
+
+	for (;;)
+	{
+		int slot = -1;
+		uint64_t wanted_generation = 0;
+		{
+			std::unique_lock lock(mutex);
+			wake.wait(lock, [&] {
+				return stopping || (resourcesReady && std::any_of(std::begin(slots), std::end(slots),
+					[](const Slot& s) { return s.state == SlotState::Free; }));
+			});
+
+			if (stopping)
+				break;
+
+			for (int i = 0; i < RING_SIZE && slot < 0; i++)
+			{
+				if (slots[i].state == SlotState::Free)
+					slot = i;
+			}
+
+			slots[slot].state = SlotState::Filling;
+			wanted_generation = generation;
+
+			if (wanted_generation != pipe_generation)
+				start_frame = seekFrame;
+		}
+
+		// a seek restarts ffmpeg at the new position
+		if (ffmpeg.output && wanted_generation != pipe_generation)
+			FinishProcess(ffmpeg);
+		pipe_generation = wanted_generation;
+
+		if (ffmpeg.output == nullptr)
+		{
+			std::vector<std::string> arguments = { FFMPEG, "-hide_banner", "-nostdin", "-loglevel", "error", "-noautorotate",
+				"-ss", std::to_string(float(start_frame) / frameRate), "-i", path, "-an", "-f", "rawvideo", "-pix_fmt", "rgba" };
+			if (flipVertically)
+				arguments.insert(arguments.end(), { "-vf", "vflip" });
+			arguments.push_back("-");
+
+			ffmpeg = StartProcess(arguments, false);
+			next_frame = start_frame;
+			frames_read = 0;
+		}
+
+		// straight into the mapped upload buffer, the GL thread only touches the slot once it is ready
+		bool read = ffmpeg.output && fread(uploadData + slot * frameBytes, 1, frameBytes, ffmpeg.output) == frameBytes;
+
+		if (!read)
+		{
+			// waits for ffmpeg to exit, so not under the lock the GL thread takes every frame
+			FinishProcess(ffmpeg);
+
+			std::lock_guard lock(mutex);
+			slots[slot].state = SlotState::Free;
+
+			// the end of the file plays it again from the start, nothing at all from the start is an error
+			if (frames_read == 0 && start_frame == 0)
+			{
+				failed = true;
+				break;
+			}
+
+			start_frame = 0;
+			continue;
+		}
+
+		std::lock_guard lock(mutex);
+
+		slots[slot].state = SlotState::Ready;
+		slots[slot].frame = next_frame % frameCount;
+		slots[slot].generation = pipe_generation;
+		if (pipe_generation == generation)
+			newestFrame = next_frame % frameCount;
+
+		next_frame++;
+		frames_read++;
+	}
+
+	FinishProcess(ffmpeg);
+}
+
+void VideoStream::Seek(int64_t frame)
+{
+	generation++;
+	seekFrame = frame;
+	newestFrame = -1;
+	wake.notify_one();
+}
+
+void VideoStream::Update(float time)
+{
+	if (!probed || failed)
+		return;
+
+	if (!resourcesReady)
+		CreateResources();
+
+	std::lock_guard lock(mutex);
+
+	// slots the GPU finished copying from go back to the decoder
+	for (auto& slot : slots)
+	{
+		if (slot.state != SlotState::Uploaded)
+			continue;
+
+		auto status = glClientWaitSync(GLsync(slot.fence), 0, 0);
+		if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+		{
+			glDeleteSync(GLsync(slot.fence));
+			slot.fence = nullptr;
+			slot.state = SlotState::Free;
+		}
+	}
+
+	auto looped = std::fmod(time, duration);
+	if (looped < 0.0f)
+		looped += duration;
+	auto target = std::min(int64_t(looped * frameRate), frameCount - 1);
+
+	// the newest frame that is due, everything before it will never be shown
+	int best = -1;
+	int64_t best_distance = 0;
+	int64_t oldest_future = INT64_MAX;
+	for (int i = 0; i < RING_SIZE; i++)
+	{
+		auto& slot = slots[i];
+		if (slot.state != SlotState::Ready)
+			continue;
+
+		if (slot.generation != generation)
+		{
+			slot.state = SlotState::Free;
+			continue;
+		}
+
+		auto distance = GetLoopDistance(target, slot.frame, frameCount);
+		if (distance < 0)
+		{
+			oldest_future = std::min(oldest_future, -distance);
+			continue;
+		}
+
+		if (best < 0 || distance < best_distance)
+		{
+			if (best >= 0)
+				slots[best].state = SlotState::Free;
+			best = i;
+			best_distance = distance;
+		}
+		else
+		{
+			slot.state = SlotState::Free;
+		}
+	}
+
+	if (best >= 0)
+	{
+		auto& slot = slots[best];
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer);
+		glTextureSubImage2D(texture, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (const void*)(best * frameBytes));
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slot.state = SlotState::Uploaded;
+		shownFrame = slot.frame;
+	}
+
+	// time went back past the decoded frames, or ran away from the decoder
+	auto decoded = newestFrame >= 0 ? newestFrame : seekFrame - 1;
+	bool behind = oldest_future != INT64_MAX ? oldest_future > 1 : GetLoopDistance(target, decoded, frameCount) < -1;
+	bool ahead = GetLoopDistance(target, decoded, frameCount) > int64_t(MAX_CATCH_UP_SECONDS * frameRate);
+	if (best < 0 && (behind || ahead))
+		Seek(target);
+
+	wake.notify_one();
+}
+
+float VideoStream::GetFrameTime() const
+{
+	return shownFrame >= 0 ? float(shownFrame) / frameRate : 0.0f;
+}
+
+void VideoStream::CreateResources()
+{
+	glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+	glTextureStorage2D(texture, 1, GL_RGBA8, width, height);
+	glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	auto size = GLsizeiptr(frameBytes * RING_SIZE);
+	glCreateBuffers(1, &uploadBuffer);
+	glNamedBufferStorage(uploadBuffer, size, nullptr, flags);
+	uploadData = (uint8_t*)glMapNamedBufferRange(uploadBuffer, 0, size, flags);
+
+	{
+		std::lock_guard lock(mutex);
+		resourcesReady = true;
+	}
+	wake.notify_one();
+}
+
+void VideoStream::DestroyResources()
+{
+	for (auto& slot : slots)
+	{
+		if (slot.fence)
+			glDeleteSync(GLsync(slot.fence));
+		slot.fence = nullptr;
+	}
+
+	if (uploadBuffer)
+	{
+		glUnmapNamedBuffer(uploadBuffer);
+		glDeleteBuffers(1, &uploadBuffer);
+	}
+
+	if (texture)
+		glDeleteTextures(1, &texture);
+
+	uploadBuffer = texture = 0;
+	uploadData = nullptr;
+}
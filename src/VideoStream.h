@@ -0,0 +1,86 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Plays a video file as a texture. A background thread runs ffmpeg and reads raw RGBA frames from
+// its pipe straight into a persistently mapped ring of upload buffers, the GL thread copies the
+// frame due at the current time into the texture. Neither side ever waits for the other: the
+// texture keeps its last frame while the decoder catches up, and a time that jumps away from the
+// decoded frames, like the preview transport controls do, restarts ffmpeg at the new position.
+class VideoStream
+{
+public:
+	static constexpr int RING_SIZE = 4;
+
+	static bool IsVideoFile(const std::filesystem::path& path);
+
+	VideoStream(const std::filesystem::path& path, bool flipVertically);
+	~VideoStream();
+
+	VideoStream(const VideoStream&) = delete;
+	VideoStream& operator=(const VideoStream&) = delete;
+
+	// Shows the frame at `time` seconds, looping over the video. GL thread only, like the getters.
+	void Update(float time);
+
+	const std::string& GetPath() const { return path; }
+	unsigned int GetTextureID() const { return texture; }
+	int GetWidth() const { return probed ? width : 0; }
+	int GetHeight() const { return probed ? height : 0; }
+	float GetDuration() const { return probed ? duration : 0.0f; }
+	float GetFrameRate() const { return probed ? frameRate : 0.0f; }
+	bool HasFailed() const { return failed; }
+
+	// Of the frame in the texture, what the shader gets as iChannelTime
+	float GetFrameTime() const;
+
+private:
+	enum class SlotState { Free, Filling, Ready, Uploaded };
+
+	struct Slot
+	{
+		SlotState state{ SlotState::Free };
+		int64_t frame{ 0 };
+		uint64_t generation{ 0 };
+		void* fence{ nullptr };		// GL thread only
+	};
+
+	void Decode();
+	bool Probe();
+	void Seek(int64_t frame);
+	void CreateResources();
+	void DestroyResources();
+
+	std::string path;
+	bool flipVertically;
+
+	// written by the decoder before `probed` is set
+	int width{ 0 };
+	int height{ 0 };
+	float frameRate{ 0.0f };
+	float duration{ 0.0f };
+	int64_t frameCount{ 0 };
+	std::atomic<bool> probed{ false };
+	std::atomic<bool> failed{ false };
+
+	std::thread decoder;
+	std::mutex mutex;
+	std::condition_variable wake;
+	Slot slots[RING_SIZE];
+	uint64_t generation{ 0 };		// bumped by every seek, frames of older ones are dropped
+	int64_t seekFrame{ 0 };
+	int64_t newestFrame{ -1 };		// last one decoded in this generation
+	bool resourcesReady{ false };
+	bool stopping{ false };
+
+	unsigned int texture{ 0 };
+	unsigned int uploadBuffer{ 0 };
+	uint8_t* uploadData{ nullptr };
+	size_t frameBytes{ 0 };
+	int64_t shownFrame{ -1 };
+};
@@ -0,0 +1,573 @@
+#include "VirtualTexture.h"
+#include "TextureCache.h"
+#include "TextureCompression.h"
+#include "Utils.h"
+#include "JinGL/JinGL.h"
+#include "ImageDecoder.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+	constexpr char MAGIC[4] = { 'S', 'A', 'V', 'T' };
+	constexpr uint32_t VERSION = 1;
+
+	constexpr size_t PAGE_BYTES = size_t(VirtualTexture::PAGE_SIZE) * VirtualTexture::PAGE_SIZE * 4;
+
+	// pages read ahead of the uploads, the loader pauses above this
+	constexpr size_t MAX_LOADED_PAGES = 64;
+
+	// pages used this recently are never replaced, so what is on screen does not thrash
+	constexpr uint64_t KEEP_FRAMES = 2;
+
+	// Page file layout: the header, the page index with a file page for every page id, then the
+	// pages, RGBA8 rows of PAGE_SIZE texels. Ids run level by level, row by row, with the levels
+	// of a square grid, pages wholly outside the image are not stored.
+	struct PageFileHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t width;
+		uint32_t height;
+		uint32_t grid;
+		uint32_t levels;
+		uint32_t idCount;
+		uint32_t pageCount;
+	};
+
+	static_assert(sizeof(PageFileHeader) == 32);
+
+	uint32_t GetIdCount(int grid, int levels)
+	{
+		uint32_t count = 0;
+		for (int level = 0; level < levels; level++)
+			count += uint32_t(grid >> level) * uint32_t(grid >> level);
+		return count;
+	}
+
+	// One level of the pyramid, cut into pages a band of PAGE_CONTENT rows at a time. Rows arrive in
+	// the order the image is read, top to bottom, which with `flip` is bottom up in the page file.
+	// Only the rows of the band being cut and its borders are kept.
+	struct LevelBuilder
+	{
+		int width;
+		int height;
+		int grid;						// pages on a side of the level's ids
+		uint32_t firstId;
+		int pagesX;
+		int pagesY;
+		int bandsCut{ 0 };
+		int rowsReceived{ 0 };
+		int firstRow{ 0 };				// of the window
+		std::vector<uint8_t> window;
+		std::vector<uint8_t> pairRow;	// waiting for the row it is averaged with
+		bool hasPairRow{ false };
+		std::vector<uint8_t> halfRow;
+	};
+
+	// Writes the pages of every level while the rows of the image stream through
+	class PageWriter
+	{
+	public:
+		PageWriter(std::ofstream& stream, std::vector<uint32_t>& index, uint32_t& pageCount, int width, int height,
+			int grid, int levels, bool flip)
+			: stream(stream), index(index), pageCount(pageCount), flip(flip), page(PAGE_BYTES)
+		{
+			uint32_t first_id = 0;
+			for (int level = 0; level < levels; level++)
+			{
+				int level_grid = grid >> level;
+				LevelBuilder builder{ width, height, level_grid, first_id };
+				builder.pagesX = (width + VirtualTexture::PAGE_CONTENT - 1) / VirtualTexture::PAGE_CONTENT;
+				builder.pagesY = (height + VirtualTexture::PAGE_CONTENT - 1) / VirtualTexture::PAGE_CONTENT;
+				builder.pairRow.resize(size_t(width) * 4);
+				this->levels.push_back(std::move(builder));
+
+				first_id += uint32_t(level_grid) * uint32_t(level_grid);
+				width = std::max(1, (width + 1) / 2);
+				height = std::max(1, (height + 1) / 2);
+				this->levels.back().halfRow.resize(size_t(width) * 4);
+			}
+		}
+
+		void AddRow(int level, const uint8_t* row)
+		{
+			auto& l = levels[level];
+			auto stride = size_t(l.width) * 4;
+			l.window.insert(l.window.end(), row, row + stride);
+			l.rowsReceived++;
+
+			// cut every band whose rows and borders are all in, then drop the rows no later band needs
+			int first = 0, end = 0;
+			while (l.bandsCut < l.pagesY)
+			{
+				GetBandRows(l, l.bandsCut, first, end);
+				if (l.rowsReceived < end)
+					break;
+
+				CutBand(l, flip ? l.pagesY - 1 - l.bandsCut : l.bandsCut);
+				if (++l.bandsCut < l.pagesY)
+				{
+					GetBandRows(l, l.bandsCut, first, end);
+					l.window.erase(l.window.begin(), l.window.begin() + size_t(first - l.firstRow) * stride);
+					l.firstRow = first;
+				}
+			}
+
+			if (level + 1 == int(levels.size()))
+				return;
+
+			// box filtered into the next level as soon as both rows of a pair are in, odd edges repeat
+			// their last row and texel
+			int y = GetLevelRow(l, l.rowsReceived - 1);
+			if ((y ^ 1) < l.height && !l.hasPairRow)
+			{
+				memcpy(l.pairRow.data(), row, stride);
+				l.hasPairRow = true;
+				return;
+			}
+
+			auto row0 = l.hasPairRow ? l.pairRow.data() : row;
+			l.hasPairRow = false;
+
+			int half_width = int(l.halfRow.size() / 4);
+			for (int x = 0; x < half_width; x++)
+			{
+				auto x0 = size_t(std::min(x * 2, l.width - 1)) * 4;
+				auto x1 = size_t(std::min(x * 2 + 1, l.width - 1)) * 4;
+				for (int c = 0; c < 4; c++)
+					l.halfRow[size_t(x) * 4 + c] = uint8_t((row0[x0 + c] + row0[x1 + c] + row[x0 + c] + row[x1 + c] + 2) / 4);
+			}
+			AddRow(level + 1, l.halfRow.data());
+		}
+
+		bool IsComplete() const
+		{
+			return std::all_of(levels.begin(), levels.end(), [](const LevelBuilder& l) { return l.bandsCut == l.pagesY; });
+		}
+
+	private:
+		// row of the level as the page file sees it, for the `received`th row to arrive
+		int GetLevelRow(const LevelBuilder& l, int received) const
+		{
+			return flip ? l.height - 1 - received : received;
+		}
+
+		// the rows, in arrival order, that the `band`th band to be cut and its borders are copied from
+		void GetBandRows(const LevelBuilder& l, int band, int& first, int& end) const
+		{
+			int y = flip ? l.pagesY - 1 - band : band;
+			int top = std::max(0, y * VirtualTexture::PAGE_CONTENT - VirtualTexture::PAGE_BORDER);
+			int bottom = std::min(l.height, (y + 1) * VirtualTexture::PAGE_CONTENT + VirtualTexture::PAGE_BORDER);
+			first = flip ? l.height - bottom : top;
+			end = flip ? l.height - top : bottom;
+		}
+
+		// Copies the pages of a row and their borders out of the window, the border clamps at the level's edges
+		void CutBand(const LevelBuilder& l, int pageY)
+		{
+			constexpr int SIZE = VirtualTexture::PAGE_SIZE;
+			int y0 = pageY * VirtualTexture::PAGE_CONTENT - VirtualTexture::PAGE_BORDER;
+
+			for (int pageX = 0; pageX < l.pagesX; pageX++)
+			{
+				int x0 = pageX * VirtualTexture::PAGE_CONTENT - VirtualTexture::PAGE_BORDER;
+				for (int y = 0; y < SIZE; y++)
+				{
+					int received = GetLevelRow(l, std::clamp(y0 + y, 0, l.height - 1));
+					auto row = l.window.data() + size_t(received - l.firstRow) * l.width * 4;
+					for (int x = 0; x < SIZE; x++)
+						memcpy(page.data() + (size_t(y) * SIZE + x) * 4, row + size_t(std::clamp(x0 + x, 0, l.width - 1)) * 4, 4);
+				}
+
+				index[l.firstId + uint32_t(pageY) * uint32_t(l.grid) + uint32_t(pageX)] = pageCount++;
+				stream.write((const char*)page.data(), page.size());
+			}
+		}
+
+		std::ofstream& stream;
+		std::vector<uint32_t>& index;
+		uint32_t& pageCount;
+		bool flip;
+		std::vector<LevelBuilder> levels;
+		std::vector<uint8_t> page;
+	};
+}
+
+bool VirtualTexture::IsLargeImage(const std::filesystem::path& path)
+{
+	int width = 0, height = 0, channels = 0;
+	return stbi_info(path.string().c_str(), &width, &height, &channels) &&
+		std::max(width, height) > MIN_VIRTUAL_SIZE;
+}
+
+VirtualTexture::VirtualTexture(const std::filesystem::path& path, bool flipVertically, int atlasSize)
+	: path(path.string()), flipVertically(flipVertically), atlasSize(std::clamp(atlasSize, 2, 255))
+{
+	// building the page file the first time takes as long as decoding the whole image, or longer
+	loader = std::thread([this] { Load(); });
+}
+
+VirtualTexture::~VirtualTexture()
+{
+	{
+		std::lock_guard lock(mutex);
+		stopping = true;
+	}
+
+	wake.notify_all();
+	loader.join();
+
+	if (atlas)
+		glDeleteTextures(1, &atlas);
+	if (pageTable)
+		glDeleteTextures(1, &pageTable);
+}
+
+size_t VirtualTexture::GetVideoMemoryBytes() const
+{
+	if (atlas == 0)
+		return 0;
+	return size_t(atlasSize) * atlasSize * PAGE_BYTES + tableEntries.size();
+}
+
+uint32_t VirtualTexture::GetPageId(int level, int x, int y) const
+{
+	return levelOffsets[level] + uint32_t(y) * uint32_t(grid >> level) + uint32_t(x);
+}
+
+const uint8_t* VirtualTexture::GetPageData(uint32_t page) const
+{
+	return file.GetData() + pagesOffset + size_t(pageIndex[page]) * PAGE_BYTES;
+}
+
+void VirtualTexture::Load()
+{
+	std::error_code error;
+	auto canonical = std::filesystem::weakly_canonical(path, error);
+	auto time = std::filesystem::last_write_time(canonical, error).time_since_epoch().count();
+
+	// like the texture cache, an edited image gets a new page file
+	auto source = (error ? std::filesystem::path(path) : canonical).generic_string() + "|" + std::to_string(time) +
+		(flipVertically ? "|flip" : "") + "|virtual";
+
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.vt", (unsigned long long)TextureCache::MakeKey(source, TextureFormat::RGBA8));
+	auto page_file = directory / name;
+
+	if (!OpenPageFile(page_file) && !(BuildPageFile(page_file) && OpenPageFile(page_file)))
+	{
+		failed = true;
+		return;
+	}
+	opened = true;
+
+	for (;;)
+	{
+		uint32_t page = NO_PAGE;
+		{
+			std::unique_lock lock(mutex);
+			wake.wait(lock, [&] { return stopping || (!requests.empty() && loaded.size() < MAX_LOADED_PAGES); });
+
+			if (stopping)
+				break;
+
+			page = requests.front();
+			requests.pop_front();
+		}
+
+		// reading the mapping is where the disk is hit, so it happens here and not on the GL thread
+		LoadedPage result{ page, std::vector<uint8_t>(PAGE_BYTES) };
+		memcpy(result.pixels.data(), GetPageData(page), PAGE_BYTES);
+
+		std::lock_guard lock(mutex);
+		loaded.push_back(std::move(result));
+	}
+}
+
+bool VirtualTexture::OpenPageFile(const std::filesystem::path& pageFile)
+{
+	if (!file.Open(pageFile))
+		return false;
+
+	PageFileHeader header = {};
+	if (file.GetSize() < sizeof(header))
+	{
+		file.Close();
+		return false;
+	}
+	memcpy(&header, file.GetData(), sizeof(header));
+
+	pagesOffset = sizeof(header) + size_t(header.idCount) * sizeof(uint32_t);
+	bool valid = memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == VERSION &&
+		header.levels > 0 && header.levels <= 31 && (1u << (header.levels - 1)) == header.grid && int(header.grid) <= MAX_GRID &&
+		header.idCount == GetIdCount(int(header.grid), int(header.levels)) &&
+		file.GetSize() >= pagesOffset + size_t(header.pageCount) * PAGE_BYTES;
+
+	if (!valid)
+	{
+		file.Close();
+		return false;
+	}
+
+	width = int(header.width);
+	height = int(header.height);
+	grid = int(header.grid);
+	levels = int(header.levels);
+
+	levelOffsets.resize(levels);
+	for (int level = 0; level < levels; level++)
+		levelOffsets[level] = GetIdCount(grid, level);
+
+	pageIndex.resize(header.idCount);
+	memcpy(pageIndex.data(), file.GetData() + sizeof(header), pageIndex.size() * sizeof(uint32_t));
+
+	// a damaged index must not send a read past the pages
+	if (!std::all_of(pageIndex.begin(), pageIndex.end(), [&](uint32_t p) { return p == NO_PAGE || p < header.pageCount; }))
+	{
+		file.Close();
+		return false;
+	}
+	return true;
+}
+
+bool VirtualTexture::BuildPageFile(const std::filesystem::path& pageFile)
+{
+	// read a row at a time and cut into pages a band at a time, the image is never in memory whole
+	ImageRowReader reader;
+	if (!reader.Open(path))
+		return false;
+
+	int image_width = reader.GetWidth();
+	int image_height = reader.GetHeight();
+	int pages = (std::max(image_width, image_height) + PAGE_CONTENT - 1) / PAGE_CONTENT;
+	int page_grid = 1;
+	while (page_grid < pages)
+		page_grid *= 2;
+
+	if (page_grid > MAX_GRID)
+		return false;
+
+	int level_count = 1;
+	while ((1 << (level_count - 1)) < page_grid)
+		level_count++;
+
+	PageFileHeader header = {};
+	memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.width = uint32_t(image_width);
+	header.height = uint32_t(image_height);
+	header.grid = uint32_t(page_grid);
+	header.levels = uint32_t(level_count);
+	header.idCount = GetIdCount(page_grid, level_count);
+
+	std::vector<uint32_t> index(header.idCount, NO_PAGE);
+
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+
+	return write_file_atomically(pageFile, [&](std::ofstream& stream) {
+		// the index is only known once every page was written
+		stream.write((const char*)&header, sizeof(header));
+		stream.write((const char*)index.data(), index.size() * sizeof(uint32_t));
+
+		PageWriter writer(stream, index, header.pageCount, image_width, image_height, page_grid, level_count, flipVertically);
+		std::vector<uint8_t> row(size_t(image_width) * 4);
+		for (int y = 0; y < image_height && stream; y++)
+		{
+			if (!reader.ReadRow(row.data()))
+				return false;
+			writer.AddRow(0, row.data());
+		}
+
+		stream.seekp(0);
+		stream.write((const char*)&header, sizeof(header));
+		stream.write((const char*)index.data(), index.size() * sizeof(uint32_t));
+		return writer.IsComplete();
+	});
+}
+
+void VirtualTexture::CreateResources()
+{
+	int atlas_texels = atlasSize * PAGE_SIZE;
+	glCreateTextures(GL_TEXTURE_2D, 1, &atlas);
+	glTextureStorage2D(atlas, 1, GL_RGBA8, atlas_texels, atlas_texels);
+	glTextureParameteri(atlas, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTextureParameteri(atlas, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTextureParameteri(atlas, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(atlas, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// one texel per page, the mips are the coarser levels
+	glCreateTextures(GL_TEXTURE_2D, 1, &pageTable);
+	glTextureStorage2D(pageTable, levels, GL_RGBA8UI, grid, grid);
+	glTextureParameteri(pageTable, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTextureParameteri(pageTable, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	slots.assign(size_t(atlasSize) * atlasSize, Slot{});
+	pageSlots.assign(pageIndex.size(), -1);
+	pending.assign(pageIndex.size(), 0);
+	tableEntries.assign(pageIndex.size() * 4, 0);
+
+	// the coarsest page is what every missing page falls back to in the end, read right away
+	auto top = GetPageId(levels - 1, 0, 0);
+	slots[0].page = top;
+	pageSlots[top] = 0;
+	UploadPage(top, GetPageData(top));
+	residentCount = 1;
+	tableDirty = true;
+}
+
+void VirtualTexture::UploadPage(uint32_t page, const uint8_t* pixels)
+{
+	auto slot = pageSlots[page];
+	int x = (slot % atlasSize) * PAGE_SIZE;
+	int y = (slot / atlasSize) * PAGE_SIZE;
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTextureSubImage2D(atlas, 0, x, y, PAGE_SIZE, PAGE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+}
+
+void VirtualTexture::Update(int maxUploads)
+{
+	if (!opened)
+		return;
+
+	if (atlas == 0)
+		CreateResources();
+
+	std::deque<LoadedPage> pages;
+	{
+		std::lock_guard lock(mutex);
+		auto count = std::min(loaded.size(), size_t(std::max(maxUploads, 1)));
+		pages.assign(std::make_move_iterator(loaded.begin()), std::make_move_iterator(loaded.begin() + count));
+		loaded.erase(loaded.begin(), loaded.begin() + count);
+	}
+	wake.notify_one();
+
+	for (auto& loaded_page : pages)
+	{
+		pending[loaded_page.page] = 0;
+		if (pageSlots[loaded_page.page] >= 0)
+			continue;
+
+		// a free slot, or else the one used longest ago, as long as it was not used just now
+		int slot = -1;
+		for (int i = 1; i < int(slots.size()); i++)
+		{
+			if (slots[i].page == NO_PAGE)
+			{
+				slot = i;
+				break;
+			}
+
+			if (slots[i].lastUsed + KEEP_FRAMES <= frame && (slot < 0 || slots[i].lastUsed < slots[slot].lastUsed))
+				slot = i;
+		}
+
+		// the atlas holds everything on screen already, the page is asked for again if it is still wanted
+		if (slot < 0)
+			continue;
+
+		if (slots[slot].page != NO_PAGE)
+			pageSlots[slots[slot].page] = -1;
+		else
+			residentCount++;
+
+		slots[slot] = { loaded_page.page, frame };
+		pageSlots[loaded_page.page] = slot;
+		UploadPage(loaded_page.page, loaded_page.pixels.data());
+		tableDirty = true;
+	}
+
+	if (tableDirty)
+		UpdatePageTable();
+}
+
+void VirtualTexture::UpdatePageTable()
+{
+	tableDirty = false;
+
+	// every entry points at its own page when resident, otherwise at what its parent points at
+	for (int level = levels - 1; level >= 0; level--)
+	{
+		int level_grid = grid >> level;
+		auto entries = tableEntries.data() + size_t(levelOffsets[level]) * 4;
+
+		for (int y = 0; y < level_grid; y++)
+		{
+			for (int x = 0; x < level_grid; x++)
+			{
+				auto id = GetPageId(level, x, y);
+				auto entry = entries + (size_t(y) * level_grid + x) * 4;
+				auto slot = pageSlots[id];
+
+				if (slot >= 0)
+				{
+					entry[0] = uint8_t(slot % atlasSize);
+					entry[1] = uint8_t(slot / atlasSize);
+					entry[2] = uint8_t(level);
+					entry[3] = 1;
+				}
+				else if (level + 1 < levels)
+				{
+					memcpy(entry, tableEntries.data() + size_t(GetPageId(level + 1, x / 2, y / 2)) * 4, 4);
+				}
+			}
+		}
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTextureSubImage2D(pageTable, level, 0, 0, level_grid, level_grid, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, entries);
+	}
+}
+
+void VirtualTexture::RequestPages(const uint32_t* feedback)
+{
+	if (atlas == 0)
+		return;
+
+	frame++;
+
+	std::vector<uint32_t> wanted;
+	for (size_t word = 0; word < (pageIndex.size() + 31) / 32; word++)
+	{
+		for (auto bits = feedback[word]; bits != 0; bits &= bits - 1)
+		{
+			auto id = uint32_t(word * 32 + size_t(std::countr_zero(bits)));
+			if (id >= pageIndex.size() || pageIndex[id] == NO_PAGE)
+				continue;
+
+			// the page and every coarser one it could fall back to stay, the request only goes out when missing
+			auto level = int(std::upper_bound(levelOffsets.begin(), levelOffsets.end(), id) - levelOffsets.begin()) - 1;
+			int x = int(id - levelOffsets[level]) % (grid >> level);
+			int y = int(id - levelOffsets[level]) / (grid >> level);
+
+			if (pageSlots[id] < 0 && !pending[id])
+				wanted.push_back(id);
+
+			for (; level < levels; level++, x /= 2, y /= 2)
+			{
+				auto slot = pageSlots[GetPageId(level, x, y)];
+				if (slot >= 0)
+					slots[slot].lastUsed = frame;
+			}
+		}
+	}
+
+	// coarse pages first, they replace the blurriest fallbacks and cover the most of the screen
+	std::sort(wanted.begin(), wanted.end(), [](uint32_t a, uint32_t b) { return a > b; });
+	wanted.resize(std::min(wanted.size(), slots.size() - 1));
+
+	std::lock_guard lock(mutex);
+	for (auto id : requests)
+		pending[id] = 0;
+
+	requests.assign(wanted.begin(), wanted.end());
+	for (auto id : requests)
+		pending[id] = 1;
+
+	wake.notify_one();
+}
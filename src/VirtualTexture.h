@@ -0,0 +1,129 @@
+#pragma once
+#include "MappedFile.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// An image far too large for a texture, sampled through a page table. The image is cut once into
+// square pages for every mip level and kept in a page file on disk. Shaders sample it with
+// textureVirtual from VirtualTexture.glsl, which also reports the pages it wanted in a feedback
+// buffer. The pass reads that buffer back a few frames later and hands it to RequestPages. A
+// loader thread then reads those pages from the mapped page file, and Update copies them into a
+// fixed size atlas. Video memory is the atlas and the page table, whatever the size of the image.
+// Missing pages fall back to the closest resident coarser level. The coarsest page is always
+// resident, so the whole image shows from the start.
+class VirtualTexture
+{
+public:
+	static constexpr int PAGE_SIZE = 128;		// texels on a side of a page in the atlas, border included
+	static constexpr int PAGE_BORDER = 4;		// copied from the neighbours so filtering never reads another page
+	static constexpr int PAGE_CONTENT = PAGE_SIZE - 2 * PAGE_BORDER;
+	static constexpr int MAX_GRID = 1024;		// level 0 pages on a side, 122880 texels
+
+	// see VirtualTexture.glsl, channel i has its page table on unit PAGE_TABLE_BINDING + i and
+	// its feedback bits at word i * FEEDBACK_WORDS of the buffer
+	static constexpr unsigned int PAGE_TABLE_BINDING = 16;
+	static constexpr unsigned int FEEDBACK_BINDING = 8;
+	static constexpr size_t FEEDBACK_WORDS = 1 << 16;	// a bit for every page of a MAX_GRID pyramid
+
+	// images this large on a side do not fit into a texture on most drivers
+	static constexpr int MIN_VIRTUAL_SIZE = 16384;
+
+	static inline std::filesystem::path directory = "Cache\\VirtualTextures\\";
+
+	static bool IsLargeImage(const std::filesystem::path& path);
+
+	// At most `atlasSize` x `atlasSize` pages are resident, 32 is a 4096 x 4096 RGBA8 atlas or 64 MB
+	VirtualTexture(const std::filesystem::path& path, bool flipVertically, int atlasSize = 32);
+	~VirtualTexture();
+
+	VirtualTexture(const VirtualTexture&) = delete;
+	VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+	// Copies up to `maxUploads` pages the loader read into the atlas and updates the page table.
+	// GL thread only, like everything below.
+	void Update(int maxUploads);
+
+	// Queues the pages whose bits are set in a frame's feedback, coarse levels first, in place of the
+	// requests still waiting. Resident pages and the pages standing in for the wanted ones count as used.
+	void RequestPages(const uint32_t* feedback);
+
+	const std::string& GetPath() const { return path; }
+	unsigned int GetAtlasTexture() const { return atlas; }
+	unsigned int GetPageTableTexture() const { return pageTable; }
+	int GetWidth() const { return opened ? width : 0; }
+	int GetHeight() const { return opened ? height : 0; }
+	int GetLevelCount() const { return opened ? levels : 0; }
+	bool IsOpen() const { return opened; }
+	bool HasFailed() const { return failed; }
+
+	int GetResidentPageCount() const { return residentCount; }
+	int GetAtlasPageCount() const { return atlasSize * atlasSize; }
+	size_t GetVideoMemoryBytes() const;
+
+private:
+	static constexpr uint32_t NO_PAGE = ~0u;
+
+	struct LoadedPage
+	{
+		uint32_t page;
+		std::vector<uint8_t> pixels;
+	};
+
+	struct Slot
+	{
+		uint32_t page{ NO_PAGE };
+		uint64_t lastUsed{ 0 };
+	};
+
+	void Load();
+	bool OpenPageFile(const std::filesystem::path& pageFile);
+	bool BuildPageFile(const std::filesystem::path& pageFile);
+	void CreateResources();
+	void UploadPage(uint32_t page, const uint8_t* pixels);
+	void UpdatePageTable();
+
+	uint32_t GetPageId(int level, int x, int y) const;
+	const uint8_t* GetPageData(uint32_t page) const;
+
+	std::string path;
+	bool flipVertically;
+	int atlasSize;
+
+	// written by the loader before `opened` is set
+	int width{ 0 };
+	int height{ 0 };
+	int grid{ 0 };							// level 0 pages on a side, a power of two
+	int levels{ 0 };
+	std::vector<uint32_t> levelOffsets;		// page id of every level's first page
+	std::vector<uint32_t> pageIndex;		// page id to page in the file, NO_PAGE outside the image
+	MappedFile file;
+	size_t pagesOffset{ 0 };
+	std::atomic<bool> opened{ false };
+	std::atomic<bool> failed{ false };
+
+	std::thread loader;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<uint32_t> requests;
+	std::deque<LoadedPage> loaded;
+	bool stopping{ false };
+
+	// GL thread
+	unsigned int atlas{ 0 };
+	unsigned int pageTable{ 0 };
+	std::vector<Slot> slots;				// slot 0 holds the coarsest page for good
+	std::vector<int32_t> pageSlots;			// page id to atlas slot, -1 when not resident
+	std::vector<uint8_t> pending;			// page id queued or being read
+	std::vector<uint8_t> tableEntries;		// RGBA8UI of every level: slot x, slot y, level, resident
+	bool tableDirty{ false };
+	int residentCount{ 0 };
+	uint64_t frame{ 0 };
+};